@@ -0,0 +1,34 @@
+/*******************************************************************************
+ * File Name	: boot.h (host build)
+ * Project	: BootHID
+ * Date		: 2026/10/19
+ * Version      : 1.0
+ * Target MCU   : host build of usb_hid.c
+ * Tool Chain   : cc
+ * Author       : bootloadHID contributors
+ * Release Notes:
+ *	Stub of <avr/boot.h>: SPM instructions of the emulated flash.
+ *
+ * $Id$
+ ******************************************************************************/
+
+#ifndef __host_avr_boot_h__
+#define __host_avr_boot_h__
+
+#include "hostsim.h"
+
+#define boot_page_erase( a )		host_spm_erase( a )
+#define boot_page_fill( a, w )		host_spm_fill( a, w )
+#define boot_page_write( a )		host_spm_write( a )
+#define boot_rww_enable()		host_spm_rww_enable()
+#define boot_spm_busy()			host_spm_busy()
+#define boot_spm_busy_wait()		host_spm_busy_wait()
+
+// for jmp_bootloader() in includes.h, which usb_hid.c does not call
+
+#define GET_HIGH_FUSE_BITS		0x0003
+#define FUSE_BOOTSZ0			(unsigned char)~_BV(1)
+#define FUSE_BOOTSZ1			(unsigned char)~_BV(2)
+#define boot_lock_fuse_bits_get( a )	0xFF
+
+#endif
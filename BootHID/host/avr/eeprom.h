@@ -0,0 +1,24 @@
+/*******************************************************************************
+ * File Name	: eeprom.h (host build)
+ * Project	: BootHID
+ * Date		: 2026/10/19
+ * Version      : 1.0
+ * Target MCU   : host build of usb_hid.c
+ * Tool Chain   : cc
+ * Author       : bootloadHID contributors
+ * Release Notes:
+ *	Stub of <avr/eeprom.h>: the emulated EEPROM.
+ *
+ * $Id$
+ ******************************************************************************/
+
+#ifndef __host_avr_eeprom_h__
+#define __host_avr_eeprom_h__
+
+#include "hostsim.h"
+
+#define eeprom_read_byte( a )		host_eeprom_read( (unsigned long)(a) )
+#define eeprom_update_byte( a, v )	host_eeprom_update( (unsigned long)(a), v )
+#define eeprom_busy_wait()		host_eeprom_busy_wait()
+
+#endif
@@ -0,0 +1,28 @@
+/*******************************************************************************
+ * File Name	: interrupt.h (host build)
+ * Project	: BootHID
+ * Date		: 2026/10/19
+ * Version      : 1.0
+ * Target MCU   : host build of usb_hid.c
+ * Tool Chain   : cc
+ * Author       : bootloadHID contributors
+ * Release Notes:
+ *	Stub of <avr/interrupt.h>. An ISR is a function which hostsim.c
+ *	calls with interrupts disabled, reti() enables them again.
+ *
+ * $Id$
+ ******************************************************************************/
+
+#ifndef __host_avr_interrupt_h__
+#define __host_avr_interrupt_h__
+
+#include "hostsim.h"
+
+#define cli()			host_cli()
+#define sei()			host_sei()
+
+#define ISR( vector, ... )	void vector ( void )
+#define ISR_NAKED
+#define reti()			do { host_sei() ; return ; } while ( 0 )
+
+#endif
@@ -0,0 +1,166 @@
+/*******************************************************************************
+ * File Name	: io.h (host build)
+ * Project	: BootHID
+ * Date		: 2026/10/19
+ * Version      : 1.0
+ * Target MCU   : host build of usb_hid.c
+ * Tool Chain   : cc
+ * Author       : bootloadHID contributors
+ * Release Notes:
+ *	Stub of <avr/io.h>. The chip is selected with its avr-gcc macro
+ *	(e.g. -D__AVR_ATmega32U4__, see HOSTDEVICE in default/Makefile), the
+ *	memory sizes follow from it. The registers used by usb_hid.c are
+ *	fields of host_io and host_ep, or functions of hostsim.c where an
+ *	access has side effects.
+ *
+ * $Id$
+ ******************************************************************************/
+
+#ifndef __host_avr_io_h__
+#define __host_avr_io_h__
+
+#include <stdint.h>
+#include "hostsim.h"
+
+//------------------------------------------------------------------------------
+// Memory sizes
+
+#if defined(__AVR_AT90USB1286__)
+ #define FLASHEND		0x1FFFF
+ #define SPM_PAGESIZE		256
+ #define E2END			0xFFF
+#elif defined(__AVR_AT90USB646__)
+ #define FLASHEND		0xFFFF
+ #define SPM_PAGESIZE		256
+ #define E2END			0x7FF
+#elif defined(__AVR_ATmega32U4__) || defined(__AVR_ATmega32U2__)
+ #define FLASHEND		0x7FFF
+ #define SPM_PAGESIZE		128
+ #define E2END			0x3FF
+#elif defined(__AVR_ATmega16U4__) || defined(__AVR_ATmega16U2__) || defined(__AVR_AT90USB162__)
+ #define FLASHEND		0x3FFF
+ #define SPM_PAGESIZE		128
+ #define E2END			0x1FF
+#elif defined(__AVR_AT90USB82__)
+ #define FLASHEND		0x1FFF
+ #define SPM_PAGESIZE		128
+ #define E2END			0x1FF
+#elif defined(__AVR_ATmega8U2__)
+ #define FLASHEND		0x1FFF
+ #define SPM_PAGESIZE		64
+ #define E2END			0x1FF
+#endif
+
+//------------------------------------------------------------------------------
+// Registers
+
+#define UHWCON			host_io.uhwcon
+#define USBCON			host_io.usbcon
+#define UDCON			host_io.udcon
+#define UDIEN			host_io.udien
+#define UDINT			host_io.udint
+#define UDADDR			host_io.udaddr
+#define UENUM			host_io.uenum
+#define UERST			host_io.uerst
+#define MCUCR			host_io.mcucr
+#define SMCR			host_io.smcr
+#define SREG			host_io.sreg
+#define DDRB			host_io.ddrb
+#define PORTB			host_io.portb
+#define DDRD			host_io.ddrd
+#define PORTD			host_io.portd
+#define TCCR1B			host_io.tccr1b
+
+#define UECONX			host_ep[UENUM & 7].ueconx
+#define UECFG0X			host_ep[UENUM & 7].uecfg0x
+#define UECFG1X			host_ep[UENUM & 7].uecfg1x
+#define UEIENX			host_ep[UENUM & 7].ueienx
+
+#define UEINTX			(*host_ueintx())
+#define UEDATX			(*host_uedatx())
+#define PLLCSR			(*host_pllcsr())
+#define TCNT1			(*host_tcnt1())
+
+#define USB_GEN_vect		host_usb_general
+#define USB_COM_vect		host_usb_endpoint
+
+//------------------------------------------------------------------------------
+// Register bits
+
+#define UVREGE			0	// UHWCON
+#define UIDE			6
+#define UIMOD			7
+
+#define PLOCK			0	// PLLCSR
+#define PLLE			1
+#define PLLP0			2
+#define PLLP1			3
+#define PLLP2			4
+#define PINDIV			4
+
+#define VBUSTE			0	// USBCON
+#define OTGPADE			4
+#define FRZCLK			5
+#define HOST			6
+#define USBE			7
+
+#define DETACH			0	// UDCON
+#define EORSTE			3	// UDIEN
+#define EORSTI			3	// UDINT
+#define ADDEN			7	// UDADDR
+
+#define EPEN			0	// UECONX
+#define STALLRQ			5
+
+#define EPDIR			0	// UECFG0X
+#define EPTYPE0			6
+#define EPTYPE1			7
+
+#define ALLOC			1	// UECFG1X
+#define EPBK0			2
+#define EPBK1			3
+#define EPSIZE0			4
+#define EPSIZE1			5
+#define EPSIZE2			6
+
+#define RXSTPE			3	// UEIENX
+
+#define TXINI			0	// UEINTX
+#define STALLEDI		1
+#define RXOUTI			2
+#define RXSTPI			3
+#define NAKOUTI			4
+#define RWAL			5
+#define NAKINI			6
+#define FIFOCON			7
+
+#define IVCE			0	// MCUCR
+#define IVSEL			1
+
+#define SE			0	// SMCR
+#define SM0			1
+#define SM1			2
+#define SM2			3
+
+#define CS10			0	// TCCR1B
+#define CS11			1
+#define CS12			2
+
+#define PORTB0			0	// includes.h maps PB0 to it on the ATmegaXU4
+#define PORTD5			5
+
+#if ! defined(__AVR_ATmega16U4__) && ! defined(__AVR_ATmega32U4__)
+ #define PB0			0
+ #define PD5			5
+#endif
+
+//------------------------------------------------------------------------------
+// <avr/sfr_defs.h>
+
+#define _BV( bit )		(1 << (bit))
+#define _SFR_BYTE( sfr )	(sfr)
+#define bit_is_set( sfr, bit )	(_SFR_BYTE(sfr) & _BV(bit))
+#define bit_is_clear( sfr, bit ) (!(_SFR_BYTE(sfr) & _BV(bit)))
+
+//------------------------------------------------------------------------------
+#endif
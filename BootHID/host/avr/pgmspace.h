@@ -0,0 +1,33 @@
+/*******************************************************************************
+ * File Name	: pgmspace.h (host build)
+ * Project	: BootHID
+ * Date		: 2026/10/19
+ * Version      : 1.0
+ * Target MCU   : host build of usb_hid.c
+ * Tool Chain   : cc
+ * Author       : bootloadHID contributors
+ * Release Notes:
+ *	Stub of <avr/pgmspace.h>. usb_hid.c reads the application flash
+ *	with integer addresses and its own PROGMEM data (the descriptors)
+ *	with pointers, so the argument type selects the memory.
+ *
+ * $Id$
+ ******************************************************************************/
+
+#ifndef __host_avr_pgmspace_h__
+#define __host_avr_pgmspace_h__
+
+#include "hostsim.h"
+
+#define PROGMEM
+
+#define pgm_read_byte( a )	_Generic( (a),				\
+				    unsigned short: host_flash_read,	\
+				    int: host_flash_read,		\
+				    unsigned: host_flash_read,		\
+				    long: host_flash_read,		\
+				    unsigned long: host_flash_read,	\
+				    default: host_progmem_read )( a )
+#define pgm_read_byte_far( a )	host_flash_read( a )
+
+#endif
@@ -0,0 +1,18 @@
+/*******************************************************************************
+ * File Name	: power.h (host build)
+ * Project	: BootHID
+ * Date		: 2026/10/19
+ * Version      : 1.0
+ * Target MCU   : host build of usb_hid.c
+ * Tool Chain   : cc
+ * Author       : bootloadHID contributors
+ * Release Notes:
+ *	Stub of <avr/power.h>, usb_hid.c uses none of it.
+ *
+ * $Id$
+ ******************************************************************************/
+
+#ifndef __host_avr_power_h__
+#define __host_avr_power_h__
+
+#endif
@@ -0,0 +1,21 @@
+/*******************************************************************************
+ * File Name	: sleep.h (host build)
+ * Project	: BootHID
+ * Date		: 2026/10/19
+ * Version      : 1.0
+ * Target MCU   : host build of usb_hid.c
+ * Tool Chain   : cc
+ * Author       : bootloadHID contributors
+ * Release Notes:
+ *	Stub of <avr/sleep.h>: hostsim.c runs the main loop between
+ *	transfers, sleeping returns at once.
+ *
+ * $Id$
+ ******************************************************************************/
+
+#ifndef __host_avr_sleep_h__
+#define __host_avr_sleep_h__
+
+#define sleep_cpu()		((void)0)
+
+#endif
@@ -0,0 +1,21 @@
+/*******************************************************************************
+ * File Name	: wdt.h (host build)
+ * Project	: BootHID
+ * Date		: 2026/10/19
+ * Version      : 1.0
+ * Target MCU   : host build of usb_hid.c
+ * Tool Chain   : cc
+ * Author       : bootloadHID contributors
+ * Release Notes:
+ *	Stub of <avr/wdt.h>, usb_hid.c uses none of it.
+ *
+ * $Id$
+ ******************************************************************************/
+
+#ifndef __host_avr_wdt_h__
+#define __host_avr_wdt_h__
+
+#define wdt_reset()		((void)0)
+#define wdt_disable()		((void)0)
+
+#endif
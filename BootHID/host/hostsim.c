@@ -0,0 +1,1411 @@
+/*******************************************************************************
+ * File Name	: hostsim.c
+ * Project	: BootHID
+ * Date		: 2026/10/19
+ * Version      : 1.0
+ * Target MCU   : host build of usb_hid.c
+ * Tool Chain   : cc
+ * Author       : bootloadHID contributors
+ * Release Notes:
+ *	Host build of the boot loader ("make hostsim" in default/). usb_hid.c
+ *	is compiled with the stub headers in this directory instead of
+ *	avr-libc, its two USB interrupt routines run on the build machine
+ *	against an emulated device:
+ *
+ *	- The USB controller's endpoint 0 and 1 with UENUM, UEINTX and
+ *	  UEDATX. Control transfers arrive as a SETUP packet and a data
+ *	  stage in packets of up to 64 bytes, as the host controller sends
+ *	  them. UEINTX flags written as 0 are cleared and start the
+ *	  controller's action: an IN packet is sent, the next OUT packet is
+ *	  received. Reading UEDATX beyond an OUT packet or writing beyond
+ *	  the bank, and polling UEINTX for something that never comes, are
+ *	  errors.
+ *	- The flash has a temporary page buffer, page erase and page write
+ *	  like the real SPM unit. Write ANDs the buffer into the page, so a
+ *	  missing erase shows up as wrong data. Erase and write keep the SPM
+ *	  unit busy for the programming time, and the RWW section is
+ *	  unreadable until boot_rww_enable(). SPM instructions while busy,
+ *	  reads of the busy RWW section, words filled twice, SPM with
+ *	  interrupts enabled and writes into the boot loader section are
+ *	  counted as errors.
+ *	- The EEPROM takes the EEPROM write time per changed byte.
+ *	- The main loop (usb_idle()) runs between transfers, and with
+ *	  USE_STATUS the host polls EP1 every HID_POLL_INTERVAL. Each
+ *	  report 6 must name a page of the upload in order, and the last one
+ *	  the last page.
+ *
+ *	The time is emulated: each transfer costs the transfer overhead, each
+ *	packet the packet time (defaults from the "boothid" model of the
+ *	command line utility's --plan), and busy waits advance to the end of
+ *	the SPM or EEPROM operation. The firmware's own CPU time is not
+ *	counted. A status stage completed before a busy wait lets the host
+ *	start the next transfer meanwhile.
+ *
+ *	Usage: hostsim [-p <us>] [-o <us>] [-s <us>] [-n <passes>]
+ *	               [-f <hexfile>] <intel-hexfile>
+ *
+ *	The device is enumerated (descriptors, address, configuration) and
+ *	report 1 is read. The flash is blank or holds the "-f" file. The
+ *	image is uploaded <passes> times with report 2 (128 bytes per
+ *	report, the last one short with USE_SHORT_DATA), or with report 7
+ *	for pages whose changes fit into one (USE_PATCH, the uploads start
+ *	from the known flash contents like the command line utility's
+ *	registry). Then the optional reports are checked: report 3 reads the
+ *	flash back, report 5's CRC is compared, report 4 writes and reads
+ *	the EEPROM, report 8 is printed. Report 1 finally starts the
+ *	application and the flash is compared with the image. The exit code
+ *	is 0 if it matches and no errors were counted.
+ *
+ * $Id$
+ ******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+
+#include <includes.h>
+
+// exit_bl() jumps to the application
+
+#undef JMP
+#define JMP( _a )	host_jump( _a )
+
+// The AVR build packs the structures of report 1 and 8 (-fpack-struct)
+
+#pragma pack(1)
+#include "../usb_hid.c"
+#pragma pack()
+
+#define HOST_FLASH_SIZE		((long)FLASHEND + 1)
+#define HOST_EEPROM_SIZE	((long)E2END + 1)
+#define HOST_BOOT_START		(BOOTLOADER_ADDRESS ? (long)BOOTLOADER_ADDRESS : HOST_FLASH_SIZE - 1024)
+#define HOST_BLOCK_SIZE		128		// data bytes per report 2
+#define HOST_PATCH_SIZE		32		// data bytes per report 7
+#define HOST_SPIN_LIMIT		1000000L	// polls of UEINTX without progress
+
+volatile host_io_t
+    host_io ;
+
+host_ep_t
+    host_ep[8] ;
+
+static uint8_t
+    host_flash[HOST_FLASH_SIZE], host_eeprom[HOST_EEPROM_SIZE],
+    host_image[HOST_FLASH_SIZE], host_base[HOST_FLASH_SIZE],
+    host_temp[SPM_PAGESIZE], host_temp_filled[SPM_PAGESIZE / 2] ;
+
+static int
+    host_interrupts, host_rww_locked ;
+
+static long
+    host_spins,				// UEINTX polls since the last progress
+    host_last_page,			// written last by host_upload(), -1 if none
+    host_patches, host_patch_bytes ;
+
+static double				// seconds
+    host_now, host_spm_ready, host_eeprom_ready,
+    host_packet_time   = 64e-6,
+    host_transfer_time = 1e-3,
+    host_spm_time      = 4.5e-3,
+    host_eeprom_time   = 3.4e-3 ;
+
+static jmp_buf
+    host_application, host_hang ;
+
+static unsigned long
+    host_jump_addr ;
+
+static struct host_counters
+    {
+	long   erases, writes, fills, rww_enables, eeprom_writes ;
+	long   transfers, packets ;
+	double spm_wait ;		// seconds in boot_spm_busy_wait()
+	// errors:
+	long   spm_while_busy ;		// SPM instruction while the SPM unit was busy
+	long   spm_with_eeprom ;	// SPM or EEPROM write while the other was busy
+	long   spm_unlocked ;		// SPM instruction with interrupts enabled
+	long   refills ;		// temporary buffer word written twice
+	long   busy_reads ;		// RWW section read while not readable
+	long   boot_writes ;		// erase or write of the boot loader section
+	long   bad_status ;		// report 6 out of order or overwritten
+	long   bank_errors ;		// UEDATX beyond the packet or bank
+	long   protocol ;		// packets after or status stage before the data
+    }
+    host_count ;
+
+// The current control transfer, as the host controller sees it
+
+static struct
+    {
+	uint8_t  type ;			// bmRequestType, bit 7 set for IN
+	uint8_t  *data ;
+	uint16_t len, pos ;		// wLength, bytes transferred
+	uint8_t  done ;			// status stage completed
+	double   done_time ;
+    }
+    host_xfer ;
+
+static struct host_status
+    {
+	uint8_t  report[8] ;
+	int      full ;			// report waits for the host
+	double   next_poll ;
+	long     reports ;
+	long     expect ;		// next page the device may confirm
+	long     last ;			// page confirmed last, -1 if none
+    }
+    host_status ;
+
+//------------------------------------------------------------------------------
+// USB controller
+
+static void host_packet ( void )
+{
+    host_now += host_packet_time ;
+    host_count.packets++ ;
+}
+
+static void host_out_packet ( void )
+// the host sends the next OUT packet of the data stage
+{
+    host_ep_t
+	*ep = host_ep ;
+    uint16_t
+	n = host_xfer.len - host_xfer.pos ;
+
+    if ( n > ENDPOINT0_SIZE )
+	n = ENDPOINT0_SIZE ;
+
+    memcpy( ep->bank, host_xfer.data + host_xfer.pos, n ) ;
+    ep->len  = n ;
+    ep->pos  = 0 ;
+    ep->intx |= _BV( RXOUTI ) ;
+    host_xfer.pos += n ;
+    host_packet() ;
+}
+
+static void host_ep0_cleared ( uint8_t cleared )
+{
+    host_ep_t
+	*ep = host_ep ;
+    uint8_t
+	n ;
+
+    if ( cleared & _BV( RXSTPI ) )
+    {
+	// SETUP acknowledged, the bank is free, the data stage starts
+
+	ep->len = ep->pos = 0 ;
+	ep->intx |= _BV( TXINI ) ;
+
+	if ( ! (host_xfer.type & 0x80) && host_xfer.len )
+	    host_out_packet() ;
+
+	return ;
+    }
+
+    if ( (cleared & _BV( RXOUTI )) && ! (host_xfer.type & 0x80) && host_xfer.pos < host_xfer.len )
+	host_out_packet() ;
+
+    if ( cleared & _BV( TXINI ) )
+    {
+	// IN packet sent: data, or the ZLP of the status stage
+
+	n = ep->len ;
+	ep->len = ep->pos = 0 ;
+	host_packet() ;
+
+	if ( host_xfer.done )
+	    host_count.protocol++ ;
+	else
+	if ( host_xfer.type & 0x80 )
+	{
+	    if ( n > host_xfer.len - host_xfer.pos )
+	    {
+		host_count.bank_errors++ ;	// more than wLength
+		n = host_xfer.len - host_xfer.pos ;
+	    }
+
+	    memcpy( host_xfer.data + host_xfer.pos, ep->bank, n ) ;
+	    host_xfer.pos += n ;
+
+	    if ( n < ENDPOINT0_SIZE || host_xfer.pos == host_xfer.len )
+	    {
+		// a short packet or wLength ends the data stage, the host
+		// sends the ZLP of the status stage
+
+		host_xfer.done = 1 ;
+		host_xfer.done_time = host_now ;
+		ep->intx |= _BV( RXOUTI ) ;
+	    }
+	}
+	else
+	{
+	    if ( host_xfer.pos < host_xfer.len || (ep->intx & _BV( RXOUTI )) )
+		host_count.protocol++ ;		// data not yet received
+
+	    host_xfer.done = 1 ;
+	    host_xfer.done_time = host_now ;
+	}
+
+	ep->intx |= _BV( TXINI ) ;
+    }
+}
+
+static void host_ep1_cleared ( uint8_t cleared )
+{
+    host_ep_t
+	*ep = host_ep + 1 ;
+
+    if ( cleared & _BV( FIFOCON ) )
+    {
+	// bank handed to the controller, it waits for the host's poll
+
+	if ( host_status.full || ep->len > sizeof( host_status.report ) )
+	    host_count.bad_status++ ;
+	else
+	{
+	    memcpy( host_status.report, ep->bank, ep->len ) ;
+	    host_status.full = 1 ;
+	}
+
+	ep->len = 0 ;
+	ep->intx &= ~_BV( RWAL ) ;
+    }
+}
+
+static void host_usb_sync ( void )
+// Applies what the firmware wrote to UEINTX since it last read it. Called
+// before every access to the controller and the SPM unit, so the actions
+// take place in program order. Writing the value read is a no-op, as on
+// the chip.
+{
+    host_ep_t
+	*ep ;
+    uint8_t
+	e, cleared ;
+
+    for ( e = 0 ; e < 2 ; e++ )
+    {
+	ep = host_ep + e ;
+
+	if ( ep->reg == ep->shown )
+	    continue ;
+
+	cleared = ep->intx & ~ep->reg & ~_BV( RWAL ) ;	// RWAL is read-only
+	ep->intx &= ~cleared ;
+	host_spins = 0 ;
+
+	if ( e )
+	    host_ep1_cleared( cleared ) ;
+	else
+	    host_ep0_cleared( cleared ) ;
+
+	ep->reg = ep->shown = ep->intx ;
+    }
+}
+
+volatile uint8_t *host_ueintx ( void )
+{
+    host_ep_t
+	*ep ;
+
+    host_usb_sync() ;
+
+    if ( ++host_spins > HOST_SPIN_LIMIT )
+	longjmp( host_hang, 1 ) ;
+
+    ep = host_ep + (UENUM & 7) ;
+    ep->reg = ep->shown = ep->intx ;
+
+    return &ep->reg ;
+}
+
+volatile uint8_t *host_uedatx ( void )
+{
+    static uint8_t
+	spill ;
+    host_ep_t
+	*ep ;
+
+    host_usb_sync() ;
+    host_spins = 0 ;
+
+    ep = host_ep + (UENUM & 7) ;
+
+    if ( ep->intx & (_BV( RXSTPI ) | _BV( RXOUTI )) )
+    {
+	if ( ep->pos < ep->len )
+	    return &ep->bank[ep->pos++] ;
+    }
+    else
+    if ( ep->len < sizeof( ep->bank ) )
+	return &ep->bank[ep->len++] ;
+
+    host_count.bank_errors++ ;
+    spill = 0 ;
+
+    return &spill ;
+}
+
+volatile uint8_t *host_pllcsr ( void )
+{
+    static uint8_t
+	pllcsr ;
+
+    if ( pllcsr & _BV( PLLE ) )
+	pllcsr |= _BV( PLOCK ) ;	// locks at once
+    else
+	pllcsr &= ~_BV( PLOCK ) ;
+
+    return &pllcsr ;
+}
+
+volatile uint16_t *host_tcnt1 ( void )
+// runs at F_CPU / 8 from the start, writes are ignored
+{
+    static uint16_t
+	tcnt1 ;
+
+    tcnt1 = (uint16_t)(unsigned long)(host_now * (F_CPU / 8)) ;
+
+    return &tcnt1 ;
+}
+
+//------------------------------------------------------------------------------
+// CPU, flash and EEPROM
+
+void host_delay ( double seconds )
+{
+    host_usb_sync() ;
+    host_now += seconds ;
+}
+
+void host_cli ( void )
+{
+    host_interrupts = 0 ;
+}
+
+void host_sei ( void )
+{
+    host_interrupts = 1 ;
+}
+
+void host_jump ( unsigned long addr )
+{
+    host_jump_addr = addr ;
+    longjmp( host_application, 1 ) ;
+}
+
+uint8_t host_flash_read ( unsigned long addr )
+{
+    if ( addr >= HOST_FLASH_SIZE )
+	return 0xFF ;
+
+    if ( host_rww_locked && addr < HOST_BOOT_START )
+    {
+	host_count.busy_reads++ ;
+	return 0xFF ;			// undefined on the real device
+    }
+
+    return host_flash[addr] ;
+}
+
+uint8_t host_progmem_read ( const void *addr )
+{
+    return *(const uint8_t *)addr ;
+}
+
+static int spm_accept ( void )
+// common checks of all SPM instructions, returns 0 if the instruction is
+// ignored
+{
+    host_usb_sync() ;
+
+    if ( host_interrupts )
+	host_count.spm_unlocked++ ;
+
+    if ( host_now < host_spm_ready )
+    {
+	host_count.spm_while_busy++ ;
+	return 0 ;
+    }
+
+    if ( host_now < host_eeprom_ready )
+    {
+	host_count.spm_with_eeprom++ ;
+	return 0 ;
+    }
+
+    return 1 ;
+}
+
+static void clear_temp ( void )
+{
+    memset( host_temp, 0xFF, sizeof( host_temp ) ) ;
+    memset( host_temp_filled, 0, sizeof( host_temp_filled ) ) ;
+}
+
+void host_spm_erase ( unsigned long addr )
+{
+    if ( ! spm_accept() )
+	return ;
+
+    addr &= ~(unsigned long)(SPM_PAGESIZE - 1) ;
+
+    if ( addr >= HOST_BOOT_START )
+    {
+	host_count.boot_writes++ ;
+	return ;
+    }
+
+    memset( host_flash + addr, 0xFF, SPM_PAGESIZE ) ;
+    host_count.erases++ ;
+    host_rww_locked = 1 ;
+    host_spm_ready = host_now + host_spm_time ;
+}
+
+void host_spm_fill ( unsigned long addr, uint16_t data )
+{
+    unsigned
+	i = addr & (SPM_PAGESIZE - 2) ;
+
+    if ( ! spm_accept() )
+	return ;
+
+    host_count.fills++ ;
+
+    if ( host_temp_filled[i / 2] )	// not possible before the buffer is cleared
+    {
+	host_count.refills++ ;
+	return ;
+    }
+
+    host_temp_filled[i / 2] = 1 ;
+    host_temp[i]     = data ;
+    host_temp[i + 1] = data >> 8 ;
+}
+
+void host_spm_write ( unsigned long addr )
+{
+    int
+	i ;
+
+    if ( ! spm_accept() )
+	return ;
+
+    addr &= ~(unsigned long)(SPM_PAGESIZE - 1) ;
+
+    if ( addr >= HOST_BOOT_START )
+	host_count.boot_writes++ ;
+    else
+    {
+	for ( i = 0 ; i < SPM_PAGESIZE ; i++ )
+	    host_flash[addr + i] &= host_temp[i] ;	// writing can only clear bits
+
+	host_count.writes++ ;
+	host_rww_locked = 1 ;
+	host_spm_ready = host_now + host_spm_time ;
+    }
+
+    clear_temp() ;
+}
+
+void host_spm_rww_enable ( void )
+{
+    if ( ! spm_accept() )
+	return ;
+
+    host_count.rww_enables++ ;
+    host_rww_locked = 0 ;
+    clear_temp() ;
+}
+
+int host_spm_busy ( void )
+{
+    return host_now < host_spm_ready ;
+}
+
+void host_spm_busy_wait ( void )
+{
+    host_usb_sync() ;
+
+    if ( host_now < host_spm_ready )
+    {
+	host_count.spm_wait += host_spm_ready - host_now ;
+	host_now = host_spm_ready ;
+    }
+}
+
+void host_eeprom_busy_wait ( void )
+{
+    host_usb_sync() ;
+
+    if ( host_now < host_eeprom_ready )
+	host_now = host_eeprom_ready ;
+}
+
+uint8_t host_eeprom_read ( unsigned long addr )
+{
+    host_eeprom_busy_wait() ;
+
+    return addr < HOST_EEPROM_SIZE ? host_eeprom[addr] : 0xFF ;
+}
+
+void host_eeprom_update ( unsigned long addr, uint8_t value )
+{
+    host_eeprom_busy_wait() ;
+
+    if ( addr >= HOST_EEPROM_SIZE || host_eeprom[addr] == value )
+	return ;
+
+    if ( host_now < host_spm_ready )	// EEPROM is locked while SPM is busy
+    {
+	host_count.spm_with_eeprom++ ;
+	return ;
+    }
+
+    host_eeprom[addr] = value ;
+    host_count.eeprom_writes++ ;
+    host_eeprom_ready = host_now + host_eeprom_time ;
+}
+
+//------------------------------------------------------------------------------
+// Host side
+
+static void host_poll_interrupt ( void )
+// the host controller's poll of EP1
+{
+    uint8_t
+	*r = host_status.report ;
+    long
+	addr ;
+
+    if ( host_now < host_status.next_poll )
+	return ;
+
+    host_status.next_poll = host_now + HID_POLL_INTERVAL * 1e-3 ;
+
+    if ( ! host_status.full )
+	return ;
+
+    host_status.full = 0 ;
+    host_status.reports++ ;
+    host_ep[1].intx |= _BV( RWAL ) | _BV( TXINI ) | _BV( FIFOCON ) ;
+    host_ep[1].reg = host_ep[1].shown = host_ep[1].intx ;
+
+    // a report confirms its page and all pages before it
+
+    addr = r[1] | r[2] << 8 | (long)r[3] << 16 ;
+
+    if ( r[0] != 6 || addr < host_status.expect || addr % SPM_PAGESIZE != 0 || r[4] != 0 )
+    {
+	host_count.bad_status++ ;
+	return ;
+    }
+
+    host_status.last   = addr ;
+    host_status.expect = addr + SPM_PAGESIZE ;
+}
+
+static void host_idle ( double until )
+// the main loop and the polls of EP1 until the given time
+{
+    for ( ;; )
+    {
+	host_spins = 0 ;
+	usb_idle() ;
+	host_usb_sync() ;
+	host_poll_interrupt() ;
+
+	if ( host_now >= until )
+	    break ;
+
+	host_now = until - host_now > 1e-3 ? host_now + 1e-3 : until ;
+    }
+}
+
+static int control_transfer ( uint8_t type, uint8_t request, uint16_t value, uint16_t index,
+			      uint8_t *data, uint16_t len )
+// Runs a control transfer on EP0: SETUP, data stage, status stage. Returns
+// the number of bytes transferred or -1 if the device stalls or does not
+// complete the status stage.
+{
+    host_ep_t
+	*ep = host_ep ;
+
+    host_idle( host_xfer.done_time + host_transfer_time ) ;
+    host_count.transfers++ ;
+
+    host_xfer.type = type ;
+    host_xfer.data = data ;
+    host_xfer.len  = len ;
+    host_xfer.pos  = 0 ;
+    host_xfer.done = 0 ;
+
+    ep->bank[0] = type ;
+    ep->bank[1] = request ;
+    ep->bank[2] = value ;
+    ep->bank[3] = value >> 8 ;
+    ep->bank[4] = index ;
+    ep->bank[5] = index >> 8 ;
+    ep->bank[6] = len ;
+    ep->bank[7] = len >> 8 ;
+    ep->len  = 8 ;
+    ep->pos  = 0 ;
+    ep->intx |= _BV( RXSTPI ) ;
+    ep->reg  = ep->shown = ep->intx ;
+    host_packet() ;
+
+    if ( ep->ueienx & _BV( RXSTPE ) )
+    {
+	host_spins = 0 ;
+	host_cli() ;
+	host_usb_endpoint() ;
+	host_usb_sync() ;
+    }
+
+    if ( ep->ueconx & _BV( STALLRQ ) )
+    {
+	ep->ueconx &= ~_BV( STALLRQ ) ;
+	host_xfer.done_time = host_now ;
+	return -1 ;
+    }
+
+    if ( ! host_xfer.done )
+    {
+	host_xfer.done_time = host_now ;
+	return -1 ;
+    }
+
+    return host_xfer.pos ;
+}
+
+static int host_enumerate ( void )
+// bus reset and what an operating system does with a new HID device,
+// returns 0 if the device behaves
+{
+    uint8_t
+	buf[255] ;
+    int
+	i, n, rdlen ;
+
+    host_io.udint = _BV( EORSTI ) ;
+
+    if ( host_io.udien & _BV( EORSTE ) )
+    {
+	host_cli() ;
+	host_usb_general() ;
+    }
+
+    if ( ! (host_ep[0].ueienx & _BV( RXSTPE )) )
+    {
+	fprintf( stderr, "EP0 not configured after bus reset\n" ) ;
+	return -1 ;
+    }
+
+    n = control_transfer( 0x80, GET_DESCRIPTOR, 0x0100, 0, buf, 64 ) ;
+
+    if ( n != 18 || buf[0] != 18 || buf[1] != 1 || buf[7] != ENDPOINT0_SIZE )
+    {
+	fprintf( stderr, "Device descriptor failed (%d bytes)\n", n ) ;
+	return -1 ;
+    }
+
+    if ( control_transfer( 0x00, SET_ADDRESS, 5, 0, NULL, 0 ) != 0 || host_io.udaddr != (5 | _BV( ADDEN )) )
+    {
+	fprintf( stderr, "SET_ADDRESS failed\n" ) ;
+	return -1 ;
+    }
+
+    n = control_transfer( 0x80, GET_DESCRIPTOR, 0x0200, 0, buf, sizeof( buf ) ) ;
+
+    if ( n != CONFIG_DESC_SIZE || buf[1] != 2 || (buf[2] | buf[3] << 8) != n )
+    {
+	fprintf( stderr, "Configuration descriptor failed (%d bytes)\n", n ) ;
+	return -1 ;
+    }
+
+    rdlen = buf[HID_DESC_OFFSET + 7] | buf[HID_DESC_OFFSET + 8] << 8 ;
+    n = control_transfer( 0x81, GET_DESCRIPTOR, 0x2200, 0, buf, rdlen ) ;
+
+    if ( n != rdlen || buf[n - 1] != 0xC0 )
+    {
+	fprintf( stderr, "Report descriptor failed (%d of %d bytes)\n", n, rdlen ) ;
+	return -1 ;
+    }
+
+    for ( i = 1 ; i <= 2 ; i++ )
+    {
+	n = control_transfer( 0x80, GET_DESCRIPTOR, 0x0300 | i, 0x0409, buf, sizeof( buf ) ) ;
+
+	if ( n < 2 || n != buf[0] || buf[1] != 3 )
+	{
+	    fprintf( stderr, "String descriptor %d failed\n", i ) ;
+	    return -1 ;
+	}
+    }
+
+    if ( control_transfer( 0x00, SET_CONFIGURATION, 1, 0, NULL, 0 ) != 0 ||
+	 host_ep[1].uecfg0x != EP_TYPE_INTERRUPT_IN )
+    {
+	fprintf( stderr, "SET_CONFIGURATION failed\n" ) ;
+	return -1 ;
+    }
+
+    host_ep[1].intx = _BV( RWAL ) | _BV( TXINI ) | _BV( FIFOCON ) ;	// empty bank
+    host_ep[1].reg  = host_ep[1].shown = host_ep[1].intx ;
+
+    if ( control_transfer( 0x80, GET_CONFIGURATION, 0, 0, buf, 1 ) != 1 || buf[0] != 1 )
+    {
+	fprintf( stderr, "GET_CONFIGURATION failed\n" ) ;
+	return -1 ;
+    }
+
+    if ( control_transfer( 0x21, HID_SET_IDLE, 0, 0, NULL, 0 ) != 0 )
+    {
+	fprintf( stderr, "SET_IDLE failed\n" ) ;
+	return -1 ;
+    }
+
+    if ( control_transfer( 0x80, GET_STATUS, 0, 0, buf, 2 ) >= 0 )
+    {
+	fprintf( stderr, "GET_STATUS is not stalled\n" ) ;
+	return -1 ;
+    }
+
+    printf( "Enumeration: %d transfers, report descriptor %d bytes\n", (int)host_count.transfers, rdlen ) ;
+
+    return 0 ;
+}
+
+//------------------------------------------------------------------------------
+
+static int hex_digits ( char *s, int n )
+{
+    int
+	value = 0 ;
+
+    while ( n-- )
+    {
+	value <<= 4 ;
+
+	if ( *s >= '0' && *s <= '9' )
+	    value |= *s - '0' ;
+	else
+	if ( *s >= 'a' && *s <= 'f' )
+	    value |= *s - 'a' + 10 ;
+	else
+	if ( *s >= 'A' && *s <= 'F' )
+	    value |= *s - 'A' + 10 ;
+	else
+	    return -1 ;
+
+	s++ ;
+    }
+
+    return value ;
+}
+
+static int read_hex_file ( char *name, uint8_t *image, long *start, long *end )
+{
+    FILE
+	*fp ;
+    char
+	line[600] ;
+    int
+	len, type, address, segment = 0, i, line_no = 0 ;
+    long
+	addr ;
+
+    if ( (fp = fopen( name, "r" )) == NULL )
+    {
+	perror( name ) ;
+	return -1 ;
+    }
+
+    while ( fgets( line, sizeof( line ), fp ) != NULL )
+    {
+	line_no++ ;
+
+	if ( line[0] != ':' )
+	    continue ;
+
+	len     = hex_digits( line + 1, 2 ) ;
+	address = hex_digits( line + 3, 4 ) ;
+	type    = hex_digits( line + 7, 2 ) ;
+
+	if ( len < 0 || address < 0 || type < 0 || (int)strlen( line ) < 11 + 2 * len )
+	{
+	    fprintf( stderr, "%s:%d: bad record\n", name, line_no ) ;
+	    fclose( fp ) ;
+	    return -1 ;
+	}
+
+	if ( type == 1 )
+	    break ;
+
+	if ( type == 2 || type == 4 )
+	{
+	    segment = hex_digits( line + 9, 4 ) << (type == 2 ? 4 : 16) ;
+	    continue ;
+	}
+
+	if ( type != 0 )
+	    continue ;
+
+	for ( i = 0 ; i < len ; i++ )
+	{
+	    addr = segment + address + i ;
+
+	    if ( addr >= HOST_BOOT_START )
+	    {
+		fprintf( stderr, "%s:%d: data at 0x%lx is outside of the application section\n", name, line_no, addr ) ;
+		fclose( fp ) ;
+		return -1 ;
+	    }
+
+	    image[addr] = hex_digits( line + 9 + 2 * i, 2 ) ;
+
+	    if ( addr < *start )
+		*start = addr ;
+
+	    if ( addr + 1 > *end )
+		*end = addr + 1 ;
+	}
+    }
+
+    fclose( fp ) ;
+
+    return 0 ;
+}
+
+//------------------------------------------------------------------------------
+
+static int host_patch_pages ( long start, long size )
+// sends report 7 for each page from 'start' which differs from host_base;
+// returns 1 if the changes of a page don't fit into one, -1 on errors
+{
+    uint8_t
+	report[5 + HOST_PATCH_SIZE] ;
+    long
+	page, first, last, addr ;
+    int
+	i, pass ;
+
+    for ( pass = 0 ; pass < 2 ; pass++ )	// check all pages, then send
+    {
+	for ( page = start ; page < start + size ; page += SPM_PAGESIZE )
+	{
+	    first = last = -1 ;
+
+	    for ( addr = page ; addr < page + SPM_PAGESIZE ; addr++ )
+	    {
+		if ( host_image[addr] != host_base[addr] )
+		{
+		    if ( first < 0 )
+			first = addr ;
+
+		    last = addr ;
+		}
+	    }
+
+	    if ( first < 0 )
+		continue ;
+
+	    if ( last - first >= HOST_PATCH_SIZE )
+		return 1 ;
+
+	    if ( pass == 0 )
+		continue ;
+
+	    report[0] = 7 ;
+
+	    for ( i = 0 ; i < 3 ; i++ )
+		report[1 + i] = first >> (8 * i) ;
+
+	    report[4] = last + 1 - first ;
+	    memset( report + 5, 0xFF, HOST_PATCH_SIZE ) ;	// full length, as bootloadHID sends it
+	    memcpy( report + 5, host_image + first, report[4] ) ;
+
+	    if ( control_transfer( 0x21, HID_SET_REPORT, 0x0307, 0, report, sizeof( report ) ) != sizeof( report ) )
+	    {
+		fprintf( stderr, "Patch report at 0x%05lx failed\n", first ) ;
+		return -1 ;
+	    }
+
+	    host_patches++ ;
+	    host_patch_bytes += report[4] ;
+	    host_last_page = page ;
+	}
+    }
+
+    return 0 ;
+}
+
+static int host_upload ( long start, long end, int mask, int patch )
+{
+    uint8_t
+	report[4 + HOST_BLOCK_SIZE] ;
+    long
+	addr ;
+    int
+	i, len ;
+
+    host_last_page = -1 ;
+
+    for ( addr = start ; addr < end ; addr += HOST_BLOCK_SIZE )
+    {
+	if ( patch && (addr & mask) == 0 )
+	{
+	    if ( (i = host_patch_pages( addr, mask + 1 )) < 0 )
+		return -1 ;
+
+	    if ( i == 0 )
+	    {
+		addr += mask + 1 - HOST_BLOCK_SIZE ;
+		continue ;
+	    }
+	}
+
+	len = end - addr < HOST_BLOCK_SIZE ? end - addr : HOST_BLOCK_SIZE ;
+	report[0] = 2 ;
+
+	for ( i = 0 ; i < 3 ; i++ )
+	    report[1 + i] = addr >> (8 * i) ;
+
+	memcpy( report + 4, host_image + addr, len ) ;
+
+	if ( control_transfer( 0x21, HID_SET_REPORT, 0x0302, 0, report, 4 + len ) != 4 + len )
+	{
+	    fprintf( stderr, "Data report at 0x%05lx failed\n", addr ) ;
+	    return -1 ;
+	}
+
+	host_last_page = (addr + len - 1) & ~(long)(SPM_PAGESIZE - 1) ;
+    }
+
+    if ( patch )
+	memcpy( host_base, host_image, sizeof( host_base ) ) ;
+
+    return 0 ;
+}
+
+#if USE_STATUS
+static int host_wait_for_status ( long last_page )
+// lets the main loop run until the last page is confirmed; returns 0 if
+// it is
+{
+    double
+	deadline = host_now + 1 ;
+
+    while ( host_status.last != last_page && host_now < deadline )
+	host_idle( host_now + 1e-3 ) ;
+
+    if ( host_status.last != last_page )
+    {
+	host_count.bad_status++ ;
+	return -1 ;
+    }
+
+    return 0 ;
+}
+#endif
+
+#if USE_READ_ADDR
+static int host_set_address ( uint8_t id, long addr )
+// report 3 (or 4 with data) sets the address of the next reads
+{
+    uint8_t
+	report[4] = { id, addr, addr >> 8, addr >> 16 } ;
+
+    return control_transfer( 0x21, HID_SET_REPORT, 0x0300 | id, 0, report, 4 ) == 4 ? 0 : -1 ;
+}
+
+static long host_read_back ( uint8_t id, long start, long end, const uint8_t *expect )
+// reads start to end with report 3 (flash) or 4 (EEPROM), returns the
+// number of bytes which differ from 'expect', or -1
+{
+    uint8_t
+	report[4 + HOST_BLOCK_SIZE] ;
+    long
+	addr, bad = 0 ;
+    int
+	i ;
+
+    if ( host_set_address( 3, start ) != 0 )
+	return -1 ;
+
+    for ( addr = start ; addr < end ; addr += HOST_BLOCK_SIZE )
+    {
+	if ( control_transfer( 0xA1, HID_GET_REPORT, 0x0300 | id, 0, report, sizeof( report ) ) != sizeof( report ) ||
+	     report[0] != id || (report[1] | report[2] << 8 | (long)report[3] << 16) != addr )
+	{
+	    fprintf( stderr, "Report %d at 0x%05lx failed\n", id, addr ) ;
+	    return -1 ;
+	}
+
+	for ( i = 0 ; i < HOST_BLOCK_SIZE && addr + i < end ; i++ )
+	    bad += report[4 + i] != expect[addr + i] ;
+    }
+
+    return bad ;
+}
+#endif
+
+static int host_check_reports ( long start, long end )
+// exercises the optional reports, returns the number of failures
+{
+    int
+	failed = 0 ;
+
+  #if USE_READBACK
+    {
+	long
+	    bad = host_read_back( 3, start, end, host_flash ) ;
+
+	if ( bad == 0 )
+	    printf( "Read-back: %ld bytes match\n", end - start ) ;
+	else
+	    printf( "Error: read-back failed or differs in %ld bytes\n", bad ) ;
+
+	failed += bad != 0 ;
+    }
+  #endif
+
+  #if USE_FINGERPRINT
+    {
+	uint8_t
+	    report[9] ;
+	uint32_t
+	    crc = 0xFFFFFFFF ;
+	long
+	    a ;
+	int
+	    i ;
+
+	for ( a = 0 ; a < HOST_BOOT_START ; a++ )
+	{
+	    crc ^= host_flash[a] ;
+
+	    for ( i = 8 ; i-- ; )
+		crc = (crc >> 1) ^ (crc & 1 ? 0xEDB88320 : 0) ;
+	}
+
+	crc = ~crc ;
+
+	if ( control_transfer( 0xA1, HID_GET_REPORT, 0x0305, 0, report, sizeof( report ) ) != sizeof( report ) ||
+	     report[0] != 5 ||
+	     (report[1] | report[2] << 8 | report[3] << 16 | (uint32_t)report[4] << 24) != crc ||
+	     (report[5] | report[6] << 8 | (long)report[7] << 16) != HOST_BOOT_START )
+	{
+	    printf( "Error: report 5 does not match the flash\n" ) ;
+	    failed++ ;
+	}
+	else
+	    printf( "Fingerprint: CRC 0x%08lx of %ld bytes matches\n", (unsigned long)crc, (long)HOST_BOOT_START ) ;
+    }
+  #endif
+
+  #if USE_EEPROM
+    {
+	uint8_t
+	    report[4 + HOST_BLOCK_SIZE], pattern[HOST_BLOCK_SIZE] ;
+	long
+	    bad ;
+	int
+	    i ;
+
+	report[0] = 4 ;
+	report[1] = report[2] = report[3] = 0 ;
+
+	for ( i = 0 ; i < HOST_BLOCK_SIZE ; i++ )
+	    report[4 + i] = pattern[i] = i * 7 + 1 ;
+
+	if ( control_transfer( 0x21, HID_SET_REPORT, 0x0304, 0, report, sizeof( report ) ) != sizeof( report ) )
+	    bad = -1 ;
+	else
+	if ( (bad = host_read_back( 4, 0, HOST_BLOCK_SIZE, pattern )) == 0 )
+	    bad = memcmp( host_eeprom, pattern, HOST_BLOCK_SIZE ) != 0 ;
+
+	if ( bad == 0 )
+	    printf( "EEPROM: %d bytes written and read back\n", HOST_BLOCK_SIZE ) ;
+	else
+	    printf( "Error: EEPROM reports failed or differ\n" ) ;
+
+	failed += bad != 0 ;
+    }
+  #endif
+
+  #if USE_PERF
+    {
+	uint8_t
+	    r[sizeof( perf )] ;
+	double
+	    khz ;
+
+	#define PERF_U16( o )	(r[o] | r[(o) + 1] << 8)
+	#define PERF_MS( o )	((r[o] | r[(o) + 1] << 8 | (long)r[(o) + 2] << 16 | (long)r[(o) + 3] << 24) / khz)
+
+	if ( control_transfer( 0xA1, HID_GET_REPORT, 0x0308, 0, r, sizeof( r ) ) != sizeof( r ) || r[0] != 8 )
+	{
+	    printf( "Error: report 8 failed\n" ) ;
+	    failed++ ;
+	}
+	else
+	{
+	    khz = PERF_U16( 1 ) ;
+	    printf( "Perf: erase %.1f ms, write %.1f ms, busy %.1f ms, receive %.1f ms, idle %.1f ms; "
+		    "%d erased, %d written, %d setups\n",
+		    PERF_MS( 3 ), PERF_MS( 7 ), PERF_MS( 11 ), PERF_MS( 15 ), PERF_MS( 19 ),
+		    PERF_U16( 23 ), PERF_U16( 25 ), PERF_U16( 27 ) ) ;
+	}
+    }
+  #endif
+
+    (void)start ;
+    (void)end ;
+
+    return failed ;
+}
+
+//------------------------------------------------------------------------------
+
+static void usage ( char *name )
+{
+    fprintf( stderr, "usage: %s [-p <us>] [-o <us>] [-s <us>] [-n <passes>] [-f <hexfile>] <intel-hexfile>\n", name ) ;
+    fprintf( stderr, "  -p  time per packet (default %.0f us)\n", host_packet_time * 1e6 ) ;
+    fprintf( stderr, "  -o  overhead per control transfer (default %.0f us)\n", host_transfer_time * 1e6 ) ;
+    fprintf( stderr, "  -s  time of a page erase or write (default %.0f us)\n", host_spm_time * 1e6 ) ;
+    fprintf( stderr, "  -n  number of uploads of the image (default 1)\n" ) ;
+    fprintf( stderr, "  -f  initial flash contents (default blank)\n" ) ;
+}
+
+int main ( int argc, char **argv )
+{
+    uint8_t
+	info[16] ;
+    char
+	*file = NULL, *flash_file = NULL ;
+    long
+	start = HOST_FLASH_SIZE, end = 0, data_end, flash_start = HOST_FLASH_SIZE, flash_end = 0,
+	addr, errors, first_bad = -1, bad_bytes = 0, pages ;
+    int
+	i, len, passes = 1, mask, patch, failed ;
+    double
+	pass_start ;
+    struct host_counters
+	before ;
+    struct host_status
+	status_before ;
+
+    for ( i = 1 ; i < argc ; i++ )
+    {
+	if ( strcmp( argv[i], "-f" ) == 0 && i + 1 < argc )
+	    flash_file = argv[++i] ;
+	else
+	if ( argv[i][0] == '-' && strchr( "posn", argv[i][1] ) != NULL && argv[i][2] == 0 && i + 1 < argc )
+	{
+	    double
+		value = atof( argv[++i] ) ;
+
+	    switch ( argv[i - 1][1] )
+	    {
+		case 'p': host_packet_time   = value * 1e-6 ; break ;
+		case 'o': host_transfer_time = value * 1e-6 ; break ;
+		case 's': host_spm_time      = value * 1e-6 ; break ;
+		case 'n': passes             = (int)value ; break ;
+	    }
+	}
+	else
+	if ( argv[i][0] != '-' && file == NULL )
+	    file = argv[i] ;
+	else
+	{
+	    usage( argv[0] ) ;
+	    return 2 ;
+	}
+    }
+
+    if ( file == NULL )
+    {
+	usage( argv[0] ) ;
+	return 2 ;
+    }
+
+    memset( host_image, 0xFF, sizeof( host_image ) ) ;
+
+    if ( read_hex_file( file, host_image, &start, &end ) != 0 )
+	return 2 ;
+
+    if ( start >= end )
+    {
+	fprintf( stderr, "No data in %s\n", file ) ;
+	return 2 ;
+    }
+
+    memset( host_flash, 0xFF, sizeof( host_flash ) ) ;
+
+    if ( flash_file != NULL && read_hex_file( flash_file, host_flash, &flash_start, &flash_end ) != 0 )
+	return 2 ;
+
+    memset( host_eeprom, 0xFF, sizeof( host_eeprom ) ) ;
+    clear_temp() ;
+
+    if ( setjmp( host_hang ) )
+    {
+	printf( "Error: the firmware waits for the USB controller forever\n" ) ;
+	return 1 ;
+    }
+
+    host_status.last = -1 ;
+    usb_init() ;
+
+    if ( host_enumerate() != 0 )
+	return 1 ;
+
+    len = control_transfer( 0xA1, HID_GET_REPORT, 0x0301, 0, info, sizeof( info ) ) ;
+
+    if ( len < 7 || info[0] != 1 )
+    {
+	fprintf( stderr, "Device info report failed (%d bytes)\n", len ) ;
+	return 1 ;
+    }
+
+    printf( "Device info: %d bytes, page size %d, flash size %ld", len, info[1] | info[2] << 8,
+	    info[3] | info[4] << 8 | (long)info[5] << 16 | (long)info[6] << 24 ) ;
+
+    if ( len >= 16 )
+	printf( ", boot loader at 0x%lx, features 0x%x",
+		info[8] | info[9] << 8 | (long)info[10] << 16 | (long)info[11] << 24, info[14] | info[15] << 8 ) ;
+
+    printf( "\n" ) ;
+
+    patch = len >= 16 && ((info[14] | info[15] << 8) & 0x100) ;
+    memcpy( host_base, host_flash, sizeof( host_base ) ) ;
+
+    mask = (SPM_PAGESIZE > HOST_BLOCK_SIZE ? SPM_PAGESIZE : HOST_BLOCK_SIZE) - 1 ;
+    start &= ~(long)mask ;
+    data_end = (end + 1) & ~1L ;
+    end = (end + mask) & ~(long)mask ;
+    pages = (end - start) / SPM_PAGESIZE ;
+
+    if ( len < 16 || ! (info[14] & 0x40) )
+	data_end = end ;			// send whole pages
+    else
+    if ( (data_end & (HOST_BLOCK_SIZE - 1)) == 0 && (data_end & mask) != 0 )
+	data_end += 2 ;				// a full report does not end the page
+
+    for ( i = 0 ; i < passes ; i++ )
+    {
+	before = host_count ;
+	pass_start = host_now ;
+	status_before = host_status ;
+	host_status.expect = start ;
+	host_status.last = -1 ;
+	host_patches = host_patch_bytes = 0 ;
+
+	if ( host_upload( start, data_end, mask, patch ) != 0 )
+	    return 1 ;
+
+	printf( "Upload %d: %ld bytes in %.3f s (%.0f bytes/s, %.2f ms per page), %ld erases, %ld writes, %.3f s waiting for SPM\n",
+		i + 1, data_end - start, host_now - pass_start,
+		host_now > pass_start ? (data_end - start) / (host_now - pass_start) : 0,
+		(host_now - pass_start) * 1e3 / pages,
+		host_count.erases - before.erases, host_count.writes - before.writes,
+		host_count.spm_wait - before.spm_wait ) ;
+
+	if ( patch )
+	    printf( "Patch: %ld reports with %ld bytes\n", host_patches, host_patch_bytes ) ;
+
+      #if USE_STATUS
+	if ( host_last_page < 0 )
+	    printf( "Status: nothing written\n" ) ;
+	else
+	if ( host_wait_for_status( host_last_page ) != 0 )
+	    printf( "Error: last page not confirmed by report 6\n" ) ;
+	else
+	    printf( "Status: last page confirmed after %.3f s\n", host_now - pass_start ) ;
+
+	printf( "Status: %ld reports for %ld pages\n", host_status.reports - status_before.reports, pages ) ;
+      #else
+	(void)status_before ;
+      #endif
+    }
+
+    failed = host_check_reports( start, end ) ;
+
+    // leave the boot loader
+
+    info[0] = 1 ;
+
+    if ( setjmp( host_application ) == 0 )
+    {
+	control_transfer( 0x21, HID_SET_REPORT, 0x0301, 0, info, 7 ) ;
+	printf( "Error: report 1 does not start the application\n" ) ;
+	failed++ ;
+    }
+    else
+    if ( host_jump_addr != 0 || (host_io.mcucr & _BV( IVSEL )) || ! (host_io.udcon & _BV( DETACH )) )
+    {
+	printf( "Error: application started at 0x%lx without moving the vectors or detaching\n", host_jump_addr ) ;
+	failed++ ;
+    }
+
+    for ( addr = 0 ; addr < HOST_BOOT_START ; addr++ )
+    {
+	if ( host_flash[addr] != host_image[addr] )
+	{
+	    if ( first_bad < 0 )
+		first_bad = addr ;
+
+	    bad_bytes++ ;
+	}
+    }
+
+    printf( "SPM: %ld erases, %ld writes, %ld fills, %ld RWW enables; %ld transfers, %ld packets\n",
+	    host_count.erases, host_count.writes, host_count.fills, host_count.rww_enables,
+	    host_count.transfers, host_count.packets ) ;
+
+    errors = host_count.spm_while_busy + host_count.spm_with_eeprom + host_count.spm_unlocked +
+	     host_count.refills + host_count.busy_reads + host_count.boot_writes +
+	     host_count.bad_status + host_count.bank_errors + host_count.protocol + failed ;
+
+    if ( host_count.spm_while_busy )
+	printf( "Error: %ld SPM instructions while the SPM unit was busy\n", host_count.spm_while_busy ) ;
+
+    if ( host_count.spm_with_eeprom )
+	printf( "Error: %ld SPM or EEPROM operations while the other one was busy\n", host_count.spm_with_eeprom ) ;
+
+    if ( host_count.spm_unlocked )
+	printf( "Error: %ld SPM instructions with interrupts enabled\n", host_count.spm_unlocked ) ;
+
+    if ( host_count.refills )
+	printf( "Error: %ld page buffer words filled twice\n", host_count.refills ) ;
+
+    if ( host_count.busy_reads )
+	printf( "Error: %ld reads of the RWW section while it was busy\n", host_count.busy_reads ) ;
+
+    if ( host_count.bad_status )
+	printf( "Error: %ld status reports missing, out of order or overwritten\n", host_count.bad_status ) ;
+
+    if ( host_count.boot_writes )
+	printf( "Error: %ld erases or writes of the boot loader section\n", host_count.boot_writes ) ;
+
+    if ( host_count.bank_errors )
+	printf( "Error: %ld UEDATX accesses beyond the packet or bank\n", host_count.bank_errors ) ;
+
+    if ( host_count.protocol )
+	printf( "Error: %ld IN packets out of the transfer's order\n", host_count.protocol ) ;
+
+    if ( bad_bytes )
+	printf( "Flash differs from the image in %ld bytes, first at 0x%05lx\n", bad_bytes, first_bad ) ;
+    else
+	printf( "Flash matches the image\n" ) ;
+
+    return bad_bytes != 0 || errors != 0 ;
+}
+
+//------------------------------------------------------------------------------
+// End of hostsim.c
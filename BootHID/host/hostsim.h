@@ -0,0 +1,103 @@
+/*******************************************************************************
+ * File Name	: hostsim.h
+ * Project	: BootHID
+ * Date		: 2026/10/19
+ * Version      : 1.0
+ * Target MCU   : host build of usb_hid.c
+ * Tool Chain   : cc
+ * Author       : bootloadHID contributors
+ * Release Notes:
+ *	Interface between the stub AVR headers in this directory and the
+ *	emulated device in hostsim.c. The stubs map the USB controller
+ *	registers, SPM, EEPROM and interrupt control to the items below.
+ *
+ * $Id$
+ ******************************************************************************/
+
+#ifndef __hostsim_h__
+#define __hostsim_h__
+
+#include <stdint.h>
+
+//------------------------------------------------------------------------------
+// Registers without side effects
+
+typedef struct
+    {
+	uint8_t  uhwcon, usbcon, udcon, udien, udint, udaddr, uenum, uerst ;
+	uint8_t  mcucr, smcr, sreg, ddrb, portb, ddrd, portd, tccr1b ;
+    }
+    host_io_t ;
+
+extern volatile host_io_t
+    host_io ;
+
+// Endpoint registers, selected by UENUM. UEINTX is not a plain variable:
+// the firmware sees and writes 'reg', the controller state is 'intx', see
+// host_ueintx().
+
+typedef struct
+    {
+	uint8_t  ueconx, uecfg0x, uecfg1x, ueienx ;
+	uint8_t  intx, reg, shown ;
+	uint8_t  bank[64] ;		// data of the current packet
+	uint8_t  len, pos ;		// bytes in the bank, next byte to read
+    }
+    host_ep_t ;
+
+extern host_ep_t
+    host_ep[8] ;
+
+volatile uint8_t *
+    host_ueintx( void ) ;		// UEINTX of the selected endpoint
+volatile uint8_t *
+    host_uedatx( void ) ;		// next byte of the bank
+volatile uint8_t *
+    host_pllcsr( void ) ;		// locks when enabled
+volatile uint16_t *
+    host_tcnt1( void ) ;		// emulated time at F_CPU / 8
+
+void
+    host_usb_general( void ) ;		// USB_GEN_vect
+void
+    host_usb_endpoint( void ) ;		// USB_COM_vect
+
+//------------------------------------------------------------------------------
+// CPU, flash and EEPROM
+
+void
+    host_delay( double seconds ) ;
+void
+    host_cli( void ) ;
+void
+    host_sei( void ) ;			// SPM checks the interrupt flag
+void
+    __attribute__((__noreturn__)) host_jump( unsigned long addr ) ;
+
+uint8_t
+    host_flash_read( unsigned long addr ) ;	// counts reads of a busy RWW section
+uint8_t
+    host_progmem_read( const void *addr ) ;	// the boot loader's own PROGMEM data
+
+void
+    host_spm_erase( unsigned long addr ) ;
+void
+    host_spm_fill( unsigned long addr, uint16_t data ) ;
+void
+    host_spm_write( unsigned long addr ) ;
+void
+    host_spm_rww_enable( void ) ;
+int
+    host_spm_busy( void ) ;
+void
+    host_spm_busy_wait( void ) ;
+
+uint8_t
+    host_eeprom_read( unsigned long addr ) ;
+void
+    host_eeprom_update( unsigned long addr, uint8_t value ) ;
+void
+    host_eeprom_busy_wait( void ) ;
+
+//------------------------------------------------------------------------------
+#endif
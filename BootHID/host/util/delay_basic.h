@@ -0,0 +1,23 @@
+/*******************************************************************************
+ * File Name	: delay_basic.h (host build)
+ * Project	: BootHID
+ * Date		: 2026/10/19
+ * Version      : 1.0
+ * Target MCU   : host build of usb_hid.c
+ * Tool Chain   : cc
+ * Author       : bootloadHID contributors
+ * Release Notes:
+ *	Stub of <util/delay_basic.h>: the loops advance the emulated time.
+ *
+ * $Id$
+ ******************************************************************************/
+
+#ifndef __host_util_delay_basic_h__
+#define __host_util_delay_basic_h__
+
+#include "hostsim.h"
+
+#define _delay_loop_1( n )	host_delay( (n) * 3.0 / F_CPU )
+#define _delay_loop_2( n )	host_delay( (n) * 4.0 / F_CPU )
+
+#endif
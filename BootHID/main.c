@@ -54,7 +54,7 @@ int FA_NORETURN( main ) ( void )
     SMCR = _B0(SM2) | _B0(SM1) | _B0(SM0) | _B1(SE) ;
 
     for ( ;; ) 				// Forever..
-	sleep_cpu() ;
+	usb_idle() ;
 }
 
 //------------------------------------------------------------------------------
@@ -69,6 +69,7 @@
 
 #include <includes.h>
 #include <avr/boot.h>
+#include <avr/eeprom.h>
 
 #define __usb_hid__
 #include "usb_hid.h"
@@ -113,6 +114,12 @@ typedef
   #endif
 	addr_t ;
 
+#if FLASHEND > 0xFFFF
+ #define read_flash_byte( a )	pgm_read_byte_far( a )
+#else
+ #define read_flash_byte( a )	pgm_read_byte( a )
+#endif
+
 //------------------------------------------------------------------------------
 // Descriptor Data
 
@@ -146,7 +153,7 @@ static const uint8_t
 	0x75, 0x08,			//   REPORT_SIZE (8)
 
 	0x85, 0x01,			//   REPORT_ID (1)
-	0x95, 0x06,			//   REPORT_COUNT (6)
+	0x95, 0x0F,			//   REPORT_COUNT (15)
 	0x09, 0x00,			//   USAGE (Undefined)
 	0xB2, 0x02, 0x01,		//   FEATURE (Data,Var,Abs,Buf)
 
@@ -154,6 +161,48 @@ static const uint8_t
 	0x95, 0x83,			//   REPORT_COUNT (131)
 	0x09, 0x00,			//   USAGE (Undefined)
 	0xB2, 0x02, 0x01,		//   FEATURE (Data,Var,Abs,Buf)
+
+      #if USE_READ_ADDR
+	0x85, 0x03,			//   REPORT_ID (3)
+	0x95, 0x83,			//   REPORT_COUNT (131)
+	0x09, 0x00,			//   USAGE (Undefined)
+	0xB2, 0x02, 0x01,		//   FEATURE (Data,Var,Abs,Buf)
+      #endif
+
+      #if USE_EEPROM
+	0x85, 0x04,			//   REPORT_ID (4)
+	0x95, 0x83,			//   REPORT_COUNT (131)
+	0x09, 0x00,			//   USAGE (Undefined)
+	0xB2, 0x02, 0x01,		//   FEATURE (Data,Var,Abs,Buf)
+      #endif
+
+      #if USE_FINGERPRINT
+	0x85, 0x05,			//   REPORT_ID (5)
+	0x95, 0x08,			//   REPORT_COUNT (8)
+	0x09, 0x00,			//   USAGE (Undefined)
+	0xB2, 0x02, 0x01,		//   FEATURE (Data,Var,Abs,Buf)
+      #endif
+
+      #if USE_STATUS
+	0x85, 0x06,			//   REPORT_ID (6)
+	0x95, 0x04,			//   REPORT_COUNT (4)
+	0x09, 0x00,			//   USAGE (Undefined)
+	0x81, 0x02,			//   INPUT (Data,Var,Abs)
+      #endif
+
+      #if USE_PATCH
+	0x85, 0x07,			//   REPORT_ID (7)
+	0x95, 0x24,			//   REPORT_COUNT (36)
+	0x09, 0x00,			//   USAGE (Undefined)
+	0xB2, 0x02, 0x01,		//   FEATURE (Data,Var,Abs,Buf)
+      #endif
+
+      #if USE_PERF
+	0x85, 0x08,			//   REPORT_ID (8)
+	0x95, 0x1C,			//   REPORT_COUNT (28)
+	0x09, 0x00,			//   USAGE (Undefined)
+	0xB2, 0x02, 0x01,		//   FEATURE (Data,Var,Abs,Buf)
+      #endif
 	0xC0				// END_COLLECTION
     } ;
 
@@ -199,7 +248,7 @@ static const uint8_t
 	0x81,				// Endpoint address
 	3,				// Endpoint attributes
 	LVAL( 64 ),			// Max. packet size this EP can transfer
-	200				// Polling interval for this EP in ms
+	HID_POLL_INTERVAL		// Polling interval for this EP in ms
     } ;
 #else
 
@@ -217,12 +266,21 @@ static const struct
 	uint8_t  repid ;
 	uint16_t pagesz ;
 	uint32_t flashsz ;
+	// hosts before protocol version 2 read only the fields above
+	uint8_t  version ;
+	uint32_t bootstart ;
+	uint16_t maxdata ;
+	uint16_t features ;
     }
     report1 PROGMEM =
     {
 	1,
 	SPM_PAGESIZE,
-	(uint32_t)FLASHEND + 1
+	(uint32_t)FLASHEND + 1,
+	2,
+	BOOTLOADER_ADDRESS,
+	128,
+	FEATURE_FLAGS
     } ;
 
 //------------------------------------------------------------------------------
@@ -243,6 +301,69 @@ static union
     }
     VA_NOINIT( addr ) ;
 
+#if USE_STATUS
+
+// Report 6 for status_page is due. With USE_SPEED, the page write still
+// runs when the report has been handled, the report is sent when it has
+// completed (see usb_idle()), or when the next report arrives. It also
+// stays due while the host has not fetched the previous one.
+
+static addr_t
+    VA_NOINIT( status_page ) ;
+
+static volatile uint8_t
+    status_due ;
+#endif
+
+#if USE_PERF
+
+// Report 8: where the time of an upload goes, in ticks of timer 1, which
+// runs at F_CPU / 8 (wraps after 32ms at 16MHz, longer than any single
+// wait). Cleared by usb_init(). With USE_SPEED, the page write overlaps the
+// next report and its remaining time is counted as busy.
+
+static struct
+    {
+	uint8_t  repid ;
+	uint16_t khz ;			// ticks per ms
+	uint32_t erase ;		// waiting for page erases
+	uint32_t write ;		// waiting for page writes
+	uint32_t busy ;			// other SPM and EEPROM waits
+	uint32_t receive ;		// waiting for OUT packets of SET_REPORT
+	uint32_t idle ;			// main loop
+	uint16_t erased, written ;	// pages
+	uint16_t setups ;		// SETUP packets
+    }
+    VA_NOINIT( perf ) ;
+
+static uint16_t
+    VA_NOINIT( perf_mark ) ;		// TCNT1 at the last call of usb_idle()
+
+static volatile uint8_t
+    VA_NOINIT( perf_isr ) ;		// an interrupt ran since then
+
+ #define PERF_WAIT( c, w )	do { uint16_t t_ = TCNT1 ; w ; perf.c += (uint16_t)(TCNT1 - t_) ; } while ( 0 )
+ #define PERF_COUNT( c )	perf.c++
+#else
+ #define PERF_WAIT( c, w )	w
+ #define PERF_COUNT( c )
+#endif
+
+#if USE_SPEED && USE_FINGERPRINT
+
+// CRC-32 of the values 0 to 15. In RAM: reading it from the boot section
+// would need far addressing on the AT90USB128x.
+
+static const uint32_t
+    crc_table[16] =
+    {
+	0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC,
+	0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+	0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+	0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+    } ;
+#endif
+
 //------------------------------------------------------------------------------
 // Initialize USB
 
@@ -276,6 +397,25 @@ void usb_init ( void )
     UDCON = 0 ;				// enable attach resistor
     UDIEN = _B1(EORSTE) ;
 
+  #if USE_PERF
+    {
+	uint8_t
+	    *p = VP( &perf ),
+	    i ;
+
+	for ( i = sizeof( perf ) ; i-- ; )
+	    *p++ = 0 ;
+    }
+
+    perf.repid = 8 ;
+    perf.khz   = F_CPU / 8 / 1000 ;
+    perf_isr   = 0 ;
+    perf_mark  = 0 ;
+
+    TCNT1  = 0 ;
+    TCCR1B = TPS_8( 1 ) ;		// timer 1 at F_CPU / 8
+  #endif
+
     sei() ;				// enable INTs
 }
 
@@ -287,6 +427,10 @@ ISR( USB_GEN_vect, ISR_NAKED )
     uint8_t
 	i ;
 
+  #if USE_PERF
+    perf_isr = 1 ;
+  #endif
+
     i = UDINT ;
     UDINT = 0 ;
 
@@ -320,8 +464,17 @@ static inline void usb_send_in ( void )
 
 static inline void usb_wait_receive_out ( void )
 {
+  #if USE_PERF
+    uint16_t
+	t = TCNT1 ;
+  #endif
+
     for ( ; bit_is_clear( UEINTX, RXOUTI ) ; )
 	;
+
+  #if USE_PERF
+    perf.receive += (uint16_t)(TCNT1 - t) ;
+  #endif
 }
 
 static inline void usb_ack_out ( void )
@@ -364,6 +517,84 @@ static void FA_NOINLINE( usb_send_EP0 ) ( const uint8_t *p, uint8_t len )
     while ( len || n == ENDPOINT0_SIZE ) ;
 }
 
+#if USE_STATUS
+//------------------------------------------------------------------------------
+// Tell the host via EP1 that the page at status_page is written (ID,
+// 3-byte address, 0 = written). If it has not fetched the last report yet,
+// the report stays due and usb_idle() tries again. A later page replaces
+// status_page meanwhile, its report confirms the earlier pages as well.
+
+static void post_status ( void )
+{
+    uint8_t
+	i ;
+    addr_t
+	a = status_page ;
+
+    UENUM = 1 ;
+
+    if ( UEINTX & _BV( RWAL ) )
+    {
+	UEDATX = 6 ;
+
+	for ( i = 3 ; i-- ; a >>= 8 )
+	    UEDATX = a ;
+
+	UEDATX = 0 ;
+	UEINTX = 0x3A ;			// clear TXINI & FIFOCON: send
+	status_due = 0 ;
+    }
+
+    UENUM = 0 ;
+}
+#endif
+
+#if USE_STATUS || USE_PERF
+//------------------------------------------------------------------------------
+// Main loop: the SPM unit has no interrupt in our vector table and EP1's
+// is not enabled, so we poll both while report 6 is due and sleep otherwise.
+// Nothing is kept in registers while interrupts are enabled, the naked USB
+// interrupts don't save them.
+// With USE_PERF we never sleep, the time since the last call is idle time
+// unless an interrupt ran in between.
+
+void usb_idle ( void )
+{
+    cli() ;
+
+  #if USE_PERF
+    {
+	uint16_t
+	    t = TCNT1 ;
+
+	if ( ! perf_isr )
+	    perf.idle += (uint16_t)(t - perf_mark) ;
+
+	perf_isr  = 0 ;
+	perf_mark = t ;
+    }
+  #endif
+
+  #if USE_STATUS
+    if ( status_due && ! boot_spm_busy() )
+	post_status() ;
+
+    if ( status_due )
+    {
+	sei() ;				// poll again
+	return ;
+    }
+  #endif
+
+  #if USE_PERF
+    sei() ;
+  #else
+    sei() ;				// sleep is executed before a pending
+    sleep_cpu() ;			// interrupt, which then wakes us up
+  #endif
+}
+#endif
+
 //------------------------------------------------------------------------------
 // Pass control to main app
 
@@ -373,6 +604,17 @@ static inline void FA_NORETURN( exit_bl ) ( void )
     UDCON  = _B1(DETACH) ;		// Detach from USB
     USBCON = _B0(USBE) | _B1(FRZCLK) ;	// Stop USB module
 
+  #if USE_PERF
+    TCCR1B = 0 ;			// leave timer 1 as after reset
+    TCNT1  = 0 ;
+  #endif
+
+  #if USE_SPEED
+    boot_spm_busy_wait() ;		// last page write
+  #endif
+  #if USE_EEPROM
+    eeprom_busy_wait() ;		// SPM is locked out while writing
+  #endif
     boot_rww_enable() ;			// Enable rd-while-wr memory section
 
     MCUCR = _B1(IVCE) ;			// enable change of interrupt vectors
@@ -399,11 +641,17 @@ ISR( USB_COM_vect, ISR_NAKED )
     uint8_t
 	*p ;
 
+  #if USE_PERF
+    perf_isr = 1 ;
+  #endif
+
     UENUM = 0 ;
     i = UEINTX ;
 
     if ( i & _BV( RXSTPI ) )
     {
+	PERF_COUNT( setups ) ;
+
 	bmRequestType = UEDATX ;
 	bRequest      = UEDATX ;
 
@@ -560,6 +808,14 @@ ISR( USB_COM_vect, ISR_NAKED )
 
 	    usb_send_in() ;			// Ack transfer via ZLP
 
+	  #if USE_SPEED
+	    PERF_WAIT( busy, boot_spm_busy_wait() ) ;	// page write of the last report
+	   #if USE_STATUS
+	    if ( status_due )
+		post_status() ;
+	   #endif
+	  #endif
+
 	    addr.b[0] = hid_report[1] ;
 	    addr.b[1] = hid_report[2] ;
 	  #if FLASHEND > 0xFFFF
@@ -567,14 +823,98 @@ ISR( USB_COM_vect, ISR_NAKED )
 	    addr.b[3] = 0 ;
 	  #endif
 
+	  #if USE_READ_ADDR
+	    if ( (wValue & 0xFF) == 3 )		// #3 just sets the read address
+		goto _Done ;
+	  #endif
+
 	    p = VP( hid_report + 4 ) ;		// Skip ID & 3-byte address
 
-	    for ( i = (sizeof( hid_report ) - 4) >> 1 ; i-- ; )
+	  #if USE_EEPROM
+	    if ( (wValue & 0xFF) == 4 )
+	    {
+		// eeprom_update_byte() skips unchanged bytes and does not wait
+		// for the write it starts, the last one finishes while the
+		// host sends the next report
+
+		for ( i = sizeof( hid_report ) - 4 ; i-- ; addr.a++ )
+		{
+		    if ( addr.a <= E2END )
+			eeprom_update_byte( (uint8_t *)(uint16_t)addr.a, *p ) ;
+
+		    p++ ;
+		}
+
+		goto _Done ;
+	    }
+
+	    PERF_WAIT( busy, eeprom_busy_wait() ) ;	// SPM is locked out while writing
+	  #endif
+
+	  #if USE_PATCH
+	    if ( (wValue & 0xFF) == 7 )
+	    {
+		// Change up to 32 bytes of a page (ID, address, length,
+		// data): the SPM buffer is filled from the flash with the
+		// new bytes in place of the old ones, then the page is
+		// erased and written. Bytes beyond the page are ignored.
+
+		uint16_t
+		    o, w ;
+		uint8_t
+		    lo, hi ;
+
+		n = wLength > 5 ? hid_report[4] : 0 ;
+
+		if ( wLength > 5 && n > wLength - 5 )
+		    n = wLength - 5 ;
+
+		o = addr.a & (SPM_PAGESIZE - 1) ;
+		addr.a -= o ;			// page start
+		p = VP( hid_report + 5 ) ;
+
+		boot_rww_enable() ;		// before filling, it clears the buffer
+
+		for ( w = 0 ; w < SPM_PAGESIZE ; w += 2 )
+		{
+		    lo = (uint16_t)(w - o) < n ? p[w - o] : read_flash_byte( addr.a + w ) ;
+		    hi = (uint16_t)(w + 1 - o) < n ? p[w + 1 - o] : read_flash_byte( addr.a + w + 1 ) ;
+
+		    boot_page_fill( addr.a + w, lo | (hi << 8) ) ;
+		}
+
+		boot_page_erase( addr.a ) ;	// keeps the filled buffer
+		PERF_COUNT( erased ) ;
+		PERF_WAIT( erase, boot_spm_busy_wait() ) ;
+		boot_page_write( addr.a ) ;
+		PERF_COUNT( written ) ;
+	      #if ! USE_SPEED
+		PERF_WAIT( write, boot_spm_busy_wait() ) ;
+	      #endif
+
+		addr.a += SPM_PAGESIZE ;	// as after the last data report of a page
+
+		goto _Written ;
+	    }
+	  #endif
+
+	    i = (sizeof( hid_report ) - 4) >> 1 ;
+
+	  #if USE_SHORT_DATA
+	    // The last report of an upload may be short, the rest of its
+	    // page is filled with 0xFF below
+
+	    if ( wLength < sizeof( hid_report ) )
+		i = wLength > 4 ? (uint8_t)(wLength - 4) >> 1 : 0 ;
+	  #endif
+
+	    for ( ; i-- ; )
 	    {
 		if ( ! (addr.a & (SPM_PAGESIZE - 1)) )
 		{				// if page start: erase
 		    boot_page_erase( addr.a ) ;	// erase page
-		    boot_spm_busy_wait() ;	// wait until page is erased
+		    PERF_COUNT( erased ) ;
+		    PERF_WAIT( erase, boot_spm_busy_wait() ) ;	// wait until page is erased
 		}
 
 		boot_page_fill( addr.a, *(uint16_t *)p ) ;
@@ -588,10 +928,48 @@ ISR( USB_COM_vect, ISR_NAKED )
 		if ( ! (addr.a & (SPM_PAGESIZE - 1)) )
 		{
 		    boot_page_write( addr.a - sizeof( uint16_t ) ) ;
-		    boot_spm_busy_wait() ;
+		    PERF_COUNT( written ) ;
+		  #if ! USE_SPEED
+		    PERF_WAIT( write, boot_spm_busy_wait() ) ;
+		  #endif
 		}
             }
 
+	  #if USE_SHORT_DATA
+	    if ( wLength < sizeof( hid_report ) && (addr.a & (SPM_PAGESIZE - 1)) )
+	    {
+		do
+		{
+		    boot_page_fill( addr.a, 0xFFFF ) ;
+		    addr.a += sizeof( uint16_t ) ;
+		}
+		while ( addr.a & (SPM_PAGESIZE - 1) ) ;
+
+		boot_page_write( addr.a - sizeof( uint16_t ) ) ;
+		PERF_COUNT( written ) ;
+	      #if ! USE_SPEED
+		PERF_WAIT( write, boot_spm_busy_wait() ) ;
+	      #endif
+	    }
+	  #endif
+
+	  #if USE_PATCH
+	_Written:
+	  #endif
+	  #if USE_STATUS
+	    if ( ! (addr.a & (SPM_PAGESIZE - 1)) )
+	    {
+		status_page = addr.a - SPM_PAGESIZE ;
+		status_due = 1 ;
+	      #if ! USE_SPEED
+		post_status() ;			// else when written
+	      #endif
+	    }
+	  #endif
+
+	  #if USE_READ_ADDR
+	_Done:
+	  #endif
 	  #if USE_LED
 	    LED_OFF() ;
 	  #endif
@@ -605,6 +983,136 @@ ISR( USB_COM_vect, ISR_NAKED )
 
 	    reti() ;
 	}
+
+      #if USE_PERF
+	if ( bRequest == HID_GET_REPORT && bmRequestType == 0xA1 && (wValue & 0xFF) == 8 )
+	{
+	    // Send the counters from RAM, they fit into one packet
+
+	    p = VP( &perf ) ;
+
+	    usb_wait_in_ready() ;
+
+	    for ( i = sizeof( perf ) ; i-- ; )
+		UEDATX = *p++ ;
+
+	    usb_send_in() ;
+
+	    reti() ;
+	}
+      #endif
+
+      #if USE_FINGERPRINT
+	if ( bRequest == HID_GET_REPORT && bmRequestType == 0xA1 && (wValue & 0xFF) == 5 )
+	{
+	    // Send ID, CRC-32 (as zlib's crc32()) and size of everything
+	    // below the boot loader. The host looks the CRC up in its image
+	    // registry. Takes ~15 cycles per bit (a quarter of that with
+	    // the table of USE_SPEED), the host just sees NAKs.
+
+	    uint32_t
+		crc = 0xFFFFFFFF ;
+	    addr_t
+		a ;
+
+	  #if USE_SPEED
+	    PERF_WAIT( busy, boot_spm_busy_wait() ) ;	// last page write
+	  #endif
+	  #if USE_EEPROM
+	    PERF_WAIT( busy, eeprom_busy_wait() ) ;	// SPM is locked out while writing
+	  #endif
+	    boot_rww_enable() ;			// flash may have been written
+
+	    for ( a = 0 ; a < BOOTLOADER_ADDRESS ; a++ )
+	    {
+		crc ^= read_flash_byte( a ) ;
+
+	      #if USE_SPEED
+		crc = (crc >> 4) ^ crc_table[crc & 15] ;
+		crc = (crc >> 4) ^ crc_table[crc & 15] ;
+	      #else
+		for ( i = 8 ; i-- ; )
+		    crc = (crc >> 1) ^ (crc & 1 ? 0xEDB88320 : 0) ;
+	      #endif
+	    }
+
+	    usb_wait_in_ready() ;
+
+	    UEDATX = 5 ;
+
+	    for ( i = 4 ; i-- ; crc >>= 8 )
+		UEDATX = ~crc ;
+
+	    for ( a = BOOTLOADER_ADDRESS, i = 4 ; i-- ; a >>= 8 )
+		UEDATX = a ;
+
+	    usb_send_in() ;
+
+	    reti() ;
+	}
+      #endif
+
+      #if USE_READ_ADDR
+	if ( bRequest == HID_GET_REPORT && bmRequestType == 0xA1 &&
+	     (wValue & 0xFF) >= (USE_READBACK ? 3 : 4) && (wValue & 0xFF) <= (USE_EEPROM ? 4 : 3) )
+	{
+	    // Send ID, address and 128 bytes of flash (#3) or EEPROM (#4)
+	    // from addr, which advances, so the host can stream without
+	    // setting it again
+
+	  #if USE_SPEED
+	    PERF_WAIT( busy, boot_spm_busy_wait() ) ;	// last page write
+	  #endif
+	  #if USE_READBACK
+	   #if USE_EEPROM
+	    PERF_WAIT( busy, eeprom_busy_wait() ) ;	// SPM is locked out while writing
+	   #endif
+	    boot_rww_enable() ;			// flash may have been written
+	  #endif
+
+	    if ( wLength > sizeof( hid_report ) )
+		wLength = sizeof( hid_report ) ;
+
+	    for ( n = 0 ; n < wLength ; )
+	    {
+		do
+		{
+		    i = UEINTX ;
+		}
+		while ( bits_are_clear( i, _BV( TXINI ) | _BV( RXOUTI ) ) ) ;
+
+		if ( i & _BV( RXOUTI ) )
+		    break ;			// abort
+
+		for ( i = ENDPOINT0_SIZE ; i && n < wLength ; i--, n++ )
+		{
+		    if ( n == 0 )
+			UEDATX = wValue ;
+		    else
+		    if ( n < 3 )
+			UEDATX = addr.b[n - 1] ;
+		    else
+		    if ( n == 3 )
+		      #if FLASHEND > 0xFFFF
+			UEDATX = addr.b[2] ;
+		      #else
+			UEDATX = 0 ;	// addr_t has two bytes only
+		      #endif
+		  #if USE_EEPROM
+		    else
+		    if ( (wValue & 0xFF) == 4 )
+			UEDATX = eeprom_read_byte( (uint8_t *)(uint16_t)addr.a++ ) ;
+		  #endif
+		    else
+			UEDATX = read_flash_byte( addr.a++ ) ;
+		}
+
+		usb_send_in() ;
+	    }
+
+	    reti() ;
+	}
+      #endif
     }
 
 _Stall:
@@ -14,9 +14,98 @@
 #ifndef __usb_hid_h__
 #define __usb_hid_h__
 
+//------------------------------------------------------------------------------
+// Optional features, see usb_hid.c. They don't fit into a 1kB boot section,
+// enable them with e.g. make OPTIONS="-DUSE_READBACK=1" and a 2kB section.
+// make PROFILE=speed builds for a 4kB section with USE_SPEED, read back,
+// fingerprint, status, patch and short data, -O2 and unrolled loops (see
+// default/Makefile).
+
+#ifndef USE_READBACK
+ #define USE_READBACK		0	// report 3: read flash
+#endif
+
+#ifndef USE_EEPROM
+ #define USE_EEPROM		0	// report 4: write and read EEPROM
+#endif
+
+#ifndef USE_FINGERPRINT
+ #define USE_FINGERPRINT	0	// report 5: CRC-32 of the application
+#endif
+
+#ifndef USE_STATUS
+ #define USE_STATUS		0	// report 6 on EP1: page written
+#endif
+
+#ifndef USE_PATCH
+ #define USE_PATCH		0	// report 7: change up to 32 bytes of a page
+#endif
+
+#ifndef USE_SPEED
+ #define USE_SPEED		0	// page write overlaps the next report
+#endif
+
+#ifndef USE_SHORT_DATA
+ #define USE_SHORT_DATA		0	// last report 2 may be short, see below
+#endif
+
+#ifndef USE_PERF
+ #define USE_PERF		0	// report 8: time and event counters
+#endif
+
+#if USE_FINGERPRINT && ! defined( BOOTLOADER_ADDRESS )
+ #error "USE_FINGERPRINT needs BOOTLOADER_ADDRESS (byte address), see Makefile"
+#endif
+
+#ifndef BOOTLOADER_ADDRESS
+ #define BOOTLOADER_ADDRESS	0	// unknown, the host assumes 1kB
+#endif
+
+// Feature flags reported in report 1
+
+#define FEATURE_FLAGS		(USE_READBACK | (USE_EEPROM << 1) | \
+				 (USE_FINGERPRINT << 2) | (USE_SHORT_DATA << 6) | \
+				 (USE_STATUS << 7) | (USE_PATCH << 8) | (USE_PERF << 9))
+
+// With USE_SHORT_DATA report 2 may be shorter than 132 bytes at the end of
+// an upload, the page is completed with 0xFF. Without it the host sends the
+// padding of the last page itself.
+
+// Report 3 also sets the address for reading the EEPROM
+
+#define USE_READ_ADDR		(USE_READBACK || USE_EEPROM)
+
+// The HID report descriptor grows with the optional reports, vt.S needs
+// its size for the config descriptor.
+
+#define HID_REPORT_DESC_SIZE	(33 + 9 * USE_READ_ADDR + 9 * USE_EEPROM + \
+				 9 * USE_FINGERPRINT + 8 * USE_STATUS + 9 * USE_PATCH + \
+				 9 * USE_PERF)
+
+// With USE_STATUS the host polls EP1 every frame, so that the report of a
+// page is fetched before the next page is written. Otherwise EP1 is never
+// used and the host may poll as rarely as it likes.
+
+#if USE_STATUS
+ #define HID_POLL_INTERVAL	1
+#else
+ #define HID_POLL_INTERVAL	200
+#endif
+
+#ifndef __ASSEMBLER__
+
 void
     usb_init( void ) ;			// initialize everything
 
+#if USE_STATUS || USE_PERF
+void
+    usb_idle( void ) ;			// send report 6 when due, sleep
+#else
+ #define usb_idle()	sleep_cpu()
+#endif
+
+#endif
+
 //------------------------------------------------------------------------------
 // Everything below this point is only intended for usb_hid.c
 
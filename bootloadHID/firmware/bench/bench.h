@@ -0,0 +1,32 @@
+/* Name: bench.h
+ * Project: AVR bootloader HID
+ * Author: bootloadHID contributors
+ * Creation Date: 2026-10-19
+ * Tabsize: 4
+ * License: GNU GPL v2 (see License.txt)
+ * This Revision: $Id$
+ */
+
+/*
+General Description:
+Markers of the simavr benchmark build, shared by the firmware side
+(usbdrv.c in this directory) and the simulator side (simbench.c). The
+firmware writes them to GPIOR0, simbench counts the cycles in between.
+*/
+
+#ifndef __bench_h_included__
+#define __bench_h_included__
+
+#define BENCH_SETUP     1   /* usbFunctionSetup() starts */
+#define BENCH_DATA      2   /* usbFunctionWrite() starts with 8 bytes or less */
+#define BENCH_END       3   /* the call returned */
+#define BENCH_PAGE      4   /* a page (or report, if pages are smaller) has been passed */
+#define BENCH_DONE      5   /* all data has been passed */
+
+#define BENCH_MARK_ADDR 0x3e    /* GPIOR0 in data space (ATMega32U4, ATMega88/168/328) */
+
+#ifndef BENCH_SIZE
+#   define BENCH_SIZE   4096    /* bytes uploaded */
+#endif
+
+#endif /* __bench_h_included__ */
@@ -0,0 +1,193 @@
+/* Name: simbench.c
+ * Project: AVR bootloader HID
+ * Author: bootloadHID contributors
+ * Creation Date: 2026-10-19
+ * Tabsize: 4
+ * License: GNU GPL v2 (see License.txt)
+ * This Revision: $Id$
+ */
+
+/*
+General Description:
+Cycle counts of the boot loader's write path under simavr ("make bench").
+The firmware is the real AVR build of main.c, linked with bench/usbdrv.c
+instead of the V-USB driver: usbPoll() passes an upload of BENCH_SIZE bytes
+to usbFunctionSetup() and usbFunctionWrite() one packet per call and writes
+markers to GPIOR0 around each call (see bench.h).
+
+simbench runs the ELF file instruction by instruction with the boot loader
+jumper (PD3) pulled low and reports
+- cycles per SETUP and per data packet of up to 8 bytes (mean and maximum),
+- cycles per page, i.e. all calls between two page markers, and
+- the longest time with interrupts disabled after the first marker, with
+  the address of the instruction which disabled them. usbdrv.h allows 25
+  cycles at 12 MHz (somewhat more at faster clocks); changes of the write
+  path must stay within this limit.
+
+SPM instructions complete immediately in simavr, so busy waits on the SPM
+unit are not part of the numbers; see host/hostsim.c for the time model.
+
+Usage: simbench [-m <mcu>] [-f <hz>] [-l <cycles>] <elf-file>
+
+"-l" makes the exit code 1 if interrupts were disabled for longer than
+the given number of cycles.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <simavr/sim_avr.h>
+#include <simavr/sim_elf.h>
+#include <simavr/avr_ioport.h>
+#include "bench.h"
+
+#define BENCH_MAX_CYCLES    2000000000ULL   /* give up if the markers stop */
+
+typedef struct benchStat{
+    unsigned long       count;
+    avr_cycle_count_t   sum, max;
+}benchStat_t;
+
+static benchStat_t          setupStat, dataStat, pageStat;
+static avr_cycle_count_t    callStart, pageCycles;
+static int                  callKind, started, done;
+
+/* ------------------------------------------------------------------------- */
+
+static void statAdd(benchStat_t *s, avr_cycle_count_t cycles)
+{
+    s->count++;
+    s->sum += cycles;
+    if(cycles > s->max)
+        s->max = cycles;
+}
+
+static void statPrint(char *name, benchStat_t *s, unsigned long frequency)
+{
+    if(s->count == 0)
+        return;
+    printf("  %-14s %6lu x  mean %8.1f  max %8llu cycles  (max %.1f us)\n", name, s->count,
+        (double)s->sum / s->count, (unsigned long long)s->max, s->max * 1e6 / frequency);
+}
+
+static void markerWrite(struct avr_t *avr, avr_io_addr_t addr, uint8_t v, void *param)
+{
+avr_cycle_count_t   cycles;
+
+    avr->data[addr] = v;
+    started = 1;
+    switch(v){
+    case BENCH_SETUP:
+    case BENCH_DATA:
+        callKind = v;
+        callStart = avr->cycle;
+        break;
+    case BENCH_END:
+        cycles = avr->cycle - callStart;
+        statAdd(callKind == BENCH_SETUP ? &setupStat : &dataStat, cycles);
+        pageCycles += cycles;
+        break;
+    case BENCH_PAGE:
+        statAdd(&pageStat, pageCycles);
+        pageCycles = 0;
+        break;
+    case BENCH_DONE:
+        done = 1;
+        break;
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void usage(char *name)
+{
+    fprintf(stderr, "usage: %s [-m <mcu>] [-f <hz>] [-l <cycles>] <elf-file>\n", name);
+}
+
+int main(int argc, char **argv)
+{
+elf_firmware_t      firmware;
+avr_t               *avr;
+char                *mcu = "atmega32u4", *file = NULL;
+unsigned long       frequency = 16000000, limit = 0;
+avr_cycle_count_t   disabledAt = 0, window, maxWindow = 0;
+avr_flashaddr_t     disabledPc = 0, maxWindowPc = 0;
+int                 i, state, enabled = 0;
+
+    for(i = 1; i < argc; i++){
+        if(strcmp(argv[i], "-m") == 0 && i + 1 < argc){
+            mcu = argv[++i];
+        }else if(strcmp(argv[i], "-f") == 0 && i + 1 < argc){
+            frequency = strtoul(argv[++i], NULL, 0);
+        }else if(strcmp(argv[i], "-l") == 0 && i + 1 < argc){
+            limit = strtoul(argv[++i], NULL, 0);
+        }else if(argv[i][0] != '-' && file == NULL){
+            file = argv[i];
+        }else{
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if(file == NULL){
+        usage(argv[0]);
+        return 2;
+    }
+    memset(&firmware, 0, sizeof(firmware));
+    if(elf_read_firmware(file, &firmware) != 0){
+        fprintf(stderr, "Error reading %s\n", file);
+        return 2;
+    }
+    if(firmware.mmcu[0] == 0)
+        strncpy(firmware.mmcu, mcu, sizeof(firmware.mmcu) - 1);
+    if(firmware.frequency == 0)
+        firmware.frequency = frequency;
+    if((avr = avr_make_mcu_by_name(firmware.mmcu)) == NULL){
+        fprintf(stderr, "simavr does not know %s\n", firmware.mmcu);
+        return 2;
+    }
+    avr_init(avr);
+    avr_load_firmware(avr, &firmware);
+    avr->pc = firmware.flashbase;   /* BOOTRST: start at the boot loader */
+    avr_register_io_write(avr, BENCH_MARK_ADDR, markerWrite, NULL);
+    avr_raise_irq(avr_io_getirq(avr, AVR_IOCTL_IOPORT_GETIRQ('D'), 3), 0);   /* jumper set */
+
+    while(!done){
+        state = avr_run(avr);
+        if(state == cpu_Done || state == cpu_Crashed){
+            fprintf(stderr, "Simulation stopped at 0x%04x before the upload was complete\n", avr->pc);
+            return 2;
+        }
+        if(avr->cycle > BENCH_MAX_CYCLES){
+            fprintf(stderr, "No progress after %llu cycles\n", (unsigned long long)avr->cycle);
+            return 2;
+        }
+        if(!started){   /* initialization runs with interrupts disabled */
+            enabled = avr->sreg[S_I];
+            disabledAt = avr->cycle;
+            continue;
+        }
+        if(enabled && !avr->sreg[S_I]){
+            disabledAt = avr->cycle;
+            disabledPc = avr->pc;
+        }else if(!enabled && avr->sreg[S_I]){
+            window = avr->cycle - disabledAt;
+            if(window > maxWindow){
+                maxWindow = window;
+                maxWindowPc = disabledPc;
+            }
+        }
+        enabled = avr->sreg[S_I];
+    }
+
+    printf("%s at %lu Hz, %d bytes uploaded:\n", firmware.mmcu, (unsigned long)firmware.frequency, BENCH_SIZE);
+    statPrint("SETUP", &setupStat, firmware.frequency);
+    statPrint("data packet", &dataStat, firmware.frequency);
+    statPrint("page", &pageStat, firmware.frequency);
+    printf("  interrupts disabled for at most %llu cycles (%.2f us), near 0x%04x\n",
+        (unsigned long long)maxWindow, maxWindow * 1e6 / firmware.frequency, maxWindowPc);
+    if(limit != 0 && maxWindow > limit){
+        printf("Interrupt-disabled window exceeds the limit of %lu cycles\n", limit);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,103 @@
+/* Name: usbdrv.c (simavr benchmark build)
+ * Project: AVR bootloader HID
+ * Author: bootloadHID contributors
+ * Creation Date: 2026-10-19
+ * Tabsize: 4
+ * License: GNU GPL v2 (see License.txt)
+ * This Revision: $Id$
+ */
+
+/*
+General Description:
+Replacement for the V-USB driver in the benchmark build ("make bench"),
+which runs under simavr. main.c includes "usbdrv.c"; with bench/ first in
+the include path it gets this file. Instead of receiving packets through
+the bit-banged interrupt routine, usbPoll() passes one packet per call to
+the USB functions of main.c, the way usbProcessRx() does: for each 128 byte
+block of BENCH_SIZE bytes a SETUP of SET_REPORT 2, then the 132 bytes of the
+report in packets of 8 bytes. The INT0 interrupt is never enabled, so the
+measurement is not disturbed. With BOOTLOADER_CAN_STATUS, a status report
+counts as fetched as soon as it is set, like a host polling EP1 in time.
+
+Each call is enclosed in markers written to GPIOR0, see bench.h.
+*/
+
+#include "usbdrv.h"
+#include "oddebug.h"
+#include "bench.h"
+
+#define BENCH_REPORT_SIZE   132     /* report ID, address, 128 data bytes */
+
+usbMsgPtr_t     usbMsgPtr;
+#if !USB_CFG_SUPPRESS_INTR_CODE
+usbTxStatus_t   usbTxStatus1;       /* usbInterruptIsReady() reads its len */
+#endif
+
+static unsigned benchAddress;       /* of the report being passed */
+static uchar    benchOffset;        /* bytes of the report passed */
+static uchar    benchInReport;      /* SETUP has been passed */
+
+USB_PUBLIC void usbInit(void)
+{
+#if !USB_CFG_SUPPRESS_INTR_CODE
+    usbTxLen1 = USBPID_NAK;         /* nothing pending */
+#endif
+}
+
+#if !USB_CFG_SUPPRESS_INTR_CODE
+USB_PUBLIC void usbSetInterrupt(uchar *data, uchar len)
+{
+    usbTxLen1 = USBPID_NAK;         /* fetched at once, see above */
+}
+#endif
+
+static uchar    benchByte(uchar offset)
+/* returns byte 'offset' of the current report */
+{
+    if(offset == 0)
+        return 2;
+    if(offset < 4)
+        return offset == 3 ? 0 : benchAddress >> (8 * (offset - 1));
+    offset -= 4;
+    return (benchAddress + offset) ^ 0x5a;  /* differs from blank flash */
+}
+
+USB_PUBLIC void usbPoll(void)
+{
+uchar   packet[8], i, len;
+
+    if(benchAddress >= BENCH_SIZE){
+        GPIOR0 = BENCH_DONE;
+        return;
+    }
+    if(!benchInReport){
+        packet[0] = USBRQ_TYPE_CLASS | USBRQ_RCPT_INTERFACE;
+        packet[1] = USBRQ_HID_SET_REPORT;
+        packet[2] = 2;                  /* report ID */
+        packet[3] = 3;                  /* feature report */
+        packet[4] = packet[5] = 0;
+        packet[6] = BENCH_REPORT_SIZE;
+        packet[7] = 0;
+        GPIOR0 = BENCH_SETUP;
+        usbFunctionSetup(packet);
+        GPIOR0 = BENCH_END;
+        benchInReport = 1;
+        return;
+    }
+    len = BENCH_REPORT_SIZE - benchOffset;
+    if(len > 8)
+        len = 8;
+    for(i = 0; i < len; i++)
+        packet[i] = benchByte(benchOffset + i);
+    GPIOR0 = BENCH_DATA;
+    usbFunctionWrite(packet, len);
+    GPIOR0 = BENCH_END;
+    benchOffset += len;
+    if(benchOffset >= BENCH_REPORT_SIZE){
+        benchOffset = 0;
+        benchInReport = 0;
+        benchAddress += 128;
+        if((benchAddress & (SPM_PAGESIZE - 1)) == 0)
+            GPIOR0 = BENCH_PAGE;
+    }
+}
@@ -80,6 +80,17 @@ these macros are defined, the boot loader usees them.
 
 /* --------------------------- Functional Range ---------------------------- */
 
+#ifndef BOOTLOADER_PROFILE_SPEED
+#define BOOTLOADER_PROFILE_SPEED    0
+#endif
+/* "make PROFILE=speed" defines this to 1. The boot loader is then built for a
+ * boot section of 4 kB (see the Makefile for the devices which have one)
+ * and trades flash for upload speed: the options below which save transfers
+ * or waiting (read back, fingerprint, skip and status) are enabled, the
+ * fingerprint is computed 4 bits at a time with a table in RAM, and the code
+ * is compiled with -O2 and unrolled loops instead of -Os.
+ */
+
 #define BOOTLOADER_CAN_EXIT     1
 /* If this macro is defined to 1, the boot loader command line utility can
  * initiate a reboot after uploading the FLASH when the "-r" command line
@@ -93,6 +104,69 @@ these macros are defined, the boot loader usees them.
  * an example: http://git.lochraster.org:2080/?p=fd0/usbload;a=tree
  */
 
+#define BOOTLOADER_CAN_READ     BOOTLOADER_PROFILE_SPEED
+/* If this macro is defined to 1, the flash can be read back through feature
+ * report 3 (e.g. with the "--dump" option of the command line utility). The
+ * host sets the start address with a SET_REPORT and reads 128 bytes per
+ * GET_REPORT, the address advances automatically. This costs about 150
+ * bytes, so the boot loader no longer fits into 2 kB on all devices.
+ */
+
+#define BOOTLOADER_CAN_EEPROM   0
+/* If this macro is defined to 1, the EEPROM can be written with feature
+ * report 4 (same layout as the flash data report 2) and read with
+ * GET_REPORT 4 from the address set with report 3. Only bytes which differ
+ * are written, each write runs while the next bytes are received. The
+ * command line utility programs a ".eep" file given next to the flash image.
+ */
+
+#define BOOTLOADER_CAN_FINGERPRINT  BOOTLOADER_PROFILE_SPEED
+/* If this macro is defined to 1, GET_REPORT 5 returns a CRC-32 over the
+ * application section (all flash below BOOTLOADER_ADDRESS, which the
+ * Makefile passes in) and its size. The command line utility looks the CRC
+ * up in its image registry to find out what the device contains without
+ * reading it. Computing the CRC takes about 15 cycles per bit, 0.2 seconds
+ * for 24 kB at 16 MHz.
+ */
+
+#define BOOTLOADER_CAN_SKIP     BOOTLOADER_PROFILE_SPEED
+/* If this macro is defined to 1, incoming data is compared with the flash
+ * while it is collected, and pages which already contain it are neither
+ * erased nor written. The erase of a page starts when the first difference
+ * is found. The number of skipped pages is appended to the device info
+ * report, so the host can show it. This costs about 100 bytes.
+ */
+
+#define BOOTLOADER_CAN_STATUS   BOOTLOADER_PROFILE_SPEED
+/* If this macro is defined to 1, the boot loader sends input report 6 on the
+ * interrupt-in endpoint when a page has been programmed: the page address and
+ * whether it was written or kept (with BOOTLOADER_CAN_SKIP). The host follows
+ * these notifications while it sends the next data, instead of guessing when
+ * the device is done. This enables the interrupt code of the USB driver and
+ * polls the endpoint every 10 ms; it costs about 200 bytes.
+ */
+
+#define BOOTLOADER_CAN_PATCH    BOOTLOADER_PROFILE_SPEED
+/* If this macro is defined to 1, feature report 7 changes up to 32 bytes
+ * within a page: the boot loader copies the page from the flash, replaces
+ * these bytes and writes it again. The command line utility uses it when
+ * it knows the flash contents (from its image registry or by reading the
+ * page back) and all changes of a page fit into one report, so that a small
+ * change costs a few bytes of transfer and one page write. This costs about
+ * 150 bytes.
+ */
+
+#ifndef BOOTLOADER_TRACE
+#define BOOTLOADER_TRACE    0
+#endif
+/* "make TRACE=1" defines this to 1. The DBG1() trace points of main.c then
+ * record events with a timer 1 timestamp in a ring buffer, which the main
+ * loop sends to the UART while it is idle (see trace.h). Unlike DEBUG_LEVEL,
+ * this keeps the USB timing, so it can stay enabled while real uploads are
+ * profiled. It costs about 400 bytes of flash and 200 bytes of RAM; use a
+ * 4 kB boot section (PROFILE=speed) if the boot loader does not fit.
+ */
+
 /* ------------------------------------------------------------------------- */
 
 /* Example configuration: Port D bit 3 is connected to a jumper which ties
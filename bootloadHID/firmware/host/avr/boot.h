@@ -0,0 +1,23 @@
+/* Name: boot.h (host build)
+ * Project: AVR bootloader HID
+ * Author: bootloadHID contributors
+ * Creation Date: 2026-10-19
+ * Tabsize: 4
+ * License: GNU GPL v2 (see License.txt)
+ * This Revision: $Id$
+ */
+
+#ifndef __host_avr_boot_h_included__
+#define __host_avr_boot_h_included__
+
+#include "hostsim.h"
+
+#define boot_page_erase(addr)       hostSpmErase(addr)
+#define boot_page_fill(addr, data)  hostSpmFill(addr, data)
+#define boot_page_write(addr)       hostSpmWrite(addr)
+#define boot_rww_enable()           hostSpmRwwEnable()
+#define boot_spm_busy()             hostSpmBusy()
+#define boot_spm_busy_wait()        hostSpmBusyWait()
+#define boot_rww_busy()             hostRwwBusy()
+
+#endif /* __host_avr_boot_h_included__ */
@@ -0,0 +1,19 @@
+/* Name: eeprom.h (host build)
+ * Project: AVR bootloader HID
+ * Author: bootloadHID contributors
+ * Creation Date: 2026-10-19
+ * Tabsize: 4
+ * License: GNU GPL v2 (see License.txt)
+ * This Revision: $Id$
+ */
+
+#ifndef __host_avr_eeprom_h_included__
+#define __host_avr_eeprom_h_included__
+
+#include "hostsim.h"
+
+#define eeprom_read_byte(addr)          hostEepromRead((unsigned long)(addr))
+#define eeprom_update_byte(addr, value) hostEepromUpdate((unsigned long)(addr), value)
+#define eeprom_busy_wait()              hostEepromBusyWait()
+
+#endif /* __host_avr_eeprom_h_included__ */
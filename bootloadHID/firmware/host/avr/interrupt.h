@@ -0,0 +1,18 @@
+/* Name: interrupt.h (host build)
+ * Project: AVR bootloader HID
+ * Author: bootloadHID contributors
+ * Creation Date: 2026-10-19
+ * Tabsize: 4
+ * License: GNU GPL v2 (see License.txt)
+ * This Revision: $Id$
+ */
+
+#ifndef __host_avr_interrupt_h_included__
+#define __host_avr_interrupt_h_included__
+
+#include "hostsim.h"
+
+#define cli()   hostCli()
+#define sei()   hostSei()
+
+#endif /* __host_avr_interrupt_h_included__ */
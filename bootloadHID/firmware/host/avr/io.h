@@ -0,0 +1,49 @@
+/* Name: io.h (host build)
+ * Project: AVR bootloader HID
+ * Author: bootloadHID contributors
+ * Creation Date: 2026-10-19
+ * Tabsize: 4
+ * License: GNU GPL v2 (see License.txt)
+ * This Revision: $Id$
+ */
+
+/* Stub of <avr/io.h> for the host build. The memory sizes of the emulated
+ * chip come from the Makefile (HOSTDEVICE), the registers used by the boot
+ * loader are fields of hostIo.
+ */
+
+#ifndef __host_avr_io_h_included__
+#define __host_avr_io_h_included__
+
+#include <stdint.h>
+#include "hostsim.h"
+
+#ifndef FLASHEND
+#   define FLASHEND     0x7fff
+#endif
+#ifndef SPM_PAGESIZE
+#   define SPM_PAGESIZE 128
+#endif
+#ifndef E2END
+#   define E2END        0x3ff
+#endif
+
+#define PORTD   hostIo.portd
+#define PIND    hostIo.pind
+#define DDRD    hostIo.ddrd
+#define MCUCR   hostIo.mcucr
+#define EICRA   hostIo.eicra
+#define EIMSK   hostIo.eimsk
+#define EIFR    hostIo.eifr
+#define TCCR0B  hostIo.tccr0b
+
+#define IVSEL   1
+#define IVCE    0
+#define ISC01   1
+#define ISC00   0
+#define INT0    0
+#define INTF0   0
+
+#define _BV(bit)    (1 << (bit))
+
+#endif /* __host_avr_io_h_included__ */
@@ -0,0 +1,31 @@
+/* Name: pgmspace.h (host build)
+ * Project: AVR bootloader HID
+ * Author: bootloadHID contributors
+ * Creation Date: 2026-10-19
+ * Tabsize: 4
+ * License: GNU GPL v2 (see License.txt)
+ * This Revision: $Id$
+ */
+
+/* Stub of <avr/pgmspace.h> for the host build. The boot loader reads the
+ * application flash with integer addresses and its own PROGMEM data (the
+ * descriptors) with pointers, so the argument type selects the memory.
+ */
+
+#ifndef __host_avr_pgmspace_h_included__
+#define __host_avr_pgmspace_h_included__
+
+#include "hostsim.h"
+
+#define PROGMEM
+
+#define pgm_read_byte(addr) _Generic((addr),        \
+        unsigned short: hostFlashRead,              \
+        int: hostFlashRead,                         \
+        unsigned: hostFlashRead,                    \
+        long: hostFlashRead,                        \
+        unsigned long: hostFlashRead,               \
+        default: hostProgmemRead)(addr)
+#define pgm_read_byte_far(addr) hostFlashRead(addr)
+
+#endif /* __host_avr_pgmspace_h_included__ */
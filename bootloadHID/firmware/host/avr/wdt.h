@@ -0,0 +1,15 @@
+/* Name: wdt.h (host build)
+ * Project: AVR bootloader HID
+ * Author: bootloadHID contributors
+ * Creation Date: 2026-10-19
+ * Tabsize: 4
+ * License: GNU GPL v2 (see License.txt)
+ * This Revision: $Id$
+ */
+
+#ifndef __host_avr_wdt_h_included__
+#define __host_avr_wdt_h_included__
+
+#define wdt_reset()     ((void)0)
+
+#endif /* __host_avr_wdt_h_included__ */
@@ -0,0 +1,707 @@
+/* Name: hostsim.c
+ * Project: AVR bootloader HID
+ * Author: bootloadHID contributors
+ * Creation Date: 2026-10-19
+ * Tabsize: 4
+ * License: GNU GPL v2 (see License.txt)
+ * This Revision: $Id$
+ */
+
+/*
+General Description:
+Host build of the boot loader ("make hostsim"). main.c is compiled with the
+stub headers in this directory instead of avr-libc and V-USB, so that
+usbFunctionSetup(), usbFunctionWrite() and usbFunctionRead() run on the
+build machine against an emulated device:
+
+- The flash has a temporary page buffer, page erase and page write like the
+  real SPM unit. Write ANDs the buffer into the page, so a missing erase
+  shows up as wrong data. Erase and write keep the SPM unit busy for the
+  programming time, and the RWW section is unreadable until
+  boot_rww_enable(). SPM instructions while busy, reads of the busy RWW
+  section, words filled twice, SPM with interrupts enabled and writes into
+  the boot loader section are counted as errors.
+- The EEPROM takes the EEPROM write time per changed byte.
+- With BOOTLOADER_CAN_STATUS, the main loop's status code runs after each
+  packet, and the host polls the interrupt-in endpoint at the configured
+  interval. Each status report must name a page of the upload in order,
+  and the last one the last page.
+- Control transfers are passed to the boot loader in 8 byte packets as the
+  V-USB interrupt routine does, with the conditioning of usbProcessRx().
+
+The time is emulated: each transfer costs the transfer overhead, each packet
+the packet time, and busy waits advance to the end of the SPM operation.
+The firmware's own CPU time is not counted.
+
+Usage: hostsim [-p <us>] [-o <us>] [-s <us>] [-n <passes>] [-f <hexfile>] <intel-hexfile>
+
+The flash is blank or holds the "-f" file. The image is uploaded <passes>
+times (report 2, 128 bytes per report, the last one short if the boot
+loader supports it), then
+the boot loader is left through report 1 and the flash is compared with the
+image. The exit code is 0 if it matches and no errors were counted.
+
+If the boot loader has report 7 (BOOTLOADER_CAN_PATCH), the uploads start
+from the known flash contents like the command line utility's registry:
+unchanged pages are not sent, and pages whose changes fit into one report 7
+are patched.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <setjmp.h>
+
+#define main    bootloaderMain
+#include "main.c"
+#undef main
+
+#define HOST_FLASH_SIZE     ((long)FLASHEND + 1)
+#define HOST_EEPROM_SIZE    ((long)E2END + 1)
+#define HOST_BOOT_START     (BOOTLOADER_ADDRESS ? (long)BOOTLOADER_ADDRESS : HOST_FLASH_SIZE - 2048)
+#define HOST_BLOCK_SIZE     128     /* data bytes per report 2 */
+#define HOST_PATCH_SIZE     32      /* data bytes per report 7 */
+#define HOST_FEATURE_PATCH  0x100
+
+volatile hostIo_t   hostIo;
+
+static unsigned char    hostFlash[HOST_FLASH_SIZE], hostEeprom[HOST_EEPROM_SIZE];
+static unsigned char    hostImage[HOST_FLASH_SIZE], hostBase[HOST_FLASH_SIZE];
+static long             hostLastPage;   /* written last by upload(), -1 if none */
+static long             hostPatches, hostPatchBytes;
+static unsigned char    hostTempBuffer[SPM_PAGESIZE], hostTempFilled[SPM_PAGESIZE / 2];
+static int              hostInterruptsEnabled, hostRwwLocked;
+static double           hostNow, hostSpmReady, hostEepromReady;     /* seconds */
+static double           hostPacketTime = 400e-6, hostTransferTime = 2e-3;
+static double           hostSpmTime = 4.5e-3, hostEepromTime = 3.4e-3;
+static jmp_buf          hostApplication;
+
+static struct hostCounters{
+    long    erases, writes, fills, rwwEnables, eepromWrites;
+    long    transfers, packets;
+    double  spmWait;        /* seconds in boot_spm_busy_wait() */
+    /* errors: */
+    long    spmWhileBusy;   /* SPM instruction while the SPM unit was busy */
+    long    spmWithEeprom;  /* SPM or EEPROM write while the other was busy */
+    long    spmUnlocked;    /* SPM instruction with interrupts enabled */
+    long    refills;        /* temporary buffer word written twice */
+    long    busyReads;      /* RWW section read while not readable */
+    long    bootWrites;     /* erase or write of the boot loader section */
+    long    badStatus;      /* status report out of order or malformed */
+}hostCount;
+
+static struct hostStatus{
+    unsigned char   report[8];
+    int             full;           /* report waits for the host */
+    double          nextPoll;
+    long            reports, written, kept;
+    long            expect;         /* next page the device may confirm */
+    long            last;           /* address confirmed last, -1 if none */
+}hostStatus;
+
+/* ------------------------------------------------------------------------- */
+/* ---------------------------- emulated device ---------------------------- */
+/* ------------------------------------------------------------------------- */
+
+void    hostDelay(double seconds)
+{
+    hostNow += seconds;
+}
+
+void    hostCli(void)
+{
+    hostInterruptsEnabled = 0;
+}
+
+void    hostSei(void)
+{
+    hostInterruptsEnabled = 1;
+}
+
+unsigned char   hostFlashRead(unsigned long addr)
+{
+    if(addr >= HOST_FLASH_SIZE)
+        return 0xff;
+    if(hostRwwLocked && addr < HOST_BOOT_START){
+        hostCount.busyReads++;
+        return 0xff;    /* undefined on the real device */
+    }
+    return hostFlash[addr];
+}
+
+unsigned char   hostProgmemRead(const void *addr)
+{
+    return *(const unsigned char *)addr;
+}
+
+static int  spmAccept(void)
+/* common checks of all SPM instructions, returns 0 if the instruction is
+ * ignored
+ */
+{
+    if(hostInterruptsEnabled)
+        hostCount.spmUnlocked++;
+    if(hostNow < hostSpmReady){
+        hostCount.spmWhileBusy++;
+        return 0;
+    }
+    if(hostNow < hostEepromReady){
+        hostCount.spmWithEeprom++;
+        return 0;
+    }
+    return 1;
+}
+
+static void clearTempBuffer(void)
+{
+    memset(hostTempBuffer, 0xff, sizeof(hostTempBuffer));
+    memset(hostTempFilled, 0, sizeof(hostTempFilled));
+}
+
+void    hostSpmErase(unsigned long addr)
+{
+    if(!spmAccept())
+        return;
+    addr &= ~(unsigned long)(SPM_PAGESIZE - 1);
+    if(addr >= HOST_BOOT_START){
+        hostCount.bootWrites++;
+        return;
+    }
+    memset(hostFlash + addr, 0xff, SPM_PAGESIZE);
+    hostCount.erases++;
+    hostRwwLocked = 1;
+    hostSpmReady = hostNow + hostSpmTime;
+}
+
+void    hostSpmFill(unsigned long addr, unsigned short data)
+{
+unsigned    i = addr & (SPM_PAGESIZE - 2);
+
+    if(!spmAccept())
+        return;
+    hostCount.fills++;
+    if(hostTempFilled[i / 2]){  /* not possible before the buffer is cleared */
+        hostCount.refills++;
+        return;
+    }
+    hostTempFilled[i / 2] = 1;
+    hostTempBuffer[i] = data;
+    hostTempBuffer[i + 1] = data >> 8;
+}
+
+void    hostSpmWrite(unsigned long addr)
+{
+int     i;
+
+    if(!spmAccept())
+        return;
+    addr &= ~(unsigned long)(SPM_PAGESIZE - 1);
+    if(addr >= HOST_BOOT_START){
+        hostCount.bootWrites++;
+    }else{
+        for(i = 0; i < SPM_PAGESIZE; i++)
+            hostFlash[addr + i] &= hostTempBuffer[i];   /* writing can only clear bits */
+        hostCount.writes++;
+        hostRwwLocked = 1;
+        hostSpmReady = hostNow + hostSpmTime;
+    }
+    clearTempBuffer();
+}
+
+void    hostSpmRwwEnable(void)
+{
+    if(!spmAccept())
+        return;
+    hostCount.rwwEnables++;
+    hostRwwLocked = 0;
+    clearTempBuffer();
+}
+
+int     hostSpmBusy(void)
+{
+    return hostNow < hostSpmReady;
+}
+
+void    hostSpmBusyWait(void)
+{
+    if(hostNow < hostSpmReady){
+        hostCount.spmWait += hostSpmReady - hostNow;
+        hostNow = hostSpmReady;
+    }
+}
+
+int     hostRwwBusy(void)
+{
+    return hostRwwLocked;
+}
+
+void    hostEepromBusyWait(void)
+{
+    if(hostNow < hostEepromReady)
+        hostNow = hostEepromReady;
+}
+
+unsigned char   hostEepromRead(unsigned long addr)
+{
+    hostEepromBusyWait();
+    return addr < HOST_EEPROM_SIZE ? hostEeprom[addr] : 0xff;
+}
+
+void    hostEepromUpdate(unsigned long addr, unsigned char value)
+{
+    hostEepromBusyWait();
+    if(addr >= HOST_EEPROM_SIZE || hostEeprom[addr] == value)
+        return;
+    if(hostNow < hostSpmReady){ /* EEPROM is locked while SPM is busy */
+        hostCount.spmWithEeprom++;
+        return;
+    }
+    hostEeprom[addr] = value;
+    hostCount.eepromWrites++;
+    hostEepromReady = hostNow + hostEepromTime;
+}
+
+static void hostStartApplication(void) __attribute__((__noreturn__));
+
+static void hostStartApplication(void)
+{
+    longjmp(hostApplication, 1);
+}
+
+/* ------------------------------------------------------------------------- */
+/* ------------------------------ USB transfers ---------------------------- */
+/* ------------------------------------------------------------------------- */
+
+void    hostInterruptIn(unsigned char *data, unsigned char len)
+{
+    if(hostStatus.full || len > sizeof(hostStatus.report)){
+        hostCount.badStatus++;  /* the driver would overwrite the buffer */
+        return;
+    }
+    memcpy(hostStatus.report, data, len);
+    hostStatus.full = 1;
+}
+
+int     hostInterruptIsReady(void)
+{
+    return !hostStatus.full;
+}
+
+#if BOOTLOADER_CAN_STATUS
+static void hostPollInterrupt(void)
+/* the host controller's poll of the interrupt-in endpoint */
+{
+unsigned char   *r = hostStatus.report;
+long            addr;
+
+    if(hostNow < hostStatus.nextPoll)
+        return;
+    hostStatus.nextPoll = hostNow + USB_CFG_INTR_POLL_INTERVAL * 1e-3;
+    if(!hostStatus.full)
+        return;
+    hostStatus.full = 0;
+    hostStatus.reports++;
+    addr = r[1] | r[2] << 8 | (long)r[3] << 16;
+    /* a report confirms its page and all pages before it */
+    if(r[0] != 6 || addr < hostStatus.expect || addr % SPM_PAGESIZE != 0 || r[4] > 1){
+        hostCount.badStatus++;
+        return;
+    }
+    if(r[4] == 0){
+        hostStatus.written++;
+    }else{
+        hostStatus.kept++;
+    }
+    hostStatus.last = addr;
+    hostStatus.expect = addr + SPM_PAGESIZE;
+}
+#endif
+
+static void hostPacket(void)
+{
+    hostNow += hostPacketTime;
+    hostCount.packets++;
+#if BOOTLOADER_CAN_STATUS
+    sendStatus();   /* the main loop runs between packets */
+    hostPollInterrupt();
+#endif
+}
+
+static int  controlTransfer(int type, int request, int reportId, unsigned char *data, int len)
+/* Runs a HID class request on the boot loader like V-USB does, returns the
+ * number of bytes transferred or -1 if the device stalls or never ends the
+ * data phase.
+ */
+{
+unsigned char   setup[8], packet[8];
+usbRequest_t    *rq = (void *)setup;
+uchar           replyLen, userRw, n, rval = 0;
+int             i;
+
+    hostNow += hostTransferTime;
+    hostCount.transfers++;
+    rq->bmRequestType = type | USBRQ_TYPE_CLASS | USBRQ_RCPT_INTERFACE;
+    rq->bRequest = request;
+    rq->wValue.word = reportId | (3 << 8);  /* feature report */
+    rq->wIndex.word = 0;
+    rq->wLength.word = len;
+    memcpy(packet, setup, sizeof(setup));   /* the driver passes its receive buffer */
+    hostPacket();
+    replyLen = usbFunctionSetup(packet);
+    userRw = replyLen == USB_NO_MSG;
+    if(type == USBRQ_DIR_DEVICE_TO_HOST){
+        if(userRw){
+            replyLen = rq->wLength.bytes[0];
+        }else if(!rq->wLength.bytes[1] && replyLen > rq->wLength.bytes[0]){
+            replyLen = rq->wLength.bytes[0];
+        }
+        for(i = 0; i < len; i += n){
+            n = replyLen > 8 ? 8 : replyLen;
+            replyLen -= n;
+            if(n > 0){
+#if USB_CFG_IMPLEMENT_FN_READ
+                if(userRw){
+                    n = usbFunctionRead(packet, n);
+                }else
+#endif
+                {
+                    memcpy(packet, usbMsgPtr, n);
+                    usbMsgPtr += n;
+                }
+            }
+            hostPacket();
+            if(n > 8)
+                return -1;
+            memcpy(data + i, packet, n);
+            if(n < 8){  /* a short packet ends the transfer */
+                i += n;
+                break;
+            }
+        }
+        return i;
+    }
+    for(i = 0; i < len; i += n){
+        n = len - i > 8 ? 8 : len - i;
+        hostPacket();
+        if(!userRw)
+            continue;   /* the driver acknowledges and drops the data */
+        memcpy(packet, data + i, n);
+        rval = usbFunctionWrite(packet, n);
+        if(rval == 0xff)
+            return -1;
+    }
+    if(userRw && rval == 0)
+        return -1;  /* status stage is NAKed until the host times out */
+    return len;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static int  hexDigits(char *s, int n)
+{
+int     value = 0;
+
+    while(n--){
+        value <<= 4;
+        if(*s >= '0' && *s <= '9'){
+            value |= *s - '0';
+        }else if(*s >= 'a' && *s <= 'f'){
+            value |= *s - 'a' + 10;
+        }else if(*s >= 'A' && *s <= 'F'){
+            value |= *s - 'A' + 10;
+        }else{
+            return -1;
+        }
+        s++;
+    }
+    return value;
+}
+
+static int  readHexFile(char *name, unsigned char *image, long *start, long *end)
+{
+FILE    *fp;
+char    line[600];
+int     len, type, address, segment = 0, i, lineNo = 0;
+long    addr;
+
+    if((fp = fopen(name, "r")) == NULL){
+        perror(name);
+        return -1;
+    }
+    while(fgets(line, sizeof(line), fp) != NULL){
+        lineNo++;
+        if(line[0] != ':')
+            continue;
+        len = hexDigits(line + 1, 2);
+        address = hexDigits(line + 3, 4);
+        type = hexDigits(line + 7, 2);
+        if(len < 0 || address < 0 || type < 0 || (int)strlen(line) < 11 + 2 * len){
+            fprintf(stderr, "%s:%d: bad record\n", name, lineNo);
+            fclose(fp);
+            return -1;
+        }
+        if(type == 1)
+            break;
+        if(type == 2 || type == 4){
+            segment = hexDigits(line + 9, 4) << (type == 2 ? 4 : 16);
+            continue;
+        }
+        if(type != 0)
+            continue;
+        for(i = 0; i < len; i++){
+            addr = segment + address + i;
+            if(addr >= HOST_BOOT_START){
+                fprintf(stderr, "%s:%d: data at 0x%lx is outside of the application section\n", name, lineNo, addr);
+                fclose(fp);
+                return -1;
+            }
+            image[addr] = hexDigits(line + 9 + 2 * i, 2);
+            if(addr < *start)
+                *start = addr;
+            if(addr + 1 > *end)
+                *end = addr + 1;
+        }
+    }
+    fclose(fp);
+    return 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static int  patchPages(long start, long size)
+/* sends report 7 for each page from 'start' which differs from hostBase;
+ * returns 1 if the changes of a page don't fit into one, -1 on errors
+ */
+{
+unsigned char   report[5 + HOST_PATCH_SIZE];
+long            page, first, last, addr;
+int             i, pass;
+
+    for(pass = 0; pass < 2; pass++){    /* check all pages, then send */
+        for(page = start; page < start + size; page += SPM_PAGESIZE){
+            first = last = -1;
+            for(addr = page; addr < page + SPM_PAGESIZE; addr++){
+                if(hostImage[addr] != hostBase[addr]){
+                    if(first < 0)
+                        first = addr;
+                    last = addr;
+                }
+            }
+            if(first < 0)
+                continue;
+            if(last - first >= HOST_PATCH_SIZE)
+                return 1;
+            if(pass == 0)
+                continue;
+            report[0] = 7;
+            for(i = 0; i < 3; i++)
+                report[1 + i] = first >> (8 * i);
+            report[4] = last + 1 - first;
+            memset(report + 5, 0xff, HOST_PATCH_SIZE);  /* full length, as bootloadHID sends it */
+            memcpy(report + 5, hostImage + first, report[4]);
+            if(controlTransfer(USBRQ_DIR_HOST_TO_DEVICE, USBRQ_HID_SET_REPORT, 7, report, sizeof(report)) != sizeof(report)){
+                fprintf(stderr, "Patch report at 0x%05lx failed\n", first);
+                return -1;
+            }
+            hostPatches++;
+            hostPatchBytes += report[4];
+            hostLastPage = page;
+        }
+    }
+    return 0;
+}
+
+static int  upload(long start, long end, int mask, int patch)
+{
+unsigned char   report[4 + HOST_BLOCK_SIZE];
+long            addr;
+int             i, len;
+
+    hostLastPage = -1;
+    for(addr = start; addr < end; addr += HOST_BLOCK_SIZE){
+        if(patch && (addr & mask) == 0){
+            if((i = patchPages(addr, mask + 1)) < 0)
+                return -1;
+            if(i == 0){
+                addr += mask + 1 - HOST_BLOCK_SIZE;
+                continue;
+            }
+        }
+        len = end - addr < HOST_BLOCK_SIZE ? end - addr : HOST_BLOCK_SIZE;
+        report[0] = 2;
+        for(i = 0; i < 3; i++)
+            report[1 + i] = addr >> (8 * i);
+        memcpy(report + 4, hostImage + addr, len);
+        if(controlTransfer(USBRQ_DIR_HOST_TO_DEVICE, USBRQ_HID_SET_REPORT, 2, report, 4 + len) != 4 + len){
+            fprintf(stderr, "Data report at 0x%05lx failed\n", addr);
+            return -1;
+        }
+        hostLastPage = (addr + len - 1) & ~(long)(SPM_PAGESIZE - 1);
+    }
+    if(patch)
+        memcpy(hostBase, hostImage, sizeof(hostBase));
+    return 0;
+}
+
+#if BOOTLOADER_CAN_STATUS
+static int  waitForStatus(long lastPage)
+/* lets the main loop run until the last page is confirmed; returns 0 if it is */
+{
+double  deadline = hostNow + 1;
+
+    while(hostStatus.last != lastPage && hostNow < deadline){
+        hostNow += 1e-3;
+        sendStatus();
+        hostPollInterrupt();
+    }
+    if(hostStatus.last != lastPage){
+        hostCount.badStatus++;
+        return -1;
+    }
+    return 0;
+}
+#endif
+
+static void usage(char *name)
+{
+    fprintf(stderr, "usage: %s [-p <us>] [-o <us>] [-s <us>] [-n <passes>] [-f <hexfile>] <intel-hexfile>\n", name);
+    fprintf(stderr, "  -p  time per 8 byte packet (default %.0f us)\n", hostPacketTime * 1e6);
+    fprintf(stderr, "  -o  overhead per control transfer (default %.0f us)\n", hostTransferTime * 1e6);
+    fprintf(stderr, "  -s  time of a page erase or write (default %.0f us)\n", hostSpmTime * 1e6);
+    fprintf(stderr, "  -n  number of uploads of the image (default 1)\n");
+    fprintf(stderr, "  -f  initial flash contents (default blank)\n");
+}
+
+int main(int argc, char **argv)
+{
+unsigned char   info[64];
+char            *file = NULL, *flashFile = NULL;
+long            start = HOST_FLASH_SIZE, end = 0, dataEnd, flashStart = HOST_FLASH_SIZE, flashEnd = 0, addr, errors, firstBad = -1, badBytes = 0;
+int             i, len, passes = 1, mask, patch;
+double          passStart;
+struct hostCounters before;
+#if BOOTLOADER_CAN_STATUS
+struct hostStatus   statusBefore;
+#endif
+
+    for(i = 1; i < argc; i++){
+        if(strcmp(argv[i], "-f") == 0 && i + 1 < argc){
+            flashFile = argv[++i];
+        }else if(argv[i][0] == '-' && strchr("posn", argv[i][1]) != NULL && argv[i][2] == 0 && i + 1 < argc){
+            double value = atof(argv[++i]);
+            switch(argv[i - 1][1]){
+            case 'p': hostPacketTime = value * 1e-6; break;
+            case 'o': hostTransferTime = value * 1e-6; break;
+            case 's': hostSpmTime = value * 1e-6; break;
+            case 'n': passes = (int)value; break;
+            }
+        }else if(argv[i][0] != '-' && file == NULL){
+            file = argv[i];
+        }else{
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if(file == NULL){
+        usage(argv[0]);
+        return 2;
+    }
+    memset(hostImage, 0xff, sizeof(hostImage));
+    if(readHexFile(file, hostImage, &start, &end) != 0)
+        return 2;
+    if(start >= end){
+        fprintf(stderr, "No data in %s\n", file);
+        return 2;
+    }
+    memset(hostFlash, 0xff, sizeof(hostFlash));
+    if(flashFile != NULL && readHexFile(flashFile, hostFlash, &flashStart, &flashEnd) != 0)
+        return 2;
+    memset(hostEeprom, 0xff, sizeof(hostEeprom));
+    clearTempBuffer();
+    hostSei();      /* state of the main loop */
+
+    len = controlTransfer(USBRQ_DIR_DEVICE_TO_HOST, USBRQ_HID_GET_REPORT, 1, info, sizeof(info));
+    if(len < 7 || info[0] != 1){
+        fprintf(stderr, "Device info report failed (%d bytes)\n", len);
+        return 1;
+    }
+    printf("Device info: %d bytes, page size %d, flash size %ld", len, info[1] | info[2] << 8,
+        info[3] | info[4] << 8 | (long)info[5] << 16 | (long)info[6] << 24);
+    if(len >= 16)
+        printf(", boot loader at 0x%lx, features 0x%x", info[8] | info[9] << 8 | (long)info[10] << 16 | (long)info[11] << 24, info[14] | info[15] << 8);
+    printf("\n");
+    patch = len >= 16 && ((info[14] | info[15] << 8) & HOST_FEATURE_PATCH);
+    memcpy(hostBase, hostFlash, sizeof(hostBase));
+
+    mask = (SPM_PAGESIZE > HOST_BLOCK_SIZE ? SPM_PAGESIZE : HOST_BLOCK_SIZE) - 1;
+    start &= ~(long)mask;
+    dataEnd = (end + 1) & ~1L;
+    end = (end + mask) & ~(long)mask;
+    if(len < 16 || !(info[14] & FEATURE_SHORT_DATA)){
+        dataEnd = end;              /* send whole pages */
+    }else if((dataEnd & (HOST_BLOCK_SIZE - 1)) == 0 && (dataEnd & mask) != 0){
+        dataEnd += 2;               /* a full report does not end the page */
+    }
+    for(i = 0; i < passes; i++){
+        before = hostCount;
+        passStart = hostNow;
+        hostStatus.expect = start;
+        hostStatus.last = -1;
+        hostPatches = hostPatchBytes = 0;
+        if(upload(start, dataEnd, mask, patch) != 0)
+            return 1;
+        printf("Upload %d: %ld bytes in %.3f s (%.0f bytes/s), %ld erases, %ld writes, %.3f s waiting for SPM\n",
+            i + 1, dataEnd - start, hostNow - passStart, hostNow > passStart ? (dataEnd - start) / (hostNow - passStart) : 0,
+            hostCount.erases - before.erases, hostCount.writes - before.writes, hostCount.spmWait - before.spmWait);
+        if(patch)
+            printf("Patch: %ld reports with %ld bytes\n", hostPatches, hostPatchBytes);
+#if BOOTLOADER_CAN_STATUS
+        statusBefore = hostStatus;
+        if(hostLastPage < 0){
+            printf("Status: nothing written\n");
+        }else if(waitForStatus(hostLastPage) != 0){
+            printf("Error: last page not confirmed by a status report\n");
+        }else{
+            printf("Status: last page confirmed after %.3f s\n", hostNow - passStart);
+        }
+        printf("Status: %ld reports (%ld written, %ld kept) for %ld pages\n", hostStatus.reports - statusBefore.reports,
+            hostStatus.written - statusBefore.written, hostStatus.kept - statusBefore.kept, (dataEnd - start + SPM_PAGESIZE - 1) / SPM_PAGESIZE);
+#endif
+    }
+    info[0] = 1;    /* leave the boot loader */
+    controlTransfer(USBRQ_DIR_HOST_TO_DEVICE, USBRQ_HID_SET_REPORT, 1, info, 7);
+    nullVector = hostStartApplication;
+    if(setjmp(hostApplication) == 0)
+        leaveBootloader();
+
+    for(addr = 0; addr < HOST_BOOT_START; addr++){
+        if(hostFlash[addr] != hostImage[addr]){
+            if(firstBad < 0)
+                firstBad = addr;
+            badBytes++;
+        }
+    }
+    printf("SPM: %ld erases, %ld writes, %ld fills, %ld RWW enables; %ld transfers, %ld packets\n",
+        hostCount.erases, hostCount.writes, hostCount.fills, hostCount.rwwEnables, hostCount.transfers, hostCount.packets);
+    errors = hostCount.spmWhileBusy + hostCount.spmWithEeprom + hostCount.spmUnlocked + hostCount.refills + hostCount.busyReads + hostCount.bootWrites + hostCount.badStatus;
+    if(hostCount.spmWhileBusy)
+        printf("Error: %ld SPM instructions while the SPM unit was busy\n", hostCount.spmWhileBusy);
+    if(hostCount.spmWithEeprom)
+        printf("Error: %ld SPM or EEPROM operations while the other one was busy\n", hostCount.spmWithEeprom);
+    if(hostCount.spmUnlocked)
+        printf("Error: %ld SPM instructions with interrupts enabled\n", hostCount.spmUnlocked);
+    if(hostCount.refills)
+        printf("Error: %ld page buffer words filled twice\n", hostCount.refills);
+    if(hostCount.busyReads)
+        printf("Error: %ld reads of the RWW section while it was busy\n", hostCount.busyReads);
+    if(hostCount.badStatus)
+        printf("Error: %ld status reports missing, out of order or overwritten\n", hostCount.badStatus);
+    if(hostCount.bootWrites)
+        printf("Error: %ld erases or writes of the boot loader section\n", hostCount.bootWrites);
+    if(badBytes){
+        printf("Flash differs from the image in %ld bytes, first at 0x%05lx\n", badBytes, firstBad);
+    }else{
+        printf("Flash matches the image\n");
+    }
+    return badBytes != 0 || errors != 0;
+}
@@ -0,0 +1,60 @@
+/* Name: hostsim.h
+ * Project: AVR bootloader HID
+ * Author: bootloadHID contributors
+ * Creation Date: 2026-10-19
+ * Tabsize: 4
+ * License: GNU GPL v2 (see License.txt)
+ * This Revision: $Id$
+ */
+
+/*
+General Description:
+Interface between the stub AVR headers of the host build and the emulated
+device in hostsim.c. The stubs map registers, SPM, EEPROM and interrupt
+control to the functions below.
+*/
+
+#ifndef __hostsim_h_included__
+#define __hostsim_h_included__
+
+typedef struct hostIo{
+    unsigned char   portd, pind, ddrd;
+    unsigned char   mcucr, eicra, eimsk, eifr, tccr0b;
+}hostIo_t;
+
+extern volatile hostIo_t    hostIo;
+
+void            hostDelay(double seconds);
+void            hostCli(void);
+void            hostSei(void);
+/* interrupt flag, SPM checks whether it is cleared */
+
+unsigned char   hostFlashRead(unsigned long addr);
+/* Reads the emulated flash; counts an error if the RWW section is read
+ * while it is not readable.
+ */
+unsigned char   hostProgmemRead(const void *addr);
+/* Reads PROGMEM data of the boot loader itself, i.e. host memory. */
+
+void            hostSpmErase(unsigned long addr);
+void            hostSpmFill(unsigned long addr, unsigned short data);
+void            hostSpmWrite(unsigned long addr);
+void            hostSpmRwwEnable(void);
+int             hostSpmBusy(void);
+void            hostSpmBusyWait(void);
+int             hostRwwBusy(void);
+/* SPM instructions and status as in avr/boot.h. Erase and write keep the
+ * SPM unit busy for the emulated programming time.
+ */
+
+unsigned char   hostEepromRead(unsigned long addr);
+void            hostEepromUpdate(unsigned long addr, unsigned char value);
+void            hostEepromBusyWait(void);
+
+void            hostInterruptIn(unsigned char *data, unsigned char len);
+int             hostInterruptIsReady(void);
+/* usbSetInterrupt() and usbInterruptIsReady() of the driver: the report
+ * waits until the host polls the interrupt-in endpoint.
+ */
+
+#endif /* __hostsim_h_included__ */
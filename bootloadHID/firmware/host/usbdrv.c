@@ -0,0 +1,81 @@
+/* Name: usbdrv.c (host build)
+ * Project: AVR bootloader HID
+ * Author: bootloadHID contributors
+ * Creation Date: 2026-10-19
+ * Tabsize: 4
+ * License: GNU GPL v2 (see License.txt)
+ * This Revision: $Id$
+ */
+
+/*
+General Description:
+Replacement for the V-USB driver in the host build. main.c includes
+"usbdrv.c"; with host/ first in the include path it gets this file. It
+provides the driver's types and entry points with the memory layout of the
+AVR (16 bit words in the SETUP packet). The control transfer handling of
+usbProcessRx() and usbBuildTxBlock() is reproduced in hostsim.c, which
+passes the data in 8 byte packets like the interrupt routine does.
+*/
+
+#include "usbconfig.h"
+#include "oddebug.h"
+
+/* keep the integer widths of the AVR */
+#define uchar   unsigned char
+#define schar   signed char
+#define uint    unsigned short
+#define ulong   unsigned int
+
+#undef  usbMsgPtr_t
+#define usbMsgPtr_t     uchar *     /* usbconfig.h uses a 16 bit scalar */
+#define usbMsgLen_t     uchar
+#define USB_NO_MSG      ((usbMsgLen_t)-1)
+
+typedef union usbWord{
+    unsigned short  word;
+    uchar           bytes[2];
+}usbWord_t;
+
+typedef struct usbRequest{
+    uchar       bmRequestType;
+    uchar       bRequest;
+    usbWord_t   wValue;
+    usbWord_t   wIndex;
+    usbWord_t   wLength;
+}usbRequest_t;
+
+#define USBRQ_DIR_MASK              0x80
+#define USBRQ_DIR_HOST_TO_DEVICE    0x00
+#define USBRQ_DIR_DEVICE_TO_HOST    0x80
+#define USBRQ_TYPE_CLASS            0x20
+#define USBRQ_RCPT_INTERFACE        0x01
+#define USBRQ_HID_GET_REPORT        0x01
+#define USBRQ_HID_SET_REPORT        0x09
+
+#define USB_INTR_CFG            EICRA
+#define USB_INTR_ENABLE         EIMSK
+#define usbDeviceConnect()      (DDRD &= ~(1 << USB_CFG_DMINUS_BIT))
+#define usbDeviceDisconnect()   (DDRD |= 1 << USB_CFG_DMINUS_BIT)
+#define usbHidReportDescriptor  usbDescriptorHidReport
+
+usbMsgPtr_t usbMsgPtr;      /* data of a reply not read with usbFunctionRead() */
+
+static void usbInit(void)
+{
+    USB_INTR_CFG |= (1 << ISC00) | (1 << ISC01);
+    USB_INTR_ENABLE |= 1 << INT0;
+}
+
+static void usbPoll(void)
+{
+    /* hostsim.c delivers the packets directly */
+}
+
+#if !USB_CFG_SUPPRESS_INTR_CODE
+#define usbInterruptIsReady()   hostInterruptIsReady()
+
+static void usbSetInterrupt(uchar *data, uchar len)
+{
+    hostInterruptIn(data, len);
+}
+#endif
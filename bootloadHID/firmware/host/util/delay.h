@@ -0,0 +1,18 @@
+/* Name: delay.h (host build)
+ * Project: AVR bootloader HID
+ * Author: bootloadHID contributors
+ * Creation Date: 2026-10-19
+ * Tabsize: 4
+ * License: GNU GPL v2 (see License.txt)
+ * This Revision: $Id$
+ */
+
+#ifndef __host_util_delay_h_included__
+#define __host_util_delay_h_included__
+
+#include "hostsim.h"
+
+#define _delay_ms(ms)   hostDelay((ms) * 1e-3)
+#define _delay_us(us)   hostDelay((us) * 1e-6)
+
+#endif /* __host_util_delay_h_included__ */
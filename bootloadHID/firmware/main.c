@@ -13,6 +13,7 @@
 #include <avr/pgmspace.h>
 #include <avr/wdt.h>
 #include <avr/boot.h>
+#include <avr/eeprom.h>
 #include <string.h>
 #include <util/delay.h>
 
@@ -20,6 +21,7 @@ static void leaveBootloader() __attribute__((__noreturn__));
 
 #include "bootloaderconfig.h"
 #include "usbdrv.c"
+#include "trace.h"
 
 /* ------------------------------------------------------------------------ */
 
@@ -36,14 +38,60 @@ static void leaveBootloader() __attribute__((__noreturn__));
 #   define addr_t           uint
 #endif
 
+#if (FLASHEND) > 0xffff
+#   define readFlashByte(addr)  pgm_read_byte_far(addr)
+#else
+#   define readFlashByte(addr)  pgm_read_byte(addr)
+#endif
+
+#if BOOTLOADER_CAN_FINGERPRINT && !defined(BOOTLOADER_ADDRESS)
+#   error "BOOTLOADER_ADDRESS must be defined for BOOTLOADER_CAN_FINGERPRINT, see Makefile"
+#endif
+#ifndef BOOTLOADER_ADDRESS
+#   define BOOTLOADER_ADDRESS   0   /* unknown, the host assumes 2 kB */
+#endif
+
+/* the last data report of an upload may be short, we fill the page with 0xff */
+#define FEATURE_SHORT_DATA  (1 << 6)
+/* feature flags in the device info report */
+#define FEATURE_FLAGS   (BOOTLOADER_CAN_READ | BOOTLOADER_CAN_EEPROM << 1 | BOOTLOADER_CAN_FINGERPRINT << 2 | BOOTLOADER_CAN_SKIP << 5 | FEATURE_SHORT_DATA | BOOTLOADER_CAN_STATUS << 7 | BOOTLOADER_CAN_PATCH << 8)
+
+/* report 3 sets the address for reading flash (GET report 3) and EEPROM
+ * (GET report 4)
+ */
+#define HAVE_READ_ADDRESS   (BOOTLOADER_CAN_READ || BOOTLOADER_CAN_EEPROM)
+#define FIRST_READ_REPORT   (BOOTLOADER_CAN_READ ? 3 : 4)
+#define LAST_READ_REPORT    (BOOTLOADER_CAN_EEPROM ? 4 : 3)
+/* usbFunctionWrite() handles reports other than 2 */
+#define HAVE_REPORT_ID      (HAVE_READ_ADDRESS || BOOTLOADER_CAN_PATCH)
+
 static addr_t           currentAddress; /* in bytes */
 static uchar            offset;         /* data already processed in current transfer */
+static uchar            dataLength;     /* data bytes of the current report 2 */
 #if BOOTLOADER_CAN_EXIT
 static uchar            exitMainloop;
 #endif
+#if HAVE_REPORT_ID
+static uchar            reportId;       /* of the current transfer */
+#endif
+#if HAVE_READ_ADDRESS
+static addr_t           readAddress;    /* next address read through report 3 or 4 */
+#endif
+#if BOOTLOADER_CAN_EEPROM
+static uint             eepromAddress;  /* next address written through report 4 */
+#endif
+#if BOOTLOADER_CAN_SKIP
+static uint             skippedPages;   /* since reset, reported in report 1 */
+#endif
+#if BOOTLOADER_CAN_STATUS
+#define STATUS_WRITTEN  0
+#define STATUS_KEPT     1
+static uchar            statusReport[5] = {6};  /* ID, page address, STATUS_* */
+static uchar            statusState;    /* 1: page is being written, 2: report is due */
+#endif
 
 
-const PROGMEM char usbHidReportDescriptor[33] = {
+const PROGMEM char usbHidReportDescriptor[USB_CFG_HID_REPORT_DESCRIPTOR_LENGTH] = {
     0x06, 0x00, 0xff,              // USAGE_PAGE (Generic Desktop)
     0x09, 0x01,                    // USAGE (Vendor Usage 1)
     0xa1, 0x01,                    // COLLECTION (Application)
@@ -52,7 +100,11 @@ const PROGMEM char usbHidReportDescriptor[33] = {
     0x75, 0x08,                    //   REPORT_SIZE (8)
 
     0x85, 0x01,                    //   REPORT_ID (1)
-    0x95, 0x06,                    //   REPORT_COUNT (6)
+#if BOOTLOADER_CAN_SKIP
+    0x95, 0x11,                    //   REPORT_COUNT (17)
+#else
+    0x95, 0x0f,                    //   REPORT_COUNT (15)
+#endif
     0x09, 0x00,                    //   USAGE (Undefined)
     0xb2, 0x02, 0x01,              //   FEATURE (Data,Var,Abs,Buf)
 
@@ -60,6 +112,36 @@ const PROGMEM char usbHidReportDescriptor[33] = {
     0x95, 0x83,                    //   REPORT_COUNT (131)
     0x09, 0x00,                    //   USAGE (Undefined)
     0xb2, 0x02, 0x01,              //   FEATURE (Data,Var,Abs,Buf)
+#if HAVE_READ_ADDRESS
+    0x85, 0x03,                    //   REPORT_ID (3)
+    0x95, 0x83,                    //   REPORT_COUNT (131)
+    0x09, 0x00,                    //   USAGE (Undefined)
+    0xb2, 0x02, 0x01,              //   FEATURE (Data,Var,Abs,Buf)
+#endif
+#if BOOTLOADER_CAN_EEPROM
+    0x85, 0x04,                    //   REPORT_ID (4)
+    0x95, 0x83,                    //   REPORT_COUNT (131)
+    0x09, 0x00,                    //   USAGE (Undefined)
+    0xb2, 0x02, 0x01,              //   FEATURE (Data,Var,Abs,Buf)
+#endif
+#if BOOTLOADER_CAN_FINGERPRINT
+    0x85, 0x05,                    //   REPORT_ID (5)
+    0x95, 0x08,                    //   REPORT_COUNT (8)
+    0x09, 0x00,                    //   USAGE (Undefined)
+    0xb2, 0x02, 0x01,              //   FEATURE (Data,Var,Abs,Buf)
+#endif
+#if BOOTLOADER_CAN_STATUS
+    0x85, 0x06,                    //   REPORT_ID (6)
+    0x95, 0x04,                    //   REPORT_COUNT (4)
+    0x09, 0x00,                    //   USAGE (Undefined)
+    0x81, 0x02,                    //   INPUT (Data,Var,Abs)
+#endif
+#if BOOTLOADER_CAN_PATCH
+    0x85, 0x07,                    //   REPORT_ID (7)
+    0x95, 0x24,                    //   REPORT_COUNT (36)
+    0x09, 0x00,                    //   USAGE (Undefined)
+    0xb2, 0x02, 0x01,              //   FEATURE (Data,Var,Abs,Buf)
+#endif
     0xc0                           // END_COLLECTION
 };
 
@@ -84,6 +166,8 @@ static void (*nullVector)(void) __attribute__((__noreturn__));
 static void leaveBootloader()
 {
     DBG1(0x01, 0, 0);
+    traceExit();
+    boot_spm_busy_wait();   /* last page may still be written */
     cli();
     boot_rww_enable();
     USB_INTR_ENABLE = 0;
@@ -101,22 +185,82 @@ static void leaveBootloader()
     nullVector();
 }
 
+#if BOOTLOADER_CAN_FINGERPRINT
+static uchar    fingerprint[9];     /* report ID, CRC-32, size */
+#if BOOTLOADER_PROFILE_SPEED
+/* CRC-32 of the values 0 to 15, kept in RAM: reading it from flash would need
+ * far addressing on devices with more than 64 kB
+ */
+static const ulong  crcTable[16] = {
+    0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+    0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c, 0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c
+};
+#endif
+
+static void computeFingerprint(void)
+{
+addr_t  addr;
+ulong   crc = 0xffffffff;
+uchar   i;
+
+    boot_spm_busy_wait();
+    cli();
+    boot_rww_enable();      /* flash may have been written */
+    sei();
+    for(addr = 0; addr < BOOTLOADER_ADDRESS; addr++){
+        if((addr & 0xff) == 0)
+            wdt_reset();
+        crc ^= readFlashByte(addr);
+#if BOOTLOADER_PROFILE_SPEED
+        crc = (crc >> 4) ^ crcTable[crc & 15];
+        crc = (crc >> 4) ^ crcTable[crc & 15];
+#else
+        for(i = 0; i < 8; i++)
+            crc = (crc >> 1) ^ (crc & 1 ? 0xedb88320 : 0);
+#endif
+    }
+    crc = ~crc;
+    fingerprint[0] = 5;
+    for(i = 0; i < 4; i++){
+        fingerprint[1 + i] = crc >> (8 * i);
+        fingerprint[5 + i] = (ulong)BOOTLOADER_ADDRESS >> (8 * i);
+    }
+}
+#endif
+
 uchar   usbFunctionSetup(uchar data[8])
 {
 usbRequest_t    *rq = (void *)data;
-static uchar    replyBuffer[7] = {
+static uchar    replyBuffer[16 + 2 * BOOTLOADER_CAN_SKIP] = {
         1,                              /* report ID */
         SPM_PAGESIZE & 0xff,
         SPM_PAGESIZE >> 8,
         ((long)FLASHEND + 1) & 0xff,
         (((long)FLASHEND + 1) >> 8) & 0xff,
         (((long)FLASHEND + 1) >> 16) & 0xff,
-        (((long)FLASHEND + 1) >> 24) & 0xff
+        (((long)FLASHEND + 1) >> 24) & 0xff,
+        /* hosts before protocol version 2 read only the bytes above */
+        2,                              /* protocol version */
+        (long)BOOTLOADER_ADDRESS & 0xff,
+        ((long)BOOTLOADER_ADDRESS >> 8) & 0xff,
+        ((long)BOOTLOADER_ADDRESS >> 16) & 0xff,
+        ((long)BOOTLOADER_ADDRESS >> 24) & 0xff,
+        128, 0,                         /* data bytes per report */
+        FEATURE_FLAGS & 0xff,
+        FEATURE_FLAGS >> 8
     };
 
+#if HAVE_REPORT_ID
+    reportId = rq->wValue.bytes[0];
+#endif
     if(rq->bRequest == USBRQ_HID_SET_REPORT){
+#if HAVE_REPORT_ID
+        if((reportId >= 2 && reportId <= 2 + HAVE_READ_ADDRESS + BOOTLOADER_CAN_EEPROM) || (BOOTLOADER_CAN_PATCH && reportId == 7)){
+#else
         if(rq->wValue.bytes[0] == 2){
+#endif
             offset = 0;
+            dataLength = rq->wLength.bytes[0] - 4;  /* without ID and address */
             return USB_NO_MSG;
         }
 #if BOOTLOADER_CAN_EXIT
@@ -125,12 +269,245 @@ static uchar    replyBuffer[7] = {
         }
 #endif
     }else if(rq->bRequest == USBRQ_HID_GET_REPORT){
+#if HAVE_READ_ADDRESS
+        if(reportId >= FIRST_READ_REPORT && reportId <= LAST_READ_REPORT){
+            offset = 0;
+            return USB_NO_MSG;  /* usbFunctionRead() delivers the data */
+        }
+#endif
+#if BOOTLOADER_CAN_FINGERPRINT
+        if(rq->wValue.bytes[0] == 5){
+            computeFingerprint();
+            usbMsgPtr = (usbMsgPtr_t)fingerprint;
+            return sizeof(fingerprint);
+        }
+#endif
+#if BOOTLOADER_CAN_SKIP
+        replyBuffer[16] = skippedPages;
+        replyBuffer[17] = skippedPages >> 8;
+#endif
         usbMsgPtr = (usbMsgPtr_t)replyBuffer;
-        return 7;
+        return sizeof(replyBuffer);
     }
     return 0;
 }
 
+#if HAVE_READ_ADDRESS
+uchar usbFunctionRead(uchar *data, uchar len)
+{
+uchar   i;
+
+#if BOOTLOADER_CAN_READ
+    if(offset == 0){
+        boot_spm_busy_wait();
+        cli();
+        boot_rww_enable();      /* flash may have been written since */
+        sei();
+    }
+#endif
+    for(i = 0; i < len; i++, offset++){
+        if(offset == 0){
+            data[i] = reportId;
+        }else if(offset < 4){   /* address of this block */
+            data[i] = readAddress >> (8 * (offset - 1));
+        }else{
+#if BOOTLOADER_CAN_EEPROM
+            if(reportId == 4){
+                data[i] = eeprom_read_byte((uint8_t *)(uint)readAddress);
+            }else
+#endif
+            data[i] = readFlashByte(readAddress);
+            readAddress++;
+        }
+    }
+    return len;
+}
+#endif
+
+/* Flash programming runs in the background: the page is erased while its
+ * data is collected in pageBuffer, and written when it is complete. We wait
+ * for the SPM unit only when we need it (erasing the next page or filling
+ * the page buffer), so USB reception continues while the RWW section is
+ * busy. The write of the last page completes while the host prepares the
+ * next report. On an ATmega32U4 with hostsim's default timing, an upload
+ * takes 9.3 ms per page this way and 18.2 ms with a busy wait after each
+ * erase and write.
+ */
+static uchar    pageBuffer[SPM_PAGESIZE];
+static uchar    erasePending;   /* page being received is not erased yet */
+#if BOOTLOADER_CAN_SKIP
+static uchar    pageDiffers;    /* page data differs from the flash */
+static uint     pageCompared;   /* bytes found equal so far */
+#endif
+
+static void erasePage(addr_t addr)
+{
+    DBG1(0x33, 0, 0);
+#ifndef TEST_MODE
+    boot_spm_busy_wait();
+#if BOOTLOADER_CAN_EEPROM
+    eeprom_busy_wait();         /* SPM is not possible during EEPROM writes */
+#endif
+    cli();
+    boot_page_erase(addr);
+    sei();
+#endif
+    erasePending = 0;
+#if BOOTLOADER_CAN_STATUS
+    if(statusState)
+        statusState = 2;        /* the write before has completed */
+#endif
+}
+
+#if BOOTLOADER_CAN_STATUS
+/* The report is posted from the main loop when the page is programmed. If
+ * the host has not fetched the previous one by then, it is replaced: a report
+ * confirms all pages before it.
+ */
+static void postStatus(addr_t addr, uchar result)
+{
+    statusReport[1] = addr;
+    statusReport[2] = addr >> 8;
+#if (FLASHEND) > 0xffff
+    statusReport[3] = addr >> 16;
+#endif
+    statusReport[4] = result;
+    statusState = 1;
+}
+
+static void sendStatus(void)
+{
+    if(statusState && !boot_spm_busy())
+        statusState = 2;
+    if(statusState == 2 && usbInterruptIsReady()){
+        usbSetInterrupt(statusReport, sizeof(statusReport));
+        statusState = 0;
+    }
+}
+#endif
+
+#if BOOTLOADER_CAN_SKIP
+/* Compares the page buffer up to 'end' with the flash page at 'addr' and
+ * requests the erase at the first difference. The RWW section must not be
+ * busy.
+ */
+static void comparePage(addr_t addr, uint end)
+{
+    if(boot_rww_busy()){
+        cli();
+        boot_rww_enable();      /* previous page has been written */
+        sei();
+    }
+    while(pageCompared < end){
+        if(readFlashByte(addr + pageCompared) != pageBuffer[pageCompared]){
+            pageDiffers = 1;
+            erasePending = 1;
+            return;
+        }
+        pageCompared++;
+    }
+}
+#endif
+
+static void writePage(addr_t addr)
+{
+#if SPM_PAGESIZE > 128
+uint    i;
+#else
+uchar   i;
+#endif
+
+#if BOOTLOADER_CAN_SKIP
+    if(!pageDiffers){
+        boot_spm_busy_wait();
+        comparePage(addr, SPM_PAGESIZE);
+        if(!pageDiffers){
+            skippedPages++;
+#if BOOTLOADER_CAN_STATUS
+            postStatus(addr, STATUS_KEPT);
+#endif
+            return;
+        }
+    }
+#endif
+    if(erasePending)
+        erasePage(addr);
+    DBG1(0x34, 0, 0);
+    boot_spm_busy_wait();       /* until page is erased */
+    i = 0;
+    do{
+        cli();
+        boot_page_fill(addr + i, *(short *)(pageBuffer + i));
+        sei();
+        i += 2;
+    }while(i != SPM_PAGESIZE);
+#ifndef TEST_MODE
+    cli();
+    boot_page_write(addr);      /* don't wait for completion */
+    sei();
+#endif
+#if BOOTLOADER_CAN_STATUS
+    postStatus(addr, STATUS_WRITTEN);
+#endif
+}
+
+#if BOOTLOADER_CAN_PATCH
+/* Report 7 changes up to 32 bytes within a page: ID, address (3 bytes),
+ * length, data. The page is copied from the flash into pageBuffer when the
+ * report starts, the new bytes replace the old ones as they arrive, and the
+ * page is written when the report is complete. Bytes beyond the end of the
+ * page are ignored. The host must not send it while a page of report 2 is
+ * incomplete.
+ */
+static addr_t   patchPage;
+static uint     patchOffset;    /* in the page, of the next byte */
+static uchar    patchLength;    /* bytes still to be replaced */
+
+static uchar    patchWrite(uchar *data, uchar len)
+{
+#if SPM_PAGESIZE > 128
+uint    i;
+#else
+uchar   i;
+#endif
+
+    if(offset == 0){
+        patchPage = data[1] | (addr_t)data[2] << 8;
+#if (FLASHEND) > 0xffff
+        patchPage |= (addr_t)data[3] << 16;
+#endif
+        patchOffset = patchPage & (SPM_PAGESIZE - 1);
+        patchPage -= patchOffset;
+        patchLength = data[4];
+        boot_spm_busy_wait();   /* previous page write */
+        cli();
+        boot_rww_enable();
+        sei();
+        i = 0;
+        do{
+            pageBuffer[i] = readFlashByte(patchPage + i);
+        }while(++i != SPM_PAGESIZE);
+        offset = len;
+        data += 5;
+        len = len > 5 ? len - 5 : 0;
+    }else{
+        offset += len;
+    }
+    while(len-- && patchLength && patchOffset < SPM_PAGESIZE){
+        pageBuffer[patchOffset++] = *data++;
+        patchLength--;
+    }
+    if(offset < dataLength + 4)
+        return 0;
+    erasePending = 1;
+#if BOOTLOADER_CAN_SKIP
+    pageDiffers = 1;            /* the host only patches pages which differ */
+#endif
+    writePage(patchPage);
+    return 1;
+}
+#endif
+
 uchar usbFunctionWrite(uchar *data, uchar len)
 {
 union {
@@ -140,6 +517,47 @@ union {
 }       address;
 uchar   isLast;
 
+#if BOOTLOADER_CAN_PATCH
+    if(reportId == 7)
+        return patchWrite(data, len);
+#endif
+#if HAVE_READ_ADDRESS
+    if(reportId == 3){          /* set address for reading */
+        if(offset == 0){
+            address.l = 0;
+            address.c[0] = data[1];
+            address.c[1] = data[2];
+#if (FLASHEND) > 0xffff
+            address.c[2] = data[3];
+#endif
+            readAddress = address.l;
+        }
+        offset += len;
+        return offset >= 132;
+    }
+#endif
+#if BOOTLOADER_CAN_EEPROM
+    if(reportId == 4){
+        if(offset == 0){
+            eepromAddress = data[1] | (data[2] << 8);
+            data += 4;
+            len -= 4;
+        }
+        offset += len;
+        while(len--){
+            /* eeprom_update_byte() waits for the previous write, starts the
+             * next one (if the byte differs) and returns, so the write
+             * overlaps with the reception of the following bytes.
+             */
+            boot_spm_busy_wait();   /* EEPROM is locked while SPM is busy */
+            if(eepromAddress <= E2END)
+                eeprom_update_byte((uint8_t *)eepromAddress, *data);
+            eepromAddress++;
+            data++;
+        }
+        return offset & 0x80;
+    }
+#endif
     address.l = currentAddress;
     if(offset == 0){
         DBG1(0x30, data, 3);
@@ -154,44 +572,47 @@ uchar   isLast;
     }
     DBG1(0x31, (void *)&currentAddress, 4);
     offset += len;
-    isLast = offset & 0x80; /* != 0 if last block received */
+    isLast = offset >= dataLength;  /* != 0 if last block received */
     do{
-        addr_t prevAddr;
 #if SPM_PAGESIZE > 256
         uint pageAddr;
 #else
         uchar pageAddr;
 #endif
-        DBG1(0x32, 0, 0);
+        DBG2(0x32, 0, 0);   /* per word, too frequent for the trace */
         pageAddr = address.s[0] & (SPM_PAGESIZE - 1);
-        if(pageAddr == 0){              /* if page start: erase */
-            DBG1(0x33, 0, 0);
-#ifndef TEST_MODE
-            cli();
-            boot_page_erase(address.l); /* erase page */
-            sei();
-            boot_spm_busy_wait();       /* wait until page is erased */
-#endif
+#if BOOTLOADER_CAN_SKIP
+        if(pageAddr == 0){              /* if page start: compare first */
+            pageDiffers = 0;
+            pageCompared = 0;
         }
-        cli();
-        boot_page_fill(address.l, *(short *)data);
-        sei();
-        prevAddr = address.l;
+        *(short *)(pageBuffer + pageAddr) = *(short *)data;
+        if(!pageDiffers && !boot_spm_busy())
+            comparePage(address.l - pageAddr, pageAddr + 2);
+        if(erasePending && !boot_spm_busy())
+            erasePage(address.l);       /* previous page has been written */
+#else
+        if(pageAddr == 0)               /* if page start: erase when possible */
+            erasePending = 1;
+        if(erasePending && !boot_spm_busy())
+            erasePage(address.l);       /* previous page has been written */
+        *(short *)(pageBuffer + pageAddr) = *(short *)data;
+#endif
         address.l += 2;
         data += 2;
         /* write page when we cross page boundary */
-        pageAddr = address.s[0] & (SPM_PAGESIZE - 1);
-        if(pageAddr == 0){
-            DBG1(0x34, 0, 0);
-#ifndef TEST_MODE
-            cli();
-            boot_page_write(prevAddr);
-            sei();
-            boot_spm_busy_wait();
-#endif
-        }
+        if((address.s[0] & (SPM_PAGESIZE - 1)) == 0)
+            writePage(address.l - SPM_PAGESIZE);
         len -= 2;
     }while(len);
+    if(isLast && dataLength < 128 && (address.s[0] & (SPM_PAGESIZE - 1))){
+        /* a short report ends the upload: complete and write the page */
+        do{
+            pageBuffer[address.s[0] & (SPM_PAGESIZE - 1)] = 0xff;
+            address.l++;
+        }while(address.s[0] & (SPM_PAGESIZE - 1));
+        writePage(address.l - SPM_PAGESIZE);
+    }
     currentAddress = address.l;
     DBG1(0x35, (void *)&currentAddress, 4);
     return isLast;
@@ -220,6 +641,7 @@ int __attribute__((noreturn)) main(void)
     /* initialize hardware */
     bootLoaderInit();
     odDebugInit();
+    traceInit();
     DBG1(0x00, 0, 0);
     /* jump to application if jumper is set */
     if(bootLoaderCondition()){
@@ -232,6 +654,10 @@ int __attribute__((noreturn)) main(void)
         do{ /* main event loop */
             wdt_reset();
             usbPoll();
+#if BOOTLOADER_CAN_STATUS
+            sendStatus();
+#endif
+            traceIdle();
 #if BOOTLOADER_CAN_EXIT
             if(exitMainloop){
 #if F_CPU == 12800000
@@ -0,0 +1,210 @@
+/* Name: trace.h
+ * Project: AVR bootloader HID
+ * Author: bootloadHID contributors
+ * Creation Date: 2026-10-19
+ * Tabsize: 4
+ * License: GNU GPL v2 (see License.txt)
+ * This Revision: $Id$
+ */
+
+#ifndef __trace_h_included__
+#define __trace_h_included__
+
+/*
+General Description:
+This header implements a trace backend for the DBG1() trace points of
+main.c which does not disturb USB timing ("make TRACE=1", see
+BOOTLOADER_TRACE in bootloaderconfig.h). DEBUG_LEVEL 1 prints each trace
+point on the UART before it continues, which takes longer than the host
+waits for the device. With BOOTLOADER_TRACE, DBG1() only stores an event in
+a ring buffer in RAM:
+
+    id          1 byte      the trace point, e.g. 0x33 for a page erase
+    time        2 bytes     TCNT1, running at F_CPU / 64
+    value       2 bytes     bytes 0-1 of a 4 byte address, 1-2 of a report
+                            header, else 0
+
+traceIdle() is called from the main loop and sends at most one character
+per call, if the UART is ready. Each event becomes a line of hex digits:
+
+    33 1a2b 0000
+
+The times wrap around every 65536 ticks (0.35 s at 12 MHz). If the buffer
+is full, events are dropped and counted; the count is recorded as event
+0xff before the next event which fits. The UART runs at TRACE_BAUD with
+8N1. The UART and timer 1 are reset before the application is started.
+
+Include this file after usbdrv.c, so that the trace points of the driver
+keep their meaning.
+*/
+
+#if BOOTLOADER_TRACE
+
+#if DEBUG_LEVEL > 0
+#   error "BOOTLOADER_TRACE replaces DBG1(), compile with DEBUG_LEVEL=0"
+#endif
+
+#ifndef TRACE_BAUD
+#define TRACE_BAUD      500000  /* exact at 12, 16 and 20 MHz */
+#endif
+#ifndef TRACE_EVENTS
+#define TRACE_EVENTS    32      /* must be a power of 2 */
+#endif
+#define TRACE_LOST      0xff    /* event id, the value is the number dropped */
+
+#if defined UDR0
+#   define TRACE_UDR    UDR0
+#   define TRACE_UCSRA  UCSR0A
+#   define TRACE_UCSRB  UCSR0B
+#   define TRACE_UBRR   UBRR0
+#   define TRACE_UDRE   UDRE0
+#   define TRACE_U2X    U2X0
+#   define TRACE_TXC    TXC0
+#   define TRACE_TXEN   TXEN0
+#elif defined UDR1   /* ATMega32U4 and other USB devices */
+#   define TRACE_UDR    UDR1
+#   define TRACE_UCSRA  UCSR1A
+#   define TRACE_UCSRB  UCSR1B
+#   define TRACE_UBRR   UBRR1
+#   define TRACE_UDRE   UDRE1
+#   define TRACE_U2X    U2X1
+#   define TRACE_TXC    TXC1
+#   define TRACE_TXEN   TXEN1
+#elif defined UDR
+#   define TRACE_UDR    UDR
+#   define TRACE_UCSRA  UCSRA
+#   define TRACE_UCSRB  UCSRB
+#   define TRACE_UBRR   UBRRL
+#   define TRACE_UDRE   UDRE
+#   define TRACE_U2X    U2X
+#   define TRACE_TXC    TXC
+#   define TRACE_TXEN   TXEN
+#else
+#   error "BOOTLOADER_TRACE needs a UART"
+#endif
+
+/* double speed mode: 8 clocks per bit */
+#define TRACE_UBRR_VALUE    ((F_CPU + 4L * TRACE_BAUD) / (8L * TRACE_BAUD) - 1)
+#define TRACE_BAUD_REAL     (F_CPU / (8L * (TRACE_UBRR_VALUE + 1)))
+#if TRACE_BAUD_REAL * 100 > TRACE_BAUD * 102L || TRACE_BAUD_REAL * 100 < TRACE_BAUD * 98L
+#   error "TRACE_BAUD can't be generated from F_CPU within 2%, choose another one"
+#endif
+
+typedef struct traceEvent{
+    uchar       id;
+    unsigned    time;
+    unsigned    value;
+}traceEvent_t;
+
+static traceEvent_t traceBuffer[TRACE_EVENTS];
+static uchar        traceHead, traceTail;   /* next to write, next to send */
+static uchar        traceLost;              /* dropped since the last event */
+static uchar        tracePos;               /* characters of traceLine sent */
+static char         traceLine[14] = "xx xxxx xxxx\r\n";
+
+/* ------------------------------------------------------------------------- */
+
+static inline void  traceInit(void)
+{
+    TCCR1B = 3;             /* timer 1 at F_CPU / 64 */
+    TRACE_UBRR = TRACE_UBRR_VALUE;
+    TRACE_UCSRA = 1 << TRACE_U2X;
+    TRACE_UCSRB = 1 << TRACE_TXEN;
+}
+
+static void traceRecord(uchar id, unsigned value)
+{
+uchar   free = (traceTail - traceHead - 1) & (TRACE_EVENTS - 1);
+uchar   needed = traceLost ? 2 : 1;
+
+    if(free < needed){
+        if(traceLost != 0xff)
+            traceLost++;
+        return;
+    }
+    if(traceLost){
+        traceBuffer[traceHead].id = TRACE_LOST;
+        traceBuffer[traceHead].time = TCNT1;
+        traceBuffer[traceHead].value = traceLost;
+        traceHead = (traceHead + 1) & (TRACE_EVENTS - 1);
+        traceLost = 0;
+    }
+    traceBuffer[traceHead].id = id;
+    traceBuffer[traceHead].time = TCNT1;
+    traceBuffer[traceHead].value = value;
+    traceHead = (traceHead + 1) & (TRACE_EVENTS - 1);
+}
+
+static inline unsigned  traceValue(void *data, uchar len)
+{
+uchar   *p = data;
+
+    if(len == 3)
+        return p[1] | p[2] << 8;    /* report ID and address */
+    if(len >= 2)
+        return p[0] | p[1] << 8;
+    return 0;
+}
+
+static void traceHex(char *s, unsigned value, uchar digits)
+{
+uchar   c;
+
+    s += digits;
+    do{
+        c = value & 0xf;
+        *--s = c < 10 ? '0' + c : 'a' - 10 + c;
+        value >>= 4;
+    }while(--digits);
+}
+
+static void traceIdle(void)
+{
+traceEvent_t    *e;
+
+    if(!(TRACE_UCSRA & (1 << TRACE_UDRE)))
+        return;     /* the previous character is still waiting */
+    if(tracePos == 0){
+        if(traceTail == traceHead)
+            return;
+        e = &traceBuffer[traceTail];
+        traceHex(traceLine, e->id, 2);
+        traceHex(traceLine + 3, e->time, 4);
+        traceHex(traceLine + 8, e->value, 4);
+        traceTail = (traceTail + 1) & (TRACE_EVENTS - 1);
+    }
+    TRACE_UCSRA = 1 << TRACE_U2X | 1 << TRACE_TXC;  /* clear TXC */
+    TRACE_UDR = traceLine[tracePos];
+    if(++tracePos == sizeof(traceLine))
+        tracePos = 0;
+}
+
+static void traceExit(void)
+{
+    while(traceTail != traceHead || tracePos != 0){
+        wdt_reset();
+        traceIdle();
+    }
+    while(!(TRACE_UCSRA & (1 << TRACE_TXC)))   /* main() sent event 0x00 at least */
+        wdt_reset();
+    TRACE_UCSRB = 0;
+    TRACE_UCSRA = 0;
+    TRACE_UBRR = 0;
+    TCCR1B = 0;
+    TCNT1 = 0;
+}
+
+#undef  DBG1
+#define DBG1(prefix, data, len) traceRecord(prefix, traceValue((void *)(data), len))
+
+#else   /* BOOTLOADER_TRACE */
+
+#define traceInit()
+#define traceIdle()
+#define traceExit()
+
+#endif  /* BOOTLOADER_TRACE */
+
+/* ------------------------------------------------------------------------- */
+
+#endif /* __trace_h_included__ */
@@ -42,7 +42,7 @@ the newest features and options.
  * default control endpoint 0, an interrupt-in endpoint 1 and an interrupt-in
  * endpoint 3. You must also enable endpoint 1 above.
  */
-#define USB_CFG_SUPPRESS_INTR_CODE      1
+#define USB_CFG_SUPPRESS_INTR_CODE      (!BOOTLOADER_CAN_STATUS)
 /* Define this to 1 if you want to declare interrupt-in endpoints, but don't
  * want to send any data over them. If this macro is defined to 1, functions
  * usbSetInterrupt() and usbSetInterrupt3() are omitted. This is useful if
@@ -56,7 +56,7 @@ the newest features and options.
  * it is required by the standard. We have made it a config option because it
  * bloats the code considerably.
  */
-#define USB_CFG_INTR_POLL_INTERVAL      200
+#define USB_CFG_INTR_POLL_INTERVAL      (BOOTLOADER_CAN_STATUS ? 10 : 200)
 /* If you compile a version with endpoint 1 (interrupt-in), this is the poll
  * interval. The value is in milliseconds and must not be less than 10 ms for
  * low speed devices.
@@ -75,11 +75,12 @@ the newest features and options.
  * transfers. Set it to 0 if you don't need it and want to save a couple of
  * bytes.
  */
-#define USB_CFG_IMPLEMENT_FN_READ       0
+#define USB_CFG_IMPLEMENT_FN_READ       (BOOTLOADER_CAN_READ || BOOTLOADER_CAN_EEPROM)
 /* Set this to 1 if you need to send control replies which are generated
  * "on the fly" when usbFunctionRead() is called. If you only want to send
  * data from a static buffer, set it to 0 and return the data from
- * usbFunctionSetup(). This saves a couple of bytes.
+ * usbFunctionSetup(). This saves a couple of bytes. We need it for reading
+ * back flash and EEPROM only.
  */
 #define USB_CFG_IMPLEMENT_FN_WRITEOUT   0
 /* Define this to 1 if you want to use interrupt-out (or bulk out) endpoint 1.
@@ -194,7 +195,7 @@ tuningOverflow:
 /* See USB specification if you want to conform to an existing device class or
  * protocol.
  */
-#define USB_CFG_HID_REPORT_DESCRIPTOR_LENGTH    33  /* total length of report descriptor */
+#define USB_CFG_HID_REPORT_DESCRIPTOR_LENGTH    (33 + 9 * (BOOTLOADER_CAN_READ || BOOTLOADER_CAN_EEPROM) + 9 * BOOTLOADER_CAN_EEPROM + 9 * BOOTLOADER_CAN_FINGERPRINT + 8 * BOOTLOADER_CAN_STATUS + 9 * BOOTLOADER_CAN_PATCH)
 /* Define this to the length of the HID report descriptor, if you implement
  * an HID device. Otherwise don't define it or define it to 0.
  */
@@ -0,0 +1,298 @@
+/* Name: batch.c
+ * Project: AVR bootloader HID
+ * Author: bootloadHID contributors
+ * Creation Date: 2026-10-19
+ * Tabsize: 4
+ * License: Proprietary, free under certain conditions. See Documentation.
+ * This Revision: $Id$
+ */
+
+/*
+General Description:
+This module implements batch mode ("-b <manifest>"). The manifest is a text
+file with one job per line. Empty lines and lines starting with '#' are
+ignored. A job consists of whitespace separated items:
+
+    device=<location>       Device to flash, see usbOpenDeviceAt(). "any" or
+                            omitting the item selects the first HIDBoot device.
+    image=<file>[,<file>]   Intel-Hex or ELF file(s) to upload. May be repeated. If
+                            files overlap, non-blank bytes of later files win.
+    patch=<addr>:<hex>      Bytes (as hex digits) written over the image at
+                            address <addr>. May be repeated.
+    -r                      Leave the boot loader after this job.
+
+Example:
+    device=001:012 image=app.hex patch=0x7ff0:0102 -r
+    device=001:013 image=app.hex patch=0x7ff0:0103 -r
+
+All jobs run in one process: Intel-Hex files are parsed only once, even if
+used by several jobs, and the image of the next job is prepared in a second
+thread while the current one is uploaded.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#ifndef WIN32
+#include <pthread.h>
+#endif
+#include "usbcalls.h"
+#include "bootloadHID.h"
+
+#define MAX_JOB_FILES   8
+
+/* ------------------------------------------------------------------------- */
+
+typedef struct patch{
+    struct patch    *next;
+    int             address;
+    int             len;
+    char            data[1];    /* 'len' bytes are allocated */
+}patch_t;
+
+typedef struct image{
+    struct image    *next;
+    char            *fileName;
+    char            *data;
+    int             startAddr, endAddr;
+}image_t;
+
+typedef struct job{
+    int     lineNumber;
+    char    *location;          /* NULL for any device */
+    char    *files[MAX_JOB_FILES];
+    int     numFiles;
+    patch_t *patches;
+    int     leaveBootLoader;
+    char    *data;              /* prepared image, built by prepareJob() */
+    int     startAddr, endAddr;
+    int     prepareError;
+}job_t;
+
+static image_t  *imageCache;
+
+/* ------------------------------------------------------------------------- */
+
+static int  parsePatch(job_t *job, char *arg)
+{
+patch_t *patch, **tail;
+char    *hex;
+int     address, len, i, value;
+
+    address = strtol(arg, &hex, 0);
+    if(*hex++ != ':')
+        return -1;
+    len = strlen(hex);
+    if(len == 0 || (len & 1) != 0)
+        return -1;
+    len /= 2;
+    if(address < 0 || address + len > IMAGE_BUFFER_SIZE - 256)
+        return -1;
+    patch = malloc(sizeof(patch_t) + len);
+    patch->address = address;
+    patch->len = len;
+    for(i = 0; i < len; i++){
+        if(sscanf(hex + 2 * i, "%2x", &value) != 1){
+            free(patch);
+            return -1;
+        }
+        patch->data[i] = value;
+    }
+    patch->next = NULL;
+    for(tail = &job->patches; *tail != NULL; tail = &(*tail)->next)
+        ;
+    *tail = patch;  /* keep manifest order, later patches win */
+    return 0;
+}
+
+static int  parseJob(job_t *job, char *line)
+{
+char    *item, *file;
+int     i;
+
+    for(item = strtok(line, " \t\r\n"); item != NULL; item = strtok(NULL, " \t\r\n")){
+        if(strncmp(item, "device=", 7) == 0){
+            if(strcmp(item + 7, "any") != 0)
+                job->location = strdup(item + 7);
+        }else if(strncmp(item, "image=", 6) == 0){
+            for(file = item + 6; file != NULL && *file != 0; file = strchr(file, ',')){
+                if(*file == ',')
+                    *file++ = 0;
+                if(job->numFiles >= MAX_JOB_FILES){
+                    fprintf(stderr, "Too many image files (max %d)\n", MAX_JOB_FILES);
+                    return -1;
+                }
+                job->files[job->numFiles++] = file;
+            }
+        }else if(strncmp(item, "patch=", 6) == 0){
+            if(parsePatch(job, item + 6) != 0){
+                fprintf(stderr, "Invalid patch \"%s\"\n", item + 6);
+                return -1;
+            }
+        }else if(strcmp(item, "-r") == 0){
+            job->leaveBootLoader = 1;
+        }else{
+            fprintf(stderr, "Unknown item \"%s\"\n", item);
+            return -1;
+        }
+    }
+    /* file names point into 'line', make private copies */
+    for(i = 0; i < job->numFiles; i++)
+        job->files[i] = strdup(job->files[i]);
+    return 0;
+}
+
+static job_t    *parseManifest(char *manifestFile, int *numJobs)
+{
+FILE    *input;
+char    line[4096], *p;
+job_t   *jobs = NULL;
+int     lineNumber = 0, err = 0;
+
+    *numJobs = 0;
+    input = fopen(manifestFile, "r");
+    if(input == NULL){
+        fprintf(stderr, "error opening %s: %s\n", manifestFile, strerror(errno));
+        return NULL;
+    }
+    while(fgets(line, sizeof(line), input) != NULL){
+        lineNumber++;
+        for(p = line; *p == ' ' || *p == '\t'; p++)
+            ;
+        if(*p == '#' || *p == '\r' || *p == '\n' || *p == 0)
+            continue;
+        jobs = realloc(jobs, (*numJobs + 1) * sizeof(job_t));
+        memset(&jobs[*numJobs], 0, sizeof(job_t));
+        jobs[*numJobs].lineNumber = lineNumber;
+        if(parseJob(&jobs[*numJobs], p) != 0){
+            fprintf(stderr, "%s:%d: invalid job\n", manifestFile, lineNumber);
+            err = 1;
+        }
+        (*numJobs)++;
+    }
+    fclose(input);
+    if(!err && *numJobs == 0){
+        fprintf(stderr, "No jobs in %s\n", manifestFile);
+        err = 1;
+    }
+    if(err){
+        free(jobs);     /* we exit anyway, don't care about the job contents */
+        return NULL;
+    }
+    return jobs;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static image_t  *getImage(char *fileName)
+{
+image_t *image;
+
+    for(image = imageCache; image != NULL; image = image->next){
+        if(strcmp(image->fileName, fileName) == 0)
+            return image;
+    }
+    image = malloc(sizeof(image_t));
+    image->fileName = fileName;
+    image->data = malloc(IMAGE_BUFFER_SIZE);
+    memset(image->data, -1, IMAGE_BUFFER_SIZE);
+    image->startAddr = IMAGE_BUFFER_SIZE;
+    image->endAddr = 0;
+    if(parseImageFile(fileName, image->data, &image->startAddr, &image->endAddr)){
+        free(image->data);
+        free(image);
+        return NULL;
+    }
+    image->next = imageCache;
+    imageCache = image;
+    return image;
+}
+
+static void prepareJob(job_t *job)
+{
+image_t *image;
+patch_t *patch;
+int     i, address;
+
+    job->data = malloc(IMAGE_BUFFER_SIZE);
+    memset(job->data, -1, IMAGE_BUFFER_SIZE);
+    job->startAddr = IMAGE_BUFFER_SIZE;
+    job->endAddr = 0;
+    for(i = 0; i < job->numFiles; i++){
+        if((image = getImage(job->files[i])) == NULL){
+            job->prepareError = 1;
+            return;
+        }
+        for(address = image->startAddr; address < image->endAddr; address++){
+            if(image->data[address] != (char)0xff)
+                job->data[address] = image->data[address];
+        }
+        if(job->startAddr > image->startAddr)
+            job->startAddr = image->startAddr;
+        if(job->endAddr < image->endAddr)
+            job->endAddr = image->endAddr;
+    }
+    for(patch = job->patches; patch != NULL; patch = patch->next){
+        memcpy(job->data + patch->address, patch->data, patch->len);
+        if(job->startAddr > patch->address)
+            job->startAddr = patch->address;
+        if(job->endAddr < patch->address + patch->len)
+            job->endAddr = patch->address + patch->len;
+    }
+}
+
+#ifndef WIN32
+static void *prepareThread(void *arg)
+{
+    prepareJob(arg);
+    return NULL;
+}
+#endif
+
+/* ------------------------------------------------------------------------- */
+
+int runBatch(char *manifestFile)
+{
+job_t   *jobs, *job, *next;
+int     numJobs, i, failed = 0, prepareStarted;
+#ifndef WIN32
+pthread_t   thread;
+#endif
+
+    if((jobs = parseManifest(manifestFile, &numJobs)) == NULL)
+        return 1;
+    prepareJob(&jobs[0]);
+    for(i = 0; i < numJobs; i++){
+        job = &jobs[i];
+        next = i + 1 < numJobs ? &jobs[i + 1] : NULL;
+        prepareStarted = 0;
+#ifndef WIN32
+        /* prepare the next image while this one is uploaded */
+        if(next != NULL && pthread_create(&thread, NULL, prepareThread, next) == 0)
+            prepareStarted = 1;
+#endif
+        printf("Job %d (line %d, device %s):\n", i + 1, job->lineNumber, job->location != NULL ? job->location : "any");
+        fflush(stdout);
+        if(job->prepareError){
+            fprintf(stderr, "Job %d: could not read image files\n", i + 1);
+            failed++;
+        }else if(job->startAddr >= job->endAddr && !job->leaveBootLoader){
+            printf("No data for job %d, skipping.\n", i + 1);
+        }else if(uploadData(job->data, job->startAddr, job->endAddr, job->location, job->leaveBootLoader, NULL) != 0){
+            fprintf(stderr, "Job %d failed\n", i + 1);
+            failed++;
+        }
+        free(job->data);
+#ifndef WIN32
+        if(prepareStarted)
+            pthread_join(thread, NULL);
+#endif
+        if(next != NULL && !prepareStarted)
+            prepareJob(next);
+    }
+    printf("%d of %d jobs succeeded\n", numJobs - failed, numJobs);
+    return failed != 0;
+}
+
+/* ------------------------------------------------------------------------- */
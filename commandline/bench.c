@@ -0,0 +1,274 @@
+/* Name: bench.c
+ * Project: AVR bootloader HID
+ * Author: bootloadHID contributors
+ * Creation Date: 2026-10-19
+ * Tabsize: 4
+ * License: Proprietary, free under certain conditions. See Documentation.
+ * This Revision: $Id$
+ */
+
+/*
+General Description:
+This module implements "--bench", which measures what the combination of
+board, hubs and host controller actually achieves. The device info report
+(report 1) is read repeatedly to measure the pure round trip time. With
+"--bench-write <start>:<end>", data reports are sent to this flash range as
+well, one sweep over the range, so each page is erased and written once
+regardless of "--count". This erases the range (it is filled with 0xff), so
+it must be confirmed interactively or with "--yes".
+
+The results can be stored with "--calibration <file>". When the same option
+is given for an upload or "--plan", the file is read: the measured latencies
+determine the USB transfer timeout and the throughput model used for
+estimates. The file contains "<key> <value>" lines:
+
+    firmware <name>     the "--firmware" model the values belong to
+    reportOverhead <s>  time per report, independent of its size
+    byteTime <s>        time per report byte
+    pageTime <s>        time to erase and write one page
+    timeout <ms>        timeout for USB transfers
+
+Note that the boot loaders process one control transfer at a time, so there
+is no queue depth to tune.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include "usbcalls.h"
+#include "bootloadHID.h"
+
+#define MIN_TIMEOUT     500     /* ms, never use a shorter timeout */
+#define MAX_TIMEOUT     5000    /* ms, the default of usbcalls */
+
+/* ------------------------------------------------------------------------- */
+
+static int  compareDoubles(const void *a, const void *b)
+{
+double  x = *(const double *)a, y = *(const double *)b;
+
+    return x < y ? -1 : x > y;
+}
+
+static double   percentile(double *sorted, int count, int percent)
+{
+int     index = (count * percent + 99) / 100 - 1;
+
+    if(index < 0)
+        index = 0;
+    return sorted[index];
+}
+
+static double   printLatencies(char *name, double *latencies, int count, int bytesPerReport)
+/* prints the statistics and returns the mean latency */
+{
+double  total = 0;
+int     i;
+
+    for(i = 0; i < count; i++)
+        total += latencies[i];
+    qsort(latencies, count, sizeof(double), compareDoubles);
+    printf("%s: %d reports, latency min %.3f p50 %.3f p90 %.3f p99 %.3f max %.3f ms, %.0f bytes/s\n",
+        name, count, latencies[0] * 1e3, percentile(latencies, count, 50) * 1e3, percentile(latencies, count, 90) * 1e3,
+        percentile(latencies, count, 99) * 1e3, latencies[count - 1] * 1e3, count * bytesPerReport / total);
+    return total / count;
+}
+
+static int  getConsent(int start, int end, int pages)
+{
+char    answer[16];
+
+    printf("This erases flash from 0x%05x to 0x%05x (%d page erase%s). Type \"yes\" to continue: ",
+        start, end, pages, pages == 1 ? "" : "s");
+    fflush(stdout);
+    if(fgets(answer, sizeof(answer), stdin) == NULL)
+        return 0;
+    return strcmp(answer, "yes\n") == 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+int loadCalibration(char *file, calibration_t *cal, char *firmware)
+{
+FILE    *input;
+char    line[256], key[64], name[sizeof(cal->firmware)];
+double  value;
+
+    memset(cal, 0, sizeof(*cal));
+    if((input = fopen(file, "r")) == NULL){
+        fprintf(stderr, "error opening %s: %s\n", file, strerror(errno));
+        return 1;
+    }
+    while(fgets(line, sizeof(line), input) != NULL){
+        if(sscanf(line, "firmware %31s", name) == 1){
+            strcpy(cal->firmware, name);
+            continue;
+        }
+        if(sscanf(line, "%63s %lf", key, &value) != 2 || key[0] == '#')
+            continue;
+        if(strcmp(key, "reportOverhead") == 0){
+            cal->reportOverhead = value;
+        }else if(strcmp(key, "byteTime") == 0){
+            cal->byteTime = value;
+        }else if(strcmp(key, "pageTime") == 0){
+            cal->pageTime = value;
+        }else if(strcmp(key, "timeout") == 0){
+            cal->timeout = value;
+        }
+    }
+    fclose(input);
+    if(cal->timeout <= 0){
+        fprintf(stderr, "%s: not a calibration file\n", file);
+        return 1;
+    }
+    if(strcmp(cal->firmware, firmware) != 0){
+        fprintf(stderr, "%s: calibrated for firmware \"%s\", not \"%s\"\n", file, cal->firmware[0] != 0 ? cal->firmware : "unknown", firmware);
+        return 1;
+    }
+    return 0;
+}
+
+static int  saveCalibration(char *file, calibration_t *cal)
+{
+FILE    *output;
+
+    if((output = fopen(file, "w")) == NULL){
+        fprintf(stderr, "error opening %s: %s\n", file, strerror(errno));
+        return 1;
+    }
+    fprintf(output, "# bootloadHID calibration, written by --bench\n");
+    fprintf(output, "firmware %s\n", cal->firmware);
+    fprintf(output, "reportOverhead %g\nbyteTime %g\npageTime %g\ntimeout %d\n",
+        cal->reportOverhead, cal->byteTime, cal->pageTime, cal->timeout);
+    fclose(output);
+    return 0;
+}
+
+void    applyCalibration(calibration_t *cal, throughputModel_t *model)
+{
+    model->reportOverhead = cal->reportOverhead;
+    model->byteTime = cal->byteTime;
+    model->pageTime = cal->pageTime;
+}
+
+/* ------------------------------------------------------------------------- */
+
+int runBench(int count, char *writeRange, int consent, char *firmware, char *calibrationFile)
+{
+usbDevice_t         *dev = NULL;
+int                 err = 0, len, i, pageSize, deviceSize, writeStart = 0, writeEnd = 0, writeCount = 0;
+double              *readTimes, *writeTimes = NULL, t, readMean, writeMean = 0, worst;
+char                *end;
+throughputModel_t   *model;
+calibration_t       cal;
+union{
+    char            bytes[1];
+    deviceInfo_t    info;
+    deviceData_t    data;
+}                   buffer;
+
+    if((model = findThroughputModel(firmware)) == NULL){
+        fprintf(stderr, "Unknown firmware \"%s\" (use vusb, boothid, vusb-speed or boothid-speed)\n", firmware);
+        return 1;
+    }
+    if(count < 1)
+        count = 1;
+    if(writeRange != NULL){
+        writeStart = strtol(writeRange, &end, 0);
+        if(*end != ':' || (writeEnd = strtol(end + 1, &end, 0)) <= writeStart || *end != 0){
+            fprintf(stderr, "Invalid range \"%s\", use <start>:<end>\n", writeRange);
+            return 1;
+        }
+    }
+    readTimes = malloc(count * sizeof(double));
+    if((err = usbOpenDevice(&dev, IDENT_VENDOR_NUM, IDENT_VENDOR_STRING, IDENT_PRODUCT_NUM, IDENT_PRODUCT_STRING, 1)) != 0){
+        fprintf(stderr, "Error opening HIDBoot device: %s\n", usbErrorMessage(err));
+        goto errorOccurred;
+    }
+    for(i = 0; i < count; i++){
+        len = sizeof(buffer);
+        t = getTime();
+        if((err = usbGetReport(dev, USB_HID_REPORT_TYPE_FEATURE, 1, buffer.bytes, &len)) != 0){
+            fprintf(stderr, "Error reading device info: %s\n", usbErrorMessage(err));
+            goto errorOccurred;
+        }
+        readTimes[i] = getTime() - t;
+    }
+    if(len < sizeof(buffer.info)){
+        fprintf(stderr, "Not enough bytes in device info report (%d instead of %d)\n", len, (int)sizeof(buffer.info));
+        err = -1;
+        goto errorOccurred;
+    }
+    pageSize = getUsbInt(buffer.info.pageSize, 2);
+    deviceSize = getUsbInt(buffer.info.flashSize, 4);
+    printf("Page size %d, device size %d\n", pageSize, deviceSize);
+    readMean = printLatencies("Device info (GET_REPORT 1)", readTimes, count, sizeof(buffer.info));
+    worst = readTimes[count - 1];
+    if(writeRange != NULL){
+        /* whole pages only, the boot loader erases a page when its first block arrives */
+        i = pageSize > sizeof(buffer.data.data) ? pageSize : sizeof(buffer.data.data);
+        if(writeStart % i != 0 || writeEnd % i != 0 || writeEnd > deviceSize - model->bootLoaderSize){
+            fprintf(stderr, "Write range must be aligned to %d bytes and below 0x%x\n", i, deviceSize - model->bootLoaderSize);
+            err = -1;
+            goto errorOccurred;
+        }
+        /* one sweep: repeating it would only wear the flash */
+        writeCount = (writeEnd - writeStart) / sizeof(buffer.data.data);
+        if(!consent && !getConsent(writeStart, writeEnd, (writeEnd - writeStart) / pageSize)){
+            printf("Write benchmark skipped.\n");
+            writeRange = NULL;
+        }
+    }
+    if(writeRange != NULL){
+        writeTimes = malloc(writeCount * sizeof(double));
+        memset(buffer.data.data, 0xff, sizeof(buffer.data.data));
+        buffer.data.reportId = 2;
+        for(i = 0; i < writeCount; i++){
+            setUsbInt(buffer.data.address, writeStart + i * (int)sizeof(buffer.data.data), 3);
+            t = getTime();
+            if((err = usbSetReport(dev, USB_HID_REPORT_TYPE_FEATURE, buffer.bytes, sizeof(buffer.data))) != 0){
+                fprintf(stderr, "Error uploading data block: %s\n", usbErrorMessage(err));
+                goto errorOccurred;
+            }
+            writeTimes[i] = getTime() - t;
+        }
+        writeMean = printLatencies("Data (SET_REPORT 2)", writeTimes, writeCount, sizeof(buffer.data.data));
+        if(worst < writeTimes[writeCount - 1])
+            worst = writeTimes[writeCount - 1];
+    }
+    /* Derive the throughput model: the round trip of the small info report is
+     * the per report overhead. The page time can't be separated from the
+     * transfer time of a data report, we keep the built-in value and attribute
+     * the rest to the transfer.
+     */
+    snprintf(cal.firmware, sizeof(cal.firmware), "%s", firmware);
+    cal.reportOverhead = readMean;
+    cal.pageTime = model->pageTime;
+    cal.byteTime = model->byteTime;
+    if(writeTimes != NULL){
+        t = writeMean - readMean - cal.pageTime * sizeof(buffer.data.data) / pageSize;
+        cal.byteTime = t > 0 ? t / sizeof(buffer.data) : 0;
+    }
+    cal.timeout = worst * 20e3;
+    if(cal.timeout < MIN_TIMEOUT)
+        cal.timeout = MIN_TIMEOUT;
+    if(cal.timeout > MAX_TIMEOUT)
+        cal.timeout = MAX_TIMEOUT;
+    printf("Calibration: %.3f ms/report, %.2f us/byte, %.3f ms/page, timeout %d ms\n",
+        cal.reportOverhead * 1e3, cal.byteTime * 1e6, cal.pageTime * 1e3, cal.timeout);
+    if(calibrationFile != NULL){
+        if(saveCalibration(calibrationFile, &cal))
+            err = -1;
+        else
+            printf("Calibration written to %s\n", calibrationFile);
+    }
+errorOccurred:
+    free(readTimes);
+    free(writeTimes);
+    if(dev != NULL)
+        usbCloseDevice(dev);
+    return err != 0;
+}
+
+/* ------------------------------------------------------------------------- */
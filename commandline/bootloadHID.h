@@ -0,0 +1,482 @@
+/* Name: bootloadHID.h
+ * Project: AVR bootloader HID
+ * Author: Christian Starkjohann
+ * Creation Date: 2007-03-19
+ * Tabsize: 4
+ * Copyright: (c) 2007 by OBJECTIVE DEVELOPMENT Software GmbH
+ * License: Proprietary, free under certain conditions. See Documentation.
+ * This Revision: $Id$
+ */
+
+#ifndef __bootloadHID_h_INCLUDED__
+#define __bootloadHID_h_INCLUDED__
+
+/*
+General Description:
+This header declares the functions of the command line tool which are shared
+between main.c and the additional operating modes (batch uploads etc.)
+implemented in separate modules.
+*/
+
+/* ------------------------------------------------------------------------ */
+
+#define IDENT_VENDOR_NUM        0x16c0
+#define IDENT_VENDOR_STRING     "obdev.at"
+#define IDENT_PRODUCT_NUM       1503
+#define IDENT_PRODUCT_STRING    "HIDBoot"
+/* USB IDs and names of the boot loader device */
+
+#ifndef BOOTLOAD_SIZE
+#define BOOTLOAD_SIZE           2048
+#endif
+/* Size of the boot loader section, the Makefile sets it for BootHID */
+
+#define IMAGE_BUFFER_SIZE   (65536 + 256)
+/* Size of the buffers holding flash images. Unused bytes must be 0xff. */
+
+#define STATS_ENUMERATE     0   /* finding the device */
+#define STATS_OPEN          1   /* opening and claiming the device */
+#define STATS_INFO          2   /* reading the device info report */
+#define STATS_BLOCK         3   /* sending a data report */
+#define STATS_COUNT         4
+
+#define HISTOGRAM_BUCKETS   240
+
+typedef struct histogram{
+    unsigned    count;
+    double      sum, max;       /* seconds */
+    unsigned    buckets[HISTOGRAM_BUCKETS];
+}histogram_t;
+
+typedef struct runStats{
+    histogram_t histograms[STATS_COUNT];    /* indexed by STATS_* */
+    int         reports;        /* data reports sent, including retries */
+    int         bytesSent;      /* data bytes sent, including retries */
+    int         bytesSkipped;   /* unchanged pages not sent */
+    int         pagesKept;      /* unchanged pages the device did not write */
+    int         retries;
+    double      uploadTime;     /* seconds spent sending data reports */
+    double      totalTime;
+    int         deviceCounters; /* devices which sent report 8 */
+    double      eraseTime, writeTime, busyTime, receiveTime, idleTime;  /* seconds, from report 8 */
+    int         pagesErased, pagesWritten, setupPackets;
+}runStats_t;
+/* This type holds the statistics for "--stats", see stats.c. */
+
+typedef struct deviceInfo{
+    char    reportId;
+    char    pageSize[2];
+    char    flashSize[4];
+}deviceInfo_t;
+/* Report 1 of the boot loader: device properties. Sending it with SET_REPORT
+ * makes the boot loader start the application.
+ */
+
+typedef struct deviceInfoExt{
+    deviceInfo_t    info;
+    char    protocolVersion;
+    char    bootStart[4];
+    char    maxDataSize[2];
+    char    features[2];
+}deviceInfoExt_t;
+/* Report 1 as sent by boot loaders with protocol version 2 or later. Older
+ * versions send only 'info'. With FEATURE_SKIP, two bytes follow: the number
+ * of pages the device did not write because they were unchanged.
+ */
+
+#define FEATURE_READ            1   /* report 3: read flash */
+#define FEATURE_EEPROM          2   /* report 4: read and write EEPROM */
+#define FEATURE_FINGERPRINT     4   /* report 5: CRC of the application */
+#define FEATURE_ERASE_RANGE     8   /* reserved for erasing without data */
+#define FEATURE_COMPRESSION     16  /* reserved for compressed data reports */
+#define FEATURE_SKIP            32  /* device skips pages which are unchanged */
+#define FEATURE_SHORT_DATA      64  /* last report 2 may be short, device pads the page */
+#define FEATURE_STATUS          128 /* report 6 on the interrupt endpoint: page written */
+#define FEATURE_PATCH           256 /* report 7: change a few bytes of a page */
+#define FEATURE_PERF            512 /* report 8: time and event counters */
+
+#define STATUS_TIMEOUT      1.0 /* seconds to wait for a status report */
+
+typedef struct deviceCaps{
+    int     protocolVersion;    /* 1 if report 1 has no extension */
+    int     pageSize;
+    int     flashSize;
+    int     bootStart;          /* end of the application section */
+    int     maxDataSize;        /* data bytes per report 2 */
+    int     features;           /* FEATURE_* flags */
+    int     skippedPages;       /* pages skipped by the device since reset */
+}deviceCaps_t;
+/* This type holds the device properties from report 1, see getDeviceCaps().
+ */
+
+typedef struct deviceData{
+    char    reportId;
+    char    address[3];
+    char    data[128];
+}deviceData_t;
+/* Report 2 of the boot loader: data to be written to flash at 'address'.
+ * Report 3 has the same layout: sending it sets the address for reading,
+ * each GET_REPORT returns the flash contents at the address and advances it.
+ */
+
+typedef struct deviceFingerprint{
+    char    reportId;
+    char    crc[4];
+    char    size[4];
+}deviceFingerprint_t;
+/* Report 5 of the boot loader (optional): CRC-32 of the 'size' bytes of
+ * flash below the boot loader, see registry.c.
+ */
+
+#define PATCH_DATA_SIZE 32
+
+typedef struct devicePatch{
+    char    reportId;
+    char    address[3];
+    char    length;
+    char    data[PATCH_DATA_SIZE];
+}devicePatch_t;
+/* Report 7 of the boot loader (optional, FEATURE_PATCH): the device reads
+ * the page containing 'address' from flash, replaces 'length' bytes from
+ * there and writes the page. The bytes must not cross a page boundary. The
+ * report is always sent with all PATCH_DATA_SIZE data bytes.
+ */
+
+typedef struct devicePerf{
+    char    reportId;
+    char    ticksPerMs[2];
+    char    eraseTicks[4];
+    char    writeTicks[4];
+    char    busyTicks[4];
+    char    receiveTicks[4];
+    char    idleTicks[4];
+    char    pagesErased[2];
+    char    pagesWritten[2];
+    char    setupPackets[2];
+}devicePerf_t;
+/* Report 8 of the boot loader (optional, FEATURE_PERF): counters since the
+ * boot loader started, the times in ticks of a free-running timer. They
+ * cover waiting for page erases, for page writes, for other SPM or EEPROM
+ * operations, for the OUT packets of a SET_REPORT and the idle main loop.
+ */
+
+#define TRIGGER_NONE    0
+#define TRIGGER_HID     1
+#define TRIGGER_CDC     2
+
+typedef struct trigger{
+    int     type;           /* one of the TRIGGER_* constants */
+    int     vendor, product;
+    char    report[64];     /* report ID followed by data */
+    int     reportLen;
+    char    *port;
+}trigger_t;
+/* This type describes how a running application is asked to start the boot
+ * loader. See update.c for details.
+ */
+
+#define BLOCK_UNCHANGED 1   /* page is already in flash, block is not sent */
+#define BLOCK_BLANK     2   /* page contains only 0xff */
+#define BLOCK_PATCH     4   /* page is sent as report 7 instead */
+
+typedef struct uploadBlock{
+    int     address;        /* start of the 128 byte data report */
+    int     length;         /* data bytes needed with FEATURE_SHORT_DATA, 0 if none */
+    int     flags;          /* BLOCK_* flags of the page containing the block */
+    int     patchAddress;   /* BLOCK_PATCH, first block of the page: bytes */
+    int     patchLength;    /* from base to data which differ */
+}uploadBlock_t;
+
+typedef struct uploadPlan{
+    int             pageSize;
+    int             startAddr, endAddr; /* rounded to pages */
+    int             numBlocks;
+    uploadBlock_t   *blocks;
+    int             reportsToSend, reportBytes;
+    int             dataBytes;          /* reportBytes without the headers */
+    int             bytesToSend, bytesSkipped;
+    int             blankPages;
+}uploadPlan_t;
+/* This type lists the data reports needed to upload an image. The report
+ * counts depend on the features passed to makeUploadPlan(). 'dataBytes' is
+ * what uploadData() counts in runStats_t.bytesSent for the plan.
+ */
+
+typedef struct mcuProfile{
+    char    *name;
+    int     flashSize;
+    int     pageSize;
+}mcuProfile_t;
+/* This type describes the flash of a supported MCU. */
+
+typedef struct throughputModel{
+    char    *firmware;          /* "vusb", "boothid" or a "-speed" variant */
+    int     bootLoaderSize;
+    double  reportOverhead;     /* seconds per data report, independent of size */
+    double  byteTime;           /* seconds per report byte */
+    double  pageTime;           /* seconds per page erase and write */
+    int     features;           /* FEATURE_* flags of the build */
+}throughputModel_t;
+/* This type holds the parameters for upload time estimates, see plan.c. */
+
+typedef struct calibration{
+    char    firmware[32];       /* name of the throughput model measured */
+    double  reportOverhead;     /* throughput model parameters, see above */
+    double  byteTime;
+    double  pageTime;
+    int     timeout;            /* milliseconds for USB transfers */
+}calibration_t;
+/* This type holds the results of "--bench", see bench.c. */
+
+/* ------------------------------------------------------------------------ */
+
+int     parseIntelHex(char *hexfile, char buffer[IMAGE_BUFFER_SIZE], int *startAddr, int *endAddr);
+/* This function reads the Intel-Hex file 'hexfile' into 'buffer'. The range
+ * of addresses found in the file is merged into '*startAddr' and '*endAddr'.
+ * Returns: 0 on success, 1 if the file could not be opened.
+ */
+int     parseImageFile(char *file, char buffer[IMAGE_BUFFER_SIZE], int *startAddr, int *endAddr);
+/* This function is the same as parseIntelHex(), except that ELF files (as
+ * produced by avr-gcc) are recognized and their loadable flash segments read.
+ */
+int     getDeviceCaps(usbDevice_t *dev, deviceCaps_t *caps);
+/* This function reads report 1 from 'dev' into 'caps'. For boot loaders
+ * which send the original 7 bytes only (or a boot start of 0), the boot
+ * loader size is assumed to be BOOTLOAD_SIZE and no features are set.
+ * Returns: 0 on success, -1 if the report is too short, a USB_ERROR_* code
+ * otherwise.
+ */
+int     sendExitReport(usbDevice_t *dev);
+/* This function sends report 1 to 'dev', which makes the boot loader start
+ * the application. The report has the length the device declares for it
+ * (Windows rejects others). Errors are usually to be ignored: the device
+ * may reboot before the transfer is complete.
+ * Returns: 0 on success, a USB_ERROR_* code otherwise.
+ */
+int     uploadData(char *dataBuffer, int startAddr, int endAddr, char *location, int leaveBootLoader, char *baseData);
+/* This function opens the HIDBoot device (the one at 'location' if not NULL,
+ * see usbOpenDeviceAt()) and uploads the bytes from 'startAddr' up to
+ * 'endAddr' of 'dataBuffer'. If 'baseData' is not NULL, it must contain what
+ * the device's flash is known to contain in this range; pages which are
+ * identical in both buffers are skipped. Otherwise, if the device can read
+ * its flash back, pages are read and skipped if they are equal, until
+ * several pages in a row turned out to differ. If 'leaveBootLoader' is
+ * non-zero, the device is told to start the application afterwards.
+ * Returns: 0 on success, an error code otherwise.
+ */
+int     uploadEeprom(char *file, char *location, int leaveBootLoader);
+/* This function writes the contents of the Intel-Hex file 'file' to the
+ * EEPROM of the HIDBoot device (at 'location' if not NULL). Only blocks
+ * which differ are sent. If 'leaveBootLoader' is non-zero, the device is
+ * told to start the application afterwards.
+ * Returns: 0 on success, an error code otherwise.
+ */
+int     uploadWithRegistry(char *dataBuffer, int startAddr, int endAddr, char *registry, char *location, int leaveBootLoader);
+/* This function is the same as uploadData(), except that the device's flash
+ * contents are looked up by fingerprint in the directory 'registry' and
+ * used as base data. The resulting contents are added to the registry.
+ * Returns: 0 on success, an error code otherwise.
+ */
+unsigned long   imageCrc(char *buffer, int size);
+/* This function returns the fingerprint of the first 'size' bytes of
+ * 'buffer' (bytes beyond IMAGE_BUFFER_SIZE are taken as 0xff).
+ */
+int     writeIntelHex(char *file, char *buffer, int startAddr, int endAddr);
+/* This function writes the bytes from 'startAddr' up to 'endAddr' of
+ * 'buffer' to the Intel-Hex file 'file'. Lines containing only 0xff are
+ * left out.
+ * Returns: 0 on success, 1 otherwise.
+ */
+int     waitForBootLoader(char *location, double timeout);
+/* This function polls until a HIDBoot device (at 'location' if not NULL) can
+ * be opened. A negative 'timeout' (in seconds) waits forever.
+ * Returns: 0 when the device is present, USB_ERROR_NOTFOUND on timeout.
+ */
+char    *usbErrorMessage(int errCode);
+/* This function returns a human readable description for a USB_ERROR_*
+ * code from usbcalls.h.
+ */
+double  getTime(void);
+/* This function returns a monotonic time stamp in seconds.
+ */
+void    sleepMs(int milliseconds);
+/* This function suspends the program for 'milliseconds'.
+ */
+int     getUsbInt(char *buffer, int numBytes);
+void    setUsbInt(char *buffer, int value, int numBytes);
+/* These functions convert between integers and little endian report fields.
+ */
+void    printJsonString(FILE *fp, char *s);
+/* This function writes 's' as quoted JSON string to 'fp'.
+ */
+int     statusStart(usbDevice_t *dev);
+/* This function starts collecting the status reports of 'dev', a device with
+ * FEATURE_STATUS, see status.c.
+ * Returns: 0 on success, -1 if no thread could be started.
+ */
+void    statusSent(int address);
+/* This function tells the reader that the page at 'address' was sent.
+ */
+int     statusWait(int address, double timeout);
+/* This function waits at most 'timeout' seconds until the page at 'address'
+ * (or a later one) is confirmed.
+ * Returns: 0 on success, -1 on timeout or if reading the reports failed.
+ */
+void    statusStop(void);
+/* This function stops collecting status reports. It must be called before
+ * the device is closed.
+ */
+
+/* ------------------------------------------------------------------------ */
+
+void    makeUploadPlan(uploadPlan_t *plan, char *dataBuffer, int startAddr, int endAddr, int pageSize, char *baseData, int features);
+/* This function computes the data reports needed to upload the bytes from
+ * 'startAddr' up to 'endAddr' of 'dataBuffer' to a device with 'pageSize'.
+ * The range is rounded to pages (at least 128 bytes); a device with
+ * FEATURE_SHORT_DATA gets only the bytes up to 'endAddr' and fills the rest
+ * of the last page itself. Pages which are equal in 'baseData' (if not NULL)
+ * are marked BLOCK_UNCHANGED. If 'features' contains FEATURE_PATCH, pages
+ * whose differences from 'baseData' fit into one report 7 are marked
+ * BLOCK_PATCH. The plan must be released with freeUploadPlan().
+ */
+void    freeUploadPlan(uploadPlan_t *plan);
+/* This function releases the memory allocated by makeUploadPlan(). It may be
+ * called for a zeroed plan as well.
+ */
+int     findPatch(char *data, char *base, int size, int pageSize, int *offset);
+/* This function compares 'size' bytes of 'data' with 'base'. If they differ
+ * within PATCH_DATA_SIZE bytes of one page of 'pageSize', it returns the
+ * number of bytes from the first to the last difference and their offset
+ * in 'offset'. Otherwise, also if they are equal, it returns 0.
+ */
+double  estimateUploadTime(uploadPlan_t *plan, throughputModel_t *model);
+/* This function returns the estimated time in seconds to upload 'plan'.
+ */
+mcuProfile_t        *findMcuProfile(char *name);
+throughputModel_t   *findThroughputModel(char *firmware);
+/* These functions look up the built-in MCU and throughput model tables.
+ * Returns: NULL if the name is unknown.
+ */
+
+extern runStats_t   *runStats;
+/* Statistics of this run, NULL unless they are enabled. */
+
+void    statsRecord(int which, double seconds);
+/* This function adds a sample to the histogram STATS_* 'which'. It does
+ * nothing if statistics are not enabled.
+ */
+double  statsPercentile(histogram_t *h, int percent);
+/* This function returns the approximate latency in seconds below which
+ * 'percent' percent of the samples in 'h' are.
+ */
+int     statsReadDevice(usbDevice_t *dev);
+/* This function requests report 8 from a device with FEATURE_PERF and adds
+ * its counters to 'runStats'. Returns 0 on success, an error code otherwise.
+ */
+void    printStats(FILE *fp, int json);
+/* This function prints 'runStats' as text or as one line of JSON.
+ */
+
+#define TRACK_HOST      0
+#define TRACK_PARSE     1
+
+extern FILE *traceFile;
+/* Output of "--trace", NULL unless tracing is enabled. The trace functions
+ * below must only be called if it is not NULL.
+ */
+
+int     traceOpen(char *file);
+/* This function creates the trace file 'file' and enables tracing.
+ * Returns: 0 on success, 1 otherwise.
+ */
+void    traceClose(void);
+/* This function completes and closes the trace file, if any.
+ */
+int     traceTrack(char *name);
+/* This function returns the track (a "thread" in the viewer) called 'name'
+ * and creates it if necessary.
+ */
+void    traceSpan(int track, char *name, double start, double end, char *args);
+/* This function writes an event 'name' from 'start' to 'end' (getTime()
+ * values) on 'track'. 'args' is NULL or a list of JSON members such as
+ * "\"address\": 256".
+ */
+
+/* ------------------------------------------------------------------------ */
+
+int     runBatch(char *manifestFile);
+/* This function executes all jobs listed in 'manifestFile'. See batch.c for
+ * a description of the file format.
+ * Returns: 0 if all jobs succeeded, 1 otherwise.
+ */
+int     runWatch(char *file, trigger_t *trigger);
+/* This function waits for changes of 'file' and uploads each new version
+ * to the HIDBoot device, see watch.c. If the boot loader is not active, it is
+ * started with 'trigger' (if its type is not TRIGGER_NONE). This function
+ * returns when it is stopped with Ctrl-C or on errors.
+ * Returns: 0 when stopped, 1 on errors.
+ */
+int     runPlan(char *file, char *mcu, char *firmware, char *baseFile, char *jsonFile, calibration_t *cal);
+/* This function prints the upload plan and time estimate for 'file' on the
+ * MCU 'mcu' with boot loader 'firmware' without accessing USB. If 'baseFile'
+ * is not NULL, it is taken as the current flash contents. If 'jsonFile' is
+ * not NULL, the plan is written to this file in JSON format as well. If 'cal'
+ * is not NULL, its parameters replace the built-in throughput model.
+ * Returns: 0 on success, 1 otherwise.
+ */
+int     runBench(int count, char *writeRange, int consent, char *firmware, char *calibrationFile);
+/* This function times 'count' device info requests and, if 'writeRange'
+ * ("<start>:<end>") is not NULL and the user agrees (or 'consent' is set),
+ * 'count' data reports to this range. The statistics are printed and the
+ * resulting calibration is written to 'calibrationFile' if not NULL.
+ * Returns: 0 on success, 1 otherwise.
+ */
+int     loadCalibration(char *file, calibration_t *cal, char *firmware);
+/* This function reads a calibration file written by runBench(). The file
+ * must have been measured with the throughput model 'firmware'.
+ * Returns: 0 on success, 1 otherwise.
+ */
+void    applyCalibration(calibration_t *cal, throughputModel_t *model);
+/* This function copies the measured parameters from 'cal' to 'model'.
+ */
+int     startSimulation(char *mcu, char *firmware, double timeScale);
+/* This function replaces the USB devices with a simulated HIDBoot device
+ * for the MCU 'mcu' which takes the time of the throughput model for
+ * 'firmware', multiplied by 'timeScale', for each transfer.
+ * Returns: 0 on success, 1 if 'mcu' or 'firmware' is unknown.
+ */
+int     runFaultBench(char *file, char *mcu, char *firmware, double timeScale, char *jsonFile);
+/* This function uploads 'file' to a simulated device (see startSimulation())
+ * once for each built-in fault pattern and prints the flash time, the bytes
+ * retransmitted and the retries. If 'jsonFile' is not NULL, the results are
+ * written to this file in JSON format as well.
+ * Returns: 0 if all uploads were verified, 1 otherwise.
+ */
+int     runDump(char *file);
+/* This function reads the application region of the device's flash into
+ * 'file' (Intel-Hex if the name ends in ".hex", binary otherwise).
+ * Returns: 0 on success, 1 otherwise.
+ */
+int     runUpdate(char *file, trigger_t *trigger, int appVendor, int appProduct);
+/* This function starts the boot loader with 'trigger', uploads 'file',
+ * leaves the boot loader and waits for the application with the USB IDs
+ * 'appVendor' and 'appProduct' (unless 0). The time of each phase is
+ * printed.
+ * Returns: 0 on success, 1 otherwise.
+ */
+int     parseTrigger(trigger_t *trigger, char *spec);
+/* This function parses a trigger specification (see update.c).
+ * Returns: 0 on success, -1 for invalid specifications.
+ */
+int     fireTrigger(trigger_t *trigger);
+/* This function asks the application to start the boot loader.
+ * Returns: 0 on success, an error code otherwise.
+ */
+int     parseUsbIds(char *spec, int *vendor, int *product);
+/* This function parses "<vid>:<pid>" (hexadecimal numbers).
+ * Returns: The number of characters parsed or -1 on errors.
+ */
+
+/* ------------------------------------------------------------------------ */
+
+#endif /* __bootloadHID_h_INCLUDED__ */
@@ -0,0 +1,169 @@
+/* Name: dump.c
+ * Project: AVR bootloader HID
+ * Author: bootloadHID contributors
+ * Creation Date: 2026-10-19
+ * Tabsize: 4
+ * License: Proprietary, free under certain conditions. See Documentation.
+ * This Revision: $Id$
+ */
+
+/*
+General Description:
+This module implements "--dump <file>", which reads the application region
+of the flash back from the device, e.g. as a backup before an update. The
+boot loader must be built with read support (BOOTLOADER_CAN_READ for the
+V-USB version, USE_READBACK for BootHID).
+
+Reading uses report 3, which has the same layout as the data report: we send
+it once with the start address, then each GET_REPORT returns the address
+and the next 128 bytes. Every block is written to the output as soon as it
+arrives, so the flash is never held in memory. If the file name ends in
+".hex", Intel-Hex is written (lines containing only 0xff are left out, as
+the parser fills gaps with 0xff), otherwise a binary image.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include "usbcalls.h"
+#include "bootloadHID.h"
+
+#define HEX_LINE_SIZE   16
+
+typedef struct dumpWriter{
+    FILE    *fp;
+    int     isHex;
+    int     segment;    /* upper 16 bits of the address, Intel-Hex only */
+}dumpWriter_t;
+
+/* ------------------------------------------------------------------------- */
+
+static void writeHexRecord(FILE *fp, int type, int address, unsigned char *data, int len)
+{
+int     i, sum = len + (address >> 8) + address + type;
+
+    fprintf(fp, ":%02X%04X%02X", len, address & 0xffff, type);
+    for(i = 0; i < len; i++){
+        fprintf(fp, "%02X", data[i]);
+        sum += data[i];
+    }
+    fprintf(fp, "%02X\n", -sum & 0xff);
+}
+
+static void writeBlock(dumpWriter_t *w, int address, unsigned char *data, int len)
+{
+unsigned char   segment[2];
+int             i, j;
+
+    if(!w->isHex){
+        fwrite(data, 1, len, w->fp);
+        return;
+    }
+    for(i = 0; i < len; i += HEX_LINE_SIZE){
+        for(j = 0; j < HEX_LINE_SIZE && data[i + j] == 0xff; j++);
+        if(j == HEX_LINE_SIZE)
+            continue;   /* blank */
+        if((address + i) >> 16 != w->segment){
+            w->segment = (address + i) >> 16;
+            segment[0] = w->segment >> 8;
+            segment[1] = w->segment;
+            writeHexRecord(w->fp, 4, 0, segment, 2);
+        }
+        writeHexRecord(w->fp, 0, address + i, data + i, HEX_LINE_SIZE);
+    }
+}
+
+int writeIntelHex(char *file, char *buffer, int startAddr, int endAddr)
+{
+dumpWriter_t    writer;
+int             err;
+
+    memset(&writer, 0, sizeof(writer));
+    writer.isHex = 1;
+    if((writer.fp = fopen(file, "w")) == NULL){
+        fprintf(stderr, "error creating %s: %s\n", file, strerror(errno));
+        return 1;
+    }
+    startAddr &= ~(HEX_LINE_SIZE - 1);
+    endAddr = (endAddr + HEX_LINE_SIZE - 1) & ~(HEX_LINE_SIZE - 1);
+    writeBlock(&writer, startAddr, (unsigned char *)buffer + startAddr, endAddr - startAddr);
+    writeHexRecord(writer.fp, 1, 0, NULL, 0);
+    if((err = fclose(writer.fp)) != 0)
+        fprintf(stderr, "error writing %s: %s\n", file, strerror(errno));
+    return err != 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+int runDump(char *file)
+{
+usbDevice_t     *dev = NULL;
+dumpWriter_t    writer;
+int             err, len, address, endAddr, nameLen = strlen(file);
+double          startTime = getTime();
+deviceCaps_t    caps;
+union{
+    char            bytes[1];
+    deviceData_t    data;
+}               buffer;
+
+    memset(&writer, 0, sizeof(writer));
+    writer.isHex = nameLen > 4 && strcmp(file + nameLen - 4, ".hex") == 0;
+    if((err = usbOpenDevice(&dev, IDENT_VENDOR_NUM, IDENT_VENDOR_STRING, IDENT_PRODUCT_NUM, IDENT_PRODUCT_STRING, 1)) != 0){
+        fprintf(stderr, "Error opening HIDBoot device: %s\n", usbErrorMessage(err));
+        return 1;
+    }
+    if((err = getDeviceCaps(dev, &caps)) != 0){
+        if(err > 0)
+            fprintf(stderr, "Error reading device info: %s\n", usbErrorMessage(err));
+        goto errorOccurred;
+    }
+    if(caps.protocolVersion >= 2 && !(caps.features & FEATURE_READ)){
+        fprintf(stderr, "The boot loader was built without read support.\n");
+        err = 1;
+        goto errorOccurred;
+    }
+    endAddr = caps.bootStart;
+    memset(&buffer, 0, sizeof(buffer));
+    buffer.data.reportId = 3;
+    if((err = usbSetReport(dev, USB_HID_REPORT_TYPE_FEATURE, buffer.bytes, sizeof(buffer.data))) != 0){
+        fprintf(stderr, "Error setting read address: %s\n", usbErrorMessage(err));
+        fprintf(stderr, "The boot loader was probably built without read support.\n");
+        goto errorOccurred;
+    }
+    if((writer.fp = fopen(file, writer.isHex ? "w" : "wb")) == NULL){
+        fprintf(stderr, "error creating %s: %s\n", file, strerror(errno));
+        err = 1;
+        goto errorOccurred;
+    }
+    printf("Reading %d (0x%x) bytes to %s\n", endAddr, endAddr, file);
+    for(address = 0; address < endAddr; address += sizeof(buffer.data.data)){
+        len = sizeof(buffer.data);
+        err = usbGetReport(dev, USB_HID_REPORT_TYPE_FEATURE, 3, buffer.bytes, &len);
+        if(err == 0 && (len < sizeof(buffer.data) || getUsbInt(buffer.data.address, 3) != address)){
+            fprintf(stderr, "\nUnexpected read report at 0x%05x\n", address);
+            err = -1;
+        }
+        if(err != 0){
+            if(err > 0)
+                fprintf(stderr, "\nError reading flash: %s\n", usbErrorMessage(err));
+            goto errorOccurred;
+        }
+        writeBlock(&writer, address, (unsigned char *)buffer.data.data, sizeof(buffer.data.data));
+        printf("\r0x%05x ... 0x%05x", address, address + (int)sizeof(buffer.data.data));
+        fflush(stdout);
+    }
+    if(writer.isHex)
+        writeHexRecord(writer.fp, 1, 0, NULL, 0);
+    printf("\nRead %d bytes in %.2f s\n", endAddr, getTime() - startTime);
+errorOccurred:
+    if(writer.fp != NULL && fclose(writer.fp) != 0 && err == 0){
+        fprintf(stderr, "error writing %s: %s\n", file, strerror(errno));
+        err = 1;
+    }
+    usbCloseDevice(dev);
+    return err != 0;
+}
+
+/* ------------------------------------------------------------------------- */
@@ -0,0 +1,128 @@
+/* Name: eeprom.c
+ * Project: AVR bootloader HID
+ * Author: bootloadHID contributors
+ * Creation Date: 2026-10-19
+ * Tabsize: 4
+ * License: Proprietary, free under certain conditions. See Documentation.
+ * This Revision: $Id$
+ */
+
+/*
+General Description:
+This module programs the EEPROM from an Intel-Hex file (usually the ".eep"
+file produced by avr-objcopy) given next to the flash image. The boot loader
+must be built with EEPROM support (BOOTLOADER_CAN_EEPROM for the V-USB
+version, USE_EEPROM for BootHID).
+
+The EEPROM is handled in blocks of 128 bytes. Each block touched by the file
+is read first (report 3 sets the address, GET_REPORT 4 returns the block).
+Bytes not contained in the file keep their current value, and blocks which
+already match are not sent. To find out which bytes the file contains, it is
+parsed twice, into buffers filled with 0x00 and 0xff: bytes which differ
+between the two are gaps. The boot loader writes only the bytes of a
+block which differ, so a changed byte costs one EEPROM write.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "usbcalls.h"
+#include "bootloadHID.h"
+
+#define EEPROM_BLOCK_SIZE   128
+
+typedef union{
+    char            bytes[1];
+    deviceData_t    data;
+}eepromReport_t;
+
+/* ------------------------------------------------------------------------- */
+
+static int  readEepromBlock(usbDevice_t *dev, int address, eepromReport_t *buffer)
+{
+int     err, len = sizeof(buffer->data);
+
+    memset(buffer, 0, sizeof(*buffer));
+    buffer->data.reportId = 3;
+    setUsbInt(buffer->data.address, address, 3);
+    if((err = usbSetReport(dev, USB_HID_REPORT_TYPE_FEATURE, buffer->bytes, sizeof(buffer->data))) != 0)
+        return err;
+    if((err = usbGetReport(dev, USB_HID_REPORT_TYPE_FEATURE, 4, buffer->bytes, &len)) != 0)
+        return err;
+    if(len < sizeof(buffer->data) || getUsbInt(buffer->data.address, 3) != address)
+        return -1;
+    return 0;
+}
+
+int uploadEeprom(char *file, char *location, int leaveBootLoader)
+{
+static char     eepromData[IMAGE_BUFFER_SIZE], gapData[IMAGE_BUFFER_SIZE];
+usbDevice_t     *dev = NULL;
+eepromReport_t  buffer;
+int             err, address, i, changed, bytesChanged = 0, blocksSent = 0;
+int             startAddr = sizeof(eepromData), endAddr = 0;
+deviceCaps_t    caps;
+
+    memset(eepromData, 0xff, sizeof(eepromData));
+    memset(gapData, 0, sizeof(gapData));
+    if(parseIntelHex(file, eepromData, &startAddr, &endAddr) || parseIntelHex(file, gapData, &startAddr, &endAddr))
+        return -1;
+    if(startAddr >= endAddr){
+        fprintf(stderr, "No data in EEPROM file %s\n", file);
+        return 0;
+    }
+    err = usbOpenDeviceAt(&dev, location, IDENT_VENDOR_NUM, IDENT_VENDOR_STRING, IDENT_PRODUCT_NUM, IDENT_PRODUCT_STRING, 1);
+    if(err != 0){
+        fprintf(stderr, "Error opening HIDBoot device: %s\n", usbErrorMessage(err));
+        return err;
+    }
+    if((err = getDeviceCaps(dev, &caps)) != 0){
+        if(err > 0)
+            fprintf(stderr, "Error reading device info: %s\n", usbErrorMessage(err));
+        goto errorOccurred;
+    }
+    if(caps.protocolVersion >= 2 && !(caps.features & FEATURE_EEPROM)){
+        fprintf(stderr, "The boot loader was built without EEPROM support.\n");
+        err = -1;
+        goto errorOccurred;
+    }
+    startAddr &= ~(EEPROM_BLOCK_SIZE - 1);
+    printf("Updating EEPROM from %d (0x%x) to %d (0x%x)\n", startAddr, startAddr, endAddr, endAddr);
+    for(address = startAddr; address < endAddr; address += EEPROM_BLOCK_SIZE){
+        if((err = readEepromBlock(dev, address, &buffer)) != 0){
+            fprintf(stderr, "Error reading EEPROM at 0x%04x: %s\n", address, err > 0 ? usbErrorMessage(err) : "unexpected report");
+            if(err > 0)
+                fprintf(stderr, "The boot loader was probably built without EEPROM support.\n");
+            goto errorOccurred;
+        }
+        changed = 0;
+        for(i = 0; i < EEPROM_BLOCK_SIZE; i++){
+            if(eepromData[address + i] != gapData[address + i] || eepromData[address + i] == buffer.data.data[i])
+                continue;   /* not in file or unchanged */
+            buffer.data.data[i] = eepromData[address + i];
+            changed++;
+        }
+        if(changed == 0)
+            continue;
+        buffer.data.reportId = 4;
+        setUsbInt(buffer.data.address, address, 3);
+        if((err = usbSetReport(dev, USB_HID_REPORT_TYPE_FEATURE, buffer.bytes, sizeof(buffer.data))) != 0){
+            fprintf(stderr, "Error writing EEPROM at 0x%04x: %s\n", address, usbErrorMessage(err));
+            goto errorOccurred;
+        }
+        if(runStats != NULL){
+            runStats->reports++;
+            runStats->bytesSent += EEPROM_BLOCK_SIZE;
+        }
+        bytesChanged += changed;
+        blocksSent++;
+    }
+    printf("EEPROM: %d bytes changed in %d blocks\n", bytesChanged, blocksSent);
+    if(leaveBootLoader)
+        sendExitReport(dev);
+errorOccurred:
+    usbCloseDevice(dev);
+    return err;
+}
+
+/* ------------------------------------------------------------------------- */
@@ -0,0 +1,179 @@
+/* Name: faultbench.c
+ * Project: AVR bootloader HID
+ * Author: bootloadHID contributors
+ * Creation Date: 2026-10-19
+ * Tabsize: 4
+ * License: Proprietary, free under certain conditions. See Documentation.
+ * This Revision: $Id$
+ */
+
+/*
+General Description:
+This module implements "--fault-bench", which measures what recovery from
+transfer errors costs. An image is uploaded to the simulated device of
+usb-sim.c once for each of a set of fault patterns (see usb-fault.c for the
+notation). For each pattern, the total flash time, the bytes sent in excess
+of the upload plan and the number of page retries are reported. The flash
+contents are compared with the image afterwards.
+
+The simulated flash is blank at the start of each pattern, and the upload
+is given a blank base image. The plan is then the same as the one
+uploadData() follows (no read-back), with the device's features, so the run
+without faults retransmits nothing. The benchmark fails if it does.
+
+If an upload fails, the benchmark does what a user would do: wait for the
+device to come back and start the upload again (up to RECOVERY_ATTEMPTS
+times). This time is included in the total.
+
+The simulated device runs with the throughput model of the firmware, scaled
+by "--sim-speed" (0 runs without delays, only the retry cost in bytes is
+meaningful then).
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "usbcalls.h"
+#include "bootloadHID.h"
+
+#define RECOVERY_ATTEMPTS   3
+#define RECOVERY_TIMEOUT    5.0     /* seconds to wait for the device */
+
+static char *scenarios[][2] = {
+    /* name             fault spec */
+    {"none",            NULL},
+    {"io-once",         "io@at=10"},
+    {"io-5%",           "io@p=0.05"},
+    {"delay-20ms-10%",  "delay:20@p=0.1"},
+    {"truncate-info",   "truncate:3@at=0"},
+    {"gone-500ms",      "gone:500@at=20"},
+    {NULL, NULL}
+};
+
+typedef struct scenarioResult{
+    double  seconds;
+    int     bytesSent;
+    int     bytesRetransmitted;
+    int     retries;
+    int     restarts;
+    int     verified;
+}scenarioResult_t;
+
+/* ------------------------------------------------------------------------- */
+
+int startSimulation(char *mcu, char *firmware, double timeScale)
+{
+mcuProfile_t        *profile = findMcuProfile(mcu);
+throughputModel_t   *model = findThroughputModel(firmware);
+
+    if(profile == NULL || model == NULL){
+        fprintf(stderr, "Unknown %s \"%s\"\n", profile == NULL ? "MCU" : "firmware", profile == NULL ? mcu : firmware);
+        return 1;
+    }
+    usbSimulate(profile->flashSize, profile->pageSize, model->bootLoaderSize,
+        (model->reportOverhead + 132 * model->byteTime) * timeScale, model->pageTime * timeScale);
+    return 0;
+}
+
+static void runScenario(char *spec, char *image, char *blank, int startAddr, int endAddr, int planBytes, scenarioResult_t *result)
+{
+runStats_t  stats;
+int         err, attempt;
+char        *flash;
+double      startTime;
+
+    usbClearFaults();
+    if(spec != NULL)
+        usbAddFault(spec);
+    memset(&stats, 0, sizeof(stats));
+    runStats = &stats;
+    startTime = getTime();
+    err = uploadData(image, startAddr, endAddr, NULL, 1, blank);
+    for(attempt = 0; err != 0 && attempt < RECOVERY_ATTEMPTS; attempt++){
+        if(waitForBootLoader(NULL, RECOVERY_TIMEOUT) != 0)
+            break;
+        result->restarts++;
+        err = uploadData(image, startAddr, endAddr, NULL, 1, blank);
+    }
+    result->seconds = getTime() - startTime;
+    runStats = NULL;
+    usbClearFaults();
+    result->bytesSent = stats.bytesSent;
+    result->bytesRetransmitted = stats.bytesSent - planBytes;
+    result->retries = stats.retries;
+    flash = usbSimulatedFlash(NULL);
+    result->verified = err == 0 && memcmp(flash + startAddr, image + startAddr, endAddr - startAddr) == 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+int runFaultBench(char *file, char *mcu, char *firmware, double timeScale, char *jsonFile)
+{
+static char         image[IMAGE_BUFFER_SIZE], blank[IMAGE_BUFFER_SIZE];
+int                 startAddr = sizeof(image), endAddr = 0, i, err, failed = 0;
+uploadPlan_t        plan;
+usbDevice_t         *dev;
+deviceCaps_t        caps;
+scenarioResult_t    results[sizeof(scenarios) / sizeof(scenarios[0])];
+FILE                *fp;
+
+    memset(image, -1, sizeof(image));
+    if(parseImageFile(file, image, &startAddr, &endAddr))
+        return 1;
+    if(startAddr >= endAddr){
+        fprintf(stderr, "No data in input file, exiting.\n");
+        return 1;
+    }
+    if(startSimulation(mcu, firmware, timeScale))
+        return 1;
+    if((err = usbOpenDevice(&dev, IDENT_VENDOR_NUM, IDENT_VENDOR_STRING, IDENT_PRODUCT_NUM, IDENT_PRODUCT_STRING, 1)) != 0){
+        fprintf(stderr, "Error opening simulated device: %s\n", usbErrorMessage(err));
+        return 1;
+    }
+    err = getDeviceCaps(dev, &caps);
+    usbCloseDevice(dev);
+    if(err != 0)
+        return 1;
+    memset(blank, -1, sizeof(blank));
+    makeUploadPlan(&plan, image, startAddr, endAddr, caps.pageSize, blank, caps.features);
+    freeUploadPlan(&plan);
+    memset(results, 0, sizeof(results));
+    for(i = 0; scenarios[i][0] != NULL; i++){
+        startSimulation(mcu, firmware, timeScale);  /* blank flash */
+        runScenario(scenarios[i][1], image, blank, startAddr, endAddr, plan.dataBytes, &results[i]);
+        failed |= !results[i].verified;
+        if(scenarios[i][1] == NULL && results[i].bytesRetransmitted != 0){
+            fprintf(stderr, "Scenario %s retransmitted %d bytes without faults\n", scenarios[i][0], results[i].bytesRetransmitted);
+            failed = 1;
+        }
+    }
+    printf("\n%-16s %-16s %9s %9s %12s %8s %8s %s\n", "scenario", "fault", "seconds", "bytes", "retransmitted", "retries", "restarts", "result");
+    for(i = 0; scenarios[i][0] != NULL; i++){
+        printf("%-16s %-16s %9.3f %9d %12d %8d %8d %s\n", scenarios[i][0], scenarios[i][1] != NULL ? scenarios[i][1] : "-",
+            results[i].seconds, results[i].bytesSent, results[i].bytesRetransmitted, results[i].retries, results[i].restarts,
+            results[i].verified ? "ok" : "FAILED");
+    }
+    if(jsonFile != NULL){
+        if((fp = fopen(jsonFile, "w")) == NULL){
+            fprintf(stderr, "error creating %s\n", jsonFile);
+            return 1;
+        }
+        fprintf(fp, "{\"mcu\": \"%s\", \"firmware\": \"%s\", \"planBytes\": %d, \"scenarios\": [", mcu, firmware, plan.dataBytes);
+        for(i = 0; scenarios[i][0] != NULL; i++){
+            fprintf(fp, "%s\n  {\"name\": \"%s\", \"fault\": ", i > 0 ? "," : "", scenarios[i][0]);
+            if(scenarios[i][1] != NULL){
+                printJsonString(fp, scenarios[i][1]);
+            }else{
+                fprintf(fp, "null");
+            }
+            fprintf(fp, ", \"seconds\": %.6f, \"bytesSent\": %d, \"bytesRetransmitted\": %d, \"retries\": %d, \"restarts\": %d, \"verified\": %s}",
+                results[i].seconds, results[i].bytesSent, results[i].bytesRetransmitted, results[i].retries, results[i].restarts,
+                results[i].verified ? "true" : "false");
+        }
+        fprintf(fp, "\n]}\n");
+        fclose(fp);
+    }
+    return failed;
+}
+
+/* ------------------------------------------------------------------------- */
@@ -0,0 +1,283 @@
+/* Name: hidbootbench.c
+ * Project: AVR bootloader HID
+ * Author: bootloadHID contributors
+ * Creation Date: 2026-10-19
+ * Tabsize: 4
+ * License: Proprietary, free under certain conditions. See Documentation.
+ * This Revision: $Id$
+ */
+
+/*
+General Description:
+This program measures the host side performance of bootloadHID, so that
+builds can be compared. It is built and run with "make bench" and covers:
+
+    parse       reading Intel-Hex and ELF files of several sizes
+    plan        computing upload plans, with and without a base image
+    upload      complete uploads to the simulated device (usb-sim.c) of
+                each MCU for which BootHID is available
+
+The simulated device runs without delays, so the upload times are the cost
+of the host software alone. The time the real device would need according
+to the throughput model of plan.c is reported next to it. Uploads are
+limited to 64 kB by the image buffer of the command line tool.
+
+Each measurement is repeated until it took MIN_TIME seconds (at least
+MIN_RUNS times) and the best run is reported, which is more stable than the
+mean. The results are printed to stderr (stdout carries the upload progress)
+and written in JSON format to the file given with "-o". The order and names
+of the fields do not change between versions.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "usbcalls.h"
+#include "bootloadHID.h"
+
+#define MIN_RUNS    3
+#define MIN_TIME    0.25    /* seconds per measurement */
+
+#define TEMP_HEX    "hidbootbench.tmp.hex"
+#define TEMP_ELF    "hidbootbench.tmp.elf"
+
+static int  imageSizes[] = {4096, 16384, 65536, 0};
+
+static char *uploadMcus[] = {   /* BootHID/default/hexfiles */
+    "atmega8u2", "atmega16u2", "atmega32u2", "at90usb82", "at90usb162",
+    "atmega16u4", "atmega32u4", "at90usb646", "at90usb1286", NULL
+};
+
+static char image[IMAGE_BUFFER_SIZE], parsed[IMAGE_BUFFER_SIZE], base[IMAGE_BUFFER_SIZE];
+
+/* ------------------------------------------------------------------------- */
+
+static void makeImage(char *buffer, int size, unsigned seed)
+{
+int i;
+
+    memset(buffer, -1, IMAGE_BUFFER_SIZE);
+    for(i = 0; i < size; i++){
+        seed = seed * 1103515245 + 12345;
+        buffer[i] = seed >> 16;
+    }
+}
+
+static int  writeHex(char *file, char *data, int size)
+{
+FILE    *fp;
+int     address, i, n, sum;
+
+    if((fp = fopen(file, "w")) == NULL)
+        return 1;
+    for(address = 0; address < size; address += n){
+        n = size - address < 16 ? size - address : 16;
+        sum = n + (address >> 8) + address;
+        fprintf(fp, ":%02X%04X00", n, address & 0xffff);
+        for(i = 0; i < n; i++){
+            fprintf(fp, "%02X", data[address + i] & 0xff);
+            sum += data[address + i] & 0xff;
+        }
+        fprintf(fp, "%02X\n", -sum & 0xff);
+    }
+    fprintf(fp, ":00000001FF\n");
+    fclose(fp);
+    return 0;
+}
+
+static void putElfInt(FILE *fp, unsigned value, int numBytes)
+{
+    while(numBytes--){
+        putc(value & 0xff, fp);
+        value >>= 8;
+    }
+}
+
+static int  writeElf(char *file, char *data, int size)
+/* writes a minimal AVR executable with one loadable segment at address 0 */
+{
+FILE    *fp;
+
+    if((fp = fopen(file, "wb")) == NULL)
+        return 1;
+    fwrite("\177ELF\1\1\1\0\0\0\0\0\0\0\0\0", 1, 16, fp);
+    putElfInt(fp, 2, 2);        /* executable */
+    putElfInt(fp, 83, 2);       /* AVR */
+    putElfInt(fp, 1, 4);        /* version */
+    putElfInt(fp, 0, 4);        /* entry */
+    putElfInt(fp, 52, 4);       /* program header offset */
+    putElfInt(fp, 0, 4);        /* section header offset */
+    putElfInt(fp, 0, 4);        /* flags */
+    putElfInt(fp, 52, 2);       /* header size */
+    putElfInt(fp, 32, 2);       /* program header entry size */
+    putElfInt(fp, 1, 2);        /* program header entries */
+    putElfInt(fp, 40, 2);       /* section header entry size */
+    putElfInt(fp, 0, 4);        /* section header entries and names */
+    putElfInt(fp, 1, 4);        /* PT_LOAD */
+    putElfInt(fp, 84, 4);       /* offset */
+    putElfInt(fp, 0, 4);        /* virtual address */
+    putElfInt(fp, 0, 4);        /* physical address */
+    putElfInt(fp, size, 4);     /* size in file */
+    putElfInt(fp, size, 4);     /* size in memory */
+    putElfInt(fp, 5, 4);        /* readable, executable */
+    putElfInt(fp, 1, 4);        /* alignment */
+    fwrite(data, 1, size, fp);
+    fclose(fp);
+    return 0;
+}
+
+static int  keepRunning(int runs, double total)
+{
+    return runs < MIN_RUNS || total < MIN_TIME;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static int  benchParse(FILE *json)
+{
+char    *formats[] = {"hex", "elf"}, *files[] = {TEMP_HEX, TEMP_ELF};
+int     i, f, runs, startAddr, endAddr, first = 1;
+double  t, best, total;
+
+    fprintf(stderr, "%-8s %-12s %9s %12s %12s\n", "parse", "format", "bytes", "best ms", "MB/s");
+    fprintf(json, "  \"parse\": [");
+    for(i = 0; imageSizes[i] != 0; i++){
+        makeImage(image, imageSizes[i], i);
+        if(writeHex(TEMP_HEX, image, imageSizes[i]) || writeElf(TEMP_ELF, image, imageSizes[i])){
+            fprintf(stderr, "error creating temporary files\n");
+            return 1;
+        }
+        for(f = 0; f < 2; f++){
+            for(runs = 0, best = 1e9, total = 0; keepRunning(runs, total); runs++){
+                startAddr = sizeof(parsed);
+                endAddr = 0;
+                t = getTime();
+                if(parseImageFile(files[f], parsed, &startAddr, &endAddr))
+                    return 1;
+                t = getTime() - t;
+                total += t;
+                if(best > t)
+                    best = t;
+            }
+            if(startAddr != 0 || endAddr != imageSizes[i] || memcmp(image, parsed, imageSizes[i]) != 0){
+                fprintf(stderr, "%s: parsed data differs from image\n", files[f]);
+                return 1;
+            }
+            fprintf(stderr, "%-8s %-12s %9d %12.3f %12.2f\n", "", formats[f], imageSizes[i], best * 1e3, imageSizes[i] / best * 1e-6);
+            fprintf(json, "%s\n    {\"format\": \"%s\", \"bytes\": %d, \"seconds\": %.9f, \"bytesPerSecond\": %.0f}",
+                first ? "" : ",", formats[f], imageSizes[i], best, imageSizes[i] / best);
+            first = 0;
+        }
+    }
+    fprintf(json, "\n  ],\n");
+    remove(TEMP_HEX);
+    remove(TEMP_ELF);
+    return 0;
+}
+
+static void benchPlan(FILE *json)
+{
+uploadPlan_t    plan;
+int             i, withBase, runs, first = 1;
+double          t, best, total;
+
+    fprintf(stderr, "%-8s %-12s %9s %12s %12s\n", "plan", "base", "bytes", "best us", "blocks");
+    fprintf(json, "  \"plan\": [");
+    for(i = 0; imageSizes[i] != 0; i++){
+        makeImage(image, imageSizes[i], i);
+        memcpy(base, image, sizeof(base));
+        base[imageSizes[i] / 2] ^= 1;   /* one page changed */
+        for(withBase = 0; withBase < 2; withBase++){
+            for(runs = 0, best = 1e9, total = 0; keepRunning(runs, total); runs++){
+                t = getTime();
+                makeUploadPlan(&plan, image, 0, imageSizes[i], 128, withBase ? base : NULL, 0);
+                t = getTime() - t;
+                freeUploadPlan(&plan);
+                total += t;
+                if(best > t)
+                    best = t;
+            }
+            fprintf(stderr, "%-8s %-12s %9d %12.3f %12d\n", "", withBase ? "yes" : "no", imageSizes[i], best * 1e6, plan.reportsToSend);
+            fprintf(json, "%s\n    {\"base\": %s, \"bytes\": %d, \"seconds\": %.9f, \"reports\": %d}",
+                first ? "" : ",", withBase ? "true" : "false", imageSizes[i], best, plan.reportsToSend);
+            first = 0;
+        }
+    }
+    fprintf(json, "\n  ],\n");
+}
+
+static int  benchUpload(FILE *json)
+{
+mcuProfile_t        *profile;
+throughputModel_t   *model = findThroughputModel("boothid");
+uploadPlan_t        plan;
+int                 i, size, runs;
+double              t, best, total;
+
+    fprintf(stderr, "%-8s %-12s %9s %12s %12s\n", "upload", "mcu", "bytes", "best ms", "device s");
+    fprintf(json, "  \"upload\": [");
+    for(i = 0; uploadMcus[i] != NULL; i++){
+        profile = findMcuProfile(uploadMcus[i]);
+        size = profile->flashSize - model->bootLoaderSize;
+        if(size > 65536)
+            size = 65536;
+        makeImage(image, size, i);
+        for(runs = 0, best = 1e9, total = 0; keepRunning(runs, total); runs++){
+            startSimulation(uploadMcus[i], "boothid", 0);
+            t = getTime();
+            if(uploadData(image, 0, size, NULL, 1, NULL) != 0)
+                return 1;
+            t = getTime() - t;
+            total += t;
+            if(best > t)
+                best = t;
+        }
+        if(memcmp(usbSimulatedFlash(NULL), image, size) != 0){
+            fprintf(stderr, "%s: flash differs from image\n", uploadMcus[i]);
+            return 1;
+        }
+        makeUploadPlan(&plan, image, 0, size, profile->pageSize, NULL, 0);
+        freeUploadPlan(&plan);
+        fprintf(stderr, "%-8s %-12s %9d %12.3f %12.3f\n", "", uploadMcus[i], size, best * 1e3, estimateUploadTime(&plan, model));
+        fprintf(json, "%s\n    {\"mcu\": \"%s\", \"pageSize\": %d, \"bytes\": %d, \"reports\": %d, \"seconds\": %.9f, \"modelSeconds\": %.6f}",
+            i > 0 ? "," : "", uploadMcus[i], profile->pageSize, size, plan.reportsToSend, best, estimateUploadTime(&plan, model));
+    }
+    fprintf(json, "\n  ]\n");
+    return 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+int main(int argc, char **argv)
+{
+char    *output = "bench.json";
+FILE    *json;
+int     err;
+
+    if(argc == 3 && strcmp(argv[1], "-o") == 0){
+        output = argv[2];
+    }else if(argc != 1){
+        fprintf(stderr, "usage: %s [-o <json-file>]\n", argv[0]);
+        return 1;
+    }
+    if((json = fopen(output, "w")) == NULL){
+        fprintf(stderr, "error creating %s\n", output);
+        return 1;
+    }
+    fprintf(json, "{\n  \"benchmark\": \"hidbootbench\",\n  \"version\": 1,\n");
+    err = benchParse(json);
+    if(!err){
+        benchPlan(json);
+        err = benchUpload(json);
+    }
+    fprintf(json, "}\n");
+    fclose(json);
+    if(err){
+        remove(output);
+        return 1;
+    }
+    fprintf(stderr, "Results written to %s\n", output);
+    return 0;
+}
+
+/* ------------------------------------------------------------------------- */
@@ -0,0 +1,462 @@
+/* Name: hidbootmon.c
+ * Project: AVR bootloader HID
+ * Author: bootloadHID contributors
+ * Creation Date: 2026-10-19
+ * Tabsize: 4
+ * License: Proprietary, free under certain conditions. See Documentation.
+ * This Revision: $Id$
+ */
+
+/*
+General Description:
+This is an offline analyzer for Linux usbmon captures of HIDBoot sessions.
+It reads the text format of /sys/kernel/debug/usb/usbmon/<bus>u (and the
+older <bus>t format) or pcap files as written by tcpdump or Wireshark on a
+usbmonX interface. The HID class requests of the boot loader (GET_REPORT and
+SET_REPORT of feature reports) are extracted and the upload is rebuilt:
+
+- the timeline of reports with the latency from setup to status and the
+  idle time of the bus before each report,
+- per flash page: the reports, their latency and the time the device was
+  busy programming,
+- a summary of where the time went: host (gaps between transfers), transfer
+  and device programming.
+
+usbmon sees neither NAKs nor the bus, so the device programming time is
+estimated as the latency of a data report in excess of the pure transfer
+time. Both boot loaders erase a page when its first block arrives and write
+it after the last one, so no data report is free of programming time. The
+transfer time is therefore derived from the device info request: its latency
+is divided by its 3 transactions (setup, data, status) and multiplied by the
+transactions of a data report, which depend on the endpoint 0 packet size
+(from the device descriptor if it was captured, "-m" or 8). If the capture
+has no device info request, the fastest data report is used instead.
+
+The text format has the time in microseconds modulo 4096 seconds (the kernel
+keeps 12 bits of the seconds), so a capture may wrap around; this is undone.
+
+Usage: hidbootmon [-v] [-d <bus>:<dev>] [-p <page size>] [-m <packet size>] <capture>
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#define USBRQ_GET_DESCRIPTOR    0x06
+#define USBRQ_HID_GET_REPORT    0x01
+#define USBRQ_HID_SET_REPORT    0x09
+
+#define DATA_REPORT_SIZE        132 /* report ID, address and 128 bytes */
+
+#define LINKTYPE_USB_LINUX          189 /* 48 byte header */
+#define LINKTYPE_USB_LINUX_MMAPPED  220 /* 64 byte header */
+
+/* ------------------------------------------------------------------------- */
+
+typedef struct transfer{
+    unsigned long long  tag;        /* URB address, matches submit and completion */
+    int                 bus, device;
+    double              submitted, completed;   /* seconds */
+    int                 done;
+    int                 request;    /* USBRQ_HID_* or USBRQ_GET_DESCRIPTOR */
+    int                 reportId;
+    int                 address;    /* for data reports, -1 otherwise */
+    int                 status;
+    unsigned char       data[8];    /* start of the report */
+    int                 dataLen;
+}transfer_t;
+
+static transfer_t   *transfers;
+static int          numTransfers, maxTransfers;
+static int          filterBus = -1, filterDevice = -1;
+
+/* ------------------------------------------------------------------------- */
+
+static transfer_t   *findPending(unsigned long long tag)
+{
+int i;
+
+    for(i = numTransfers - 1; i >= 0; i--){
+        if(transfers[i].tag == tag && !transfers[i].done)
+            return &transfers[i];
+    }
+    return NULL;
+}
+
+static void submitEvent(unsigned long long tag, double time, int bus, int device, unsigned char *setup, unsigned char *data, int dataLen)
+{
+transfer_t  *t;
+
+    /* only class requests for feature reports and the device descriptor */
+    if(setup[0] == 0x80 && setup[1] == USBRQ_GET_DESCRIPTOR && setup[3] == 1){
+        /* device descriptor, for the packet size */
+    }else if(setup[0] != 0x21 && setup[0] != 0xa1){
+        return;
+    }else if((setup[1] != USBRQ_HID_SET_REPORT && setup[1] != USBRQ_HID_GET_REPORT) || setup[3] != 3){
+        return;
+    }
+    if((filterBus >= 0 && bus != filterBus) || (filterDevice >= 0 && device != filterDevice))
+        return;
+    if(numTransfers >= maxTransfers){
+        maxTransfers = maxTransfers * 2 + 256;
+        transfers = realloc(transfers, maxTransfers * sizeof(transfer_t));
+    }
+    t = &transfers[numTransfers++];
+    memset(t, 0, sizeof(*t));
+    t->tag = tag;
+    t->bus = bus;
+    t->device = device;
+    t->submitted = time;
+    t->request = setup[1];
+    t->reportId = setup[2];
+    t->address = -1;
+    if(t->request == USBRQ_HID_SET_REPORT && dataLen >= 4){
+        memcpy(t->data, data, dataLen < sizeof(t->data) ? dataLen : sizeof(t->data));
+        t->dataLen = dataLen;
+        if(t->reportId == 2)
+            t->address = data[1] | (data[2] << 8) | (data[3] << 16);
+    }
+}
+
+static void completeEvent(unsigned long long tag, double time, int status, unsigned char *data, int dataLen)
+{
+transfer_t  *t;
+
+    if((t = findPending(tag)) == NULL)
+        return;     /* not a HIDBoot request or submitted before the capture */
+    t->completed = time;
+    t->status = status;
+    t->done = 1;
+    if(t->request != USBRQ_HID_SET_REPORT){
+        memcpy(t->data, data, dataLen < sizeof(t->data) ? dataLen : sizeof(t->data));
+        t->dataLen = dataLen;
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+static int  parseHexBytes(char *s, unsigned char *buffer, int maxLen)
+/* parses usbmon data words such as "01800000 800000" */
+{
+int     len = 0, value;
+
+    while(*s != 0 && len < maxLen){
+        if(*s == ' ' || *s == '\n' || *s == '\r'){
+            s++;
+            continue;
+        }
+        if(sscanf(s, "%2x", &value) != 1)
+            break;
+        buffer[len++] = value;
+        s += 2;
+    }
+    return len;
+}
+
+static int  readText(FILE *input)
+{
+char                line[1024], type, *p, *field[8];
+unsigned long long  tag;
+unsigned long       timestamp, lastTimestamp = 0;
+double              wrapped = 0, time;
+unsigned char       setup[8], data[64];
+unsigned            requestType, request, wValue, wIndex, wLength;
+int                 n, numFields, bus, device, dataLen, status;
+
+    while(fgets(line, sizeof(line), input) != NULL){
+        if(sscanf(line, "%llx %lu %c %n", &tag, &timestamp, &type, &n) < 3)
+            continue;
+        if(lastTimestamp > timestamp && lastTimestamp - timestamp > 2048000000UL)
+            wrapped += 4096;
+        lastTimestamp = timestamp;
+        time = wrapped + timestamp * 1e-6;
+        p = line + n;
+        /* address word: "Ci:1:003:0" (u format) or "Ci:003:0" (t format) */
+        if(p[0] != 'C' || (p[1] != 'i' && p[1] != 'o'))
+            continue;   /* not a control transfer */
+        for(numFields = 0; numFields < 8; ){
+            field[numFields++] = p;
+            p += strcspn(p, ": ");
+            if(*p != ':')
+                break;
+            *p++ = 0;
+        }
+        if(*p != 0)
+            *p++ = 0;
+        bus = numFields == 4 ? atoi(field[1]) : 0;
+        device = atoi(field[numFields - 2]);
+        dataLen = 0;
+        if(type == 'S'){
+            if(sscanf(p, "s %x %x %x %x %x %n", &requestType, &request, &wValue, &wIndex, &wLength, &n) < 5)
+                continue;
+            setup[0] = requestType;
+            setup[1] = request;
+            setup[2] = wValue;
+            setup[3] = wValue >> 8;
+            setup[4] = wIndex;
+            setup[5] = wIndex >> 8;
+            setup[6] = wLength;
+            setup[7] = wLength >> 8;
+            p += n;
+            if((p = strchr(p, '=')) != NULL)
+                dataLen = parseHexBytes(p + 1, data, sizeof(data));
+            submitEvent(tag, time, bus, device, setup, data, dataLen);
+        }else if(type == 'C' || type == 'E'){
+            status = type == 'E' ? -1 : atoi(p);
+            if((p = strchr(p, '=')) != NULL)
+                dataLen = parseHexBytes(p + 1, data, sizeof(data));
+            completeEvent(tag, time, status, data, dataLen);
+        }
+    }
+    return 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static unsigned getInt(unsigned char *p, int numBytes, int bigEndian)
+{
+unsigned    value = 0;
+int         i;
+
+    for(i = 0; i < numBytes; i++)
+        value |= (unsigned)p[bigEndian ? numBytes - 1 - i : i] << (8 * i);
+    return value;
+}
+
+static int  readPcap(FILE *input, char *file)
+{
+unsigned char       header[24], record[16], *packet = NULL;
+unsigned            magic, linkType, length, headerLen, dataLen;
+int                 bigEndian, nanoseconds, status;
+unsigned long long  tag;
+double              time;
+
+    if(fread(header, 1, sizeof(header), input) != sizeof(header))
+        return 1;
+    magic = getInt(header, 4, 0);
+    bigEndian = magic == 0xd4c3b2a1 || magic == 0x4d3cb2a1;
+    nanoseconds = magic == 0xa1b23c4d || magic == 0x4d3cb2a1;
+    linkType = getInt(header + 20, 4, bigEndian);
+    if(linkType == LINKTYPE_USB_LINUX){
+        headerLen = 48;
+    }else if(linkType == LINKTYPE_USB_LINUX_MMAPPED){
+        headerLen = 64;
+    }else{
+        fprintf(stderr, "%s: link type %u is not Linux usbmon\n", file, linkType);
+        return 1;
+    }
+    packet = malloc(65536);
+    while(fread(record, 1, sizeof(record), input) == sizeof(record)){
+        length = getInt(record + 8, 4, bigEndian);
+        if(length > 65536 || fread(packet, 1, length, input) != length)
+            break;
+        if(length < headerLen || packet[9] != 2)
+            continue;   /* not a control transfer */
+        time = getInt(record, 4, bigEndian) + getInt(record + 4, 4, bigEndian) * (nanoseconds ? 1e-9 : 1e-6);
+        /* the usbmon header is in the byte order of the capturing host, we assume little endian */
+        tag = getInt(packet, 4, 0) | (unsigned long long)getInt(packet + 4, 4, 0) << 32;
+        dataLen = length - headerLen;
+        if(packet[8] == 'S'){
+            if(packet[14] != 0)
+                continue;   /* no setup packet */
+            submitEvent(tag, time, getInt(packet + 12, 2, 0), packet[11], packet + 40, packet + headerLen, dataLen);
+        }else{
+            status = packet[8] == 'E' ? -1 : (int)getInt(packet + 28, 4, 0);
+            completeEvent(tag, time, status, packet + headerLen, dataLen);
+        }
+    }
+    free(packet);
+    return 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static double   gapBefore(int i)
+/* returns the time the bus was idle before transfer 'i' */
+{
+double  gap;
+
+    if(i == 0)
+        return 0;
+    gap = transfers[i].submitted - transfers[i - 1].completed;
+    return gap > 0 ? gap : 0;
+}
+
+static double   transferTime(int maxPacket, int *fromInfo)
+/* returns the estimated pure transfer time of a data report */
+{
+transfer_t  *t;
+int         i;
+double      latency, fastest = 1e9, info = 1e9;
+
+    for(i = 0; i < numTransfers; i++){
+        t = &transfers[i];
+        latency = t->completed - t->submitted;
+        if(t->status != 0)
+            continue;
+        if(t->address >= 0 && fastest > latency)
+            fastest = latency;
+        if(t->request == USBRQ_HID_GET_REPORT && t->reportId == 1 && info > latency)
+            info = latency;
+    }
+    if((*fromInfo = info < 1e9))
+        return info / 3 * (2 + (DATA_REPORT_SIZE + maxPacket - 1) / maxPacket);
+    return fastest;
+}
+
+static void analyze(int pageSize, int maxPacket, int verbose)
+{
+transfer_t  *t;
+int         i, mask, page, pageReports, dataReports = 0, errors = 0, flashSize = 0, fromInfo;
+double      minLatency, latency, start, end;
+double      pageLatency, pageBusy, pageGap, totalLatency = 0, totalBusy = 0, totalGap = 0;
+
+    /* drop requests without completion (capture ended), take the packet size from the descriptor */
+    for(i = page = 0; i < numTransfers; i++){
+        t = &transfers[i];
+        if(t->request == USBRQ_GET_DESCRIPTOR){
+            if(t->done && t->dataLen >= 8 && maxPacket == 0)
+                maxPacket = t->data[7];
+        }else if(t->done){
+            transfers[page++] = *t;
+        }
+    }
+    numTransfers = page;
+    if(numTransfers == 0){
+        printf("No HIDBoot requests found.\n");
+        return;
+    }
+    if(maxPacket == 0)
+        maxPacket = 8;
+    for(i = 0; i < numTransfers; i++){
+        t = &transfers[i];
+        if(t->request == USBRQ_HID_GET_REPORT && t->reportId == 1 && t->dataLen >= 7){
+            if(pageSize == 0)
+                pageSize = t->data[1] | (t->data[2] << 8);
+            flashSize = t->data[3] | (t->data[4] << 8) | (t->data[5] << 16) | (t->data[6] << 24);
+        }
+    }
+    if(pageSize == 0)
+        pageSize = 128;
+    mask = pageSize < 128 ? 127 : pageSize - 1;
+    minLatency = transferTime(maxPacket, &fromInfo);
+    start = transfers[0].submitted;
+    end = transfers[numTransfers - 1].completed;
+    printf("Device %d:%d, page size %d", transfers[0].bus, transfers[0].device, pageSize);
+    if(flashSize != 0)
+        printf(", flash size %d", flashSize);
+    printf(", packet size %d\n", maxPacket);
+    printf("Transfer time of a data report: %.3f ms (from %s)\n", minLatency * 1e3, fromInfo ? "device info request" : "fastest data report");
+    if(verbose){
+        printf("\n    time ms  latency ms   gap ms  request\n");
+        for(i = 0; i < numTransfers; i++){
+            t = &transfers[i];
+            printf("%11.3f  %10.3f  %7.3f  %s report %d", (t->submitted - start) * 1e3, (t->completed - t->submitted) * 1e3,
+                gapBefore(i) * 1e3, t->request == USBRQ_HID_SET_REPORT ? "SET" : "GET", t->reportId);
+            if(t->address >= 0)
+                printf(" address 0x%05x", t->address);
+            if(t->status != 0)
+                printf(" status %d", t->status);
+            printf("\n");
+        }
+    }
+    printf("\nPage     reports  latency ms  busy ms   gap ms\n");
+    for(i = 0; i < numTransfers; ){
+        t = &transfers[i];
+        latency = t->completed - t->submitted;
+        totalLatency += latency;
+        totalGap += gapBefore(i);
+        if(t->status != 0)
+            errors++;
+        if(t->address < 0){
+            i++;
+            continue;
+        }
+        page = t->address & ~mask;
+        pageReports = 0;
+        pageLatency = pageBusy = pageGap = 0;
+        for(;;){
+            pageReports++;
+            pageLatency += latency;
+            pageBusy += latency > minLatency ? latency - minLatency : 0;
+            pageGap += gapBefore(i);
+            if(++i >= numTransfers || transfers[i].address < 0 || (transfers[i].address & ~mask) != page)
+                break;
+            t = &transfers[i];
+            latency = t->completed - t->submitted;
+            totalLatency += latency;
+            totalGap += gapBefore(i);
+            if(t->status != 0)
+                errors++;
+        }
+        printf("0x%05x  %7d  %10.3f  %7.3f  %7.3f\n", page, pageReports, pageLatency * 1e3, pageBusy * 1e3, pageGap * 1e3);
+        dataReports += pageReports;
+        totalBusy += pageBusy;
+    }
+    printf("\nSession: %d requests (%d data reports, %d failed) in %.3f ms\n", numTransfers, dataReports, errors, (end - start) * 1e3);
+    printf("  host (bus idle between requests)  %10.3f ms\n", totalGap * 1e3);
+    printf("  transfers                         %10.3f ms\n", (totalLatency - totalBusy) * 1e3);
+    printf("  device programming (estimated)    %10.3f ms\n", totalBusy * 1e3);
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void usage(char *name)
+{
+    fprintf(stderr, "usage: %s [-v] [-d <bus>:<dev>] [-p <page size>] [-m <packet size>] <usbmon text or pcap file>\n", name);
+}
+
+int main(int argc, char **argv)
+{
+FILE            *input;
+char            *file = NULL;
+unsigned char   magic[4];
+int             i, verbose = 0, pageSize = 0, maxPacket = 0, err;
+
+    for(i = 1; i < argc; i++){
+        if(strcmp(argv[i], "-v") == 0){
+            verbose = 1;
+        }else if(strcmp(argv[i], "-d") == 0 && i + 1 < argc){
+            if(sscanf(argv[++i], "%d:%d", &filterBus, &filterDevice) != 2){
+                usage(argv[0]);
+                return 1;
+            }
+        }else if(strcmp(argv[i], "-p") == 0 && i + 1 < argc){
+            pageSize = atoi(argv[++i]);
+        }else if(strcmp(argv[i], "-m") == 0 && i + 1 < argc){
+            maxPacket = atoi(argv[++i]);
+        }else if(argv[i][0] == '-' || file != NULL){
+            usage(argv[0]);
+            return 1;
+        }else{
+            file = argv[i];
+        }
+    }
+    if(file == NULL){
+        usage(argv[0]);
+        return 1;
+    }
+    if((input = fopen(file, "rb")) == NULL){
+        fprintf(stderr, "error opening %s: %s\n", file, strerror(errno));
+        return 1;
+    }
+    if(fread(magic, 1, sizeof(magic), input) != sizeof(magic))
+        memset(magic, 0, sizeof(magic));
+    rewind(input);
+    if(getInt(magic, 4, 0) == 0xa1b2c3d4 || getInt(magic, 4, 1) == 0xa1b2c3d4
+            || getInt(magic, 4, 0) == 0xa1b23c4d || getInt(magic, 4, 1) == 0xa1b23c4d){
+        err = readPcap(input, file);
+    }else{
+        err = readText(input);
+    }
+    fclose(input);
+    if(err){
+        fprintf(stderr, "%s: cannot read capture\n", file);
+        return 1;
+    }
+    analyze(pageSize, maxPacket, verbose);
+    return 0;
+}
+
+/* ------------------------------------------------------------------------- */
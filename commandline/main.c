@@ -12,22 +12,24 @@
 #include <string.h>
 #include <stdlib.h>
 #include <errno.h>
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#include <unistd.h>
+#endif
 #include "usbcalls.h"
+#include "bootloadHID.h"
 
-#define IDENT_VENDOR_NUM        0x16c0
-#define IDENT_VENDOR_STRING     "obdev.at"
-#define IDENT_PRODUCT_NUM       1503
-#define IDENT_PRODUCT_STRING    "HIDBoot"
-
-#ifndef BOOTLOAD_SIZE
-#define BOOTLOAD_SIZE           2048
-#endif
+#define UPLOAD_RETRIES  3   /* attempts per page after a failed data report */
+#define READBACK_LIMIT  4   /* stop reading pages back after this many differed in a row */
 
 /* ------------------------------------------------------------------------- */
 
-static char dataBuffer[65536 + 256];    /* buffer for file data */
+#ifndef NO_MAIN
+static char dataBuffer[IMAGE_BUFFER_SIZE];    /* buffer for file data */
 static int  startAddress, endAddress;
-static char leaveBootLoader = 0;
+#endif
 
 /* ------------------------------------------------------------------------- */
 
@@ -54,7 +56,7 @@ char    temp[9];
 
 /* ------------------------------------------------------------------------- */
 
-static int  parseIntelHex(char *hexfile, char buffer[65536 + 256], int *startAddr, int *endAddr)
+int parseIntelHex(char *hexfile, char buffer[IMAGE_BUFFER_SIZE], int *startAddr, int *endAddr)
 {
 int     address, base, d, segment, i, lineLen, sum;
 FILE    *input;
@@ -93,6 +95,148 @@ FILE    *input;
 
 /* ------------------------------------------------------------------------- */
 
+static unsigned getElfInt(unsigned char *p, int numBytes)
+{
+unsigned    value = 0;
+
+    while(numBytes--)
+        value = (value << 8) | p[numBytes];
+    return value;
+}
+
+static int  parseElf(char *elffile, char buffer[IMAGE_BUFFER_SIZE], int *startAddr, int *endAddr)
+{
+unsigned char   header[52], segment[32];
+unsigned        phoff, phentsize, phnum, i, type, offset, paddr, filesz;
+FILE            *input;
+int             err = 1;
+
+    input = fopen(elffile, "rb");
+    if(input == NULL){
+        fprintf(stderr, "error opening %s: %s\n", elffile, strerror(errno));
+        return 1;
+    }
+    if(fread(header, 1, sizeof(header), input) != sizeof(header) || header[4] != 1 || header[5] != 1){
+        fprintf(stderr, "%s: not a 32 bit little endian ELF file\n", elffile);
+        goto done;
+    }
+    phoff = getElfInt(header + 28, 4);
+    phentsize = getElfInt(header + 42, 2);
+    phnum = getElfInt(header + 44, 2);
+    for(i = 0; i < phnum; i++){
+        if(fseek(input, phoff + i * phentsize, SEEK_SET) != 0 || fread(segment, 1, sizeof(segment), input) != sizeof(segment)){
+            fprintf(stderr, "%s: truncated program header\n", elffile);
+            goto done;
+        }
+        type = getElfInt(segment, 4);
+        offset = getElfInt(segment + 4, 4);
+        paddr = getElfInt(segment + 12, 4);
+        filesz = getElfInt(segment + 16, 4);
+        /* only loadable segments in flash; RAM, EEPROM and fuses are at 0x800000 and up */
+        if(type != 1 || filesz == 0 || paddr >= 0x800000)
+            continue;
+        if(filesz > IMAGE_BUFFER_SIZE - 256 || paddr > IMAGE_BUFFER_SIZE - 256 - filesz){   /* no overflow of the sum */
+            fprintf(stderr, "%s: segment at 0x%x exceeds 64 kB\n", elffile, paddr);
+            goto done;
+        }
+        if(fseek(input, offset, SEEK_SET) != 0 || fread(buffer + paddr, 1, filesz, input) != filesz){
+            fprintf(stderr, "%s: truncated segment at 0x%x\n", elffile, paddr);
+            goto done;
+        }
+        if(*startAddr > paddr)
+            *startAddr = paddr;
+        if(*endAddr < paddr + filesz)
+            *endAddr = paddr + filesz;
+    }
+    err = 0;
+done:
+    fclose(input);
+    return err;
+}
+
+int parseImageFile(char *file, char buffer[IMAGE_BUFFER_SIZE], int *startAddr, int *endAddr)
+{
+FILE    *input;
+char    magic[4] = {0};
+int     err, isElf;
+double  t = traceFile != NULL ? getTime() : 0;
+
+    if((input = fopen(file, "rb")) != NULL){
+        if(fread(magic, 1, sizeof(magic), input) != sizeof(magic))
+            magic[0] = 0;
+        fclose(input);
+    }
+    isElf = memcmp(magic, "\177ELF", 4) == 0;
+    if(isElf){
+        err = parseElf(file, buffer, startAddr, endAddr);
+    }else{
+        err = parseIntelHex(file, buffer, startAddr, endAddr);
+    }
+    if(traceFile != NULL)
+        traceSpan(TRACK_PARSE, isElf ? "parseElf" : "parseIntelHex", t, getTime(), NULL);
+    return err;
+}
+
+/* ------------------------------------------------------------------------- */
+
+double  getTime(void)
+{
+#ifdef WIN32
+LARGE_INTEGER   frequency, counter;
+
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart / frequency.QuadPart;
+#else
+struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+#endif
+}
+
+void    sleepMs(int milliseconds)
+{
+#ifdef WIN32
+    Sleep(milliseconds);
+#else
+    usleep(milliseconds * 1000);
+#endif
+}
+
+int waitForBootLoader(char *location, double timeout)
+{
+usbDevice_t *dev;
+double      deadline = getTime() + timeout;
+
+    for(;;){
+        if(usbOpenDeviceAt(&dev, location, IDENT_VENDOR_NUM, IDENT_VENDOR_STRING, IDENT_PRODUCT_NUM, IDENT_PRODUCT_STRING, 1) == 0){
+            usbCloseDevice(dev);
+            return 0;
+        }
+        if(timeout >= 0 && getTime() > deadline)
+            return USB_ERROR_NOTFOUND;
+        sleepMs(100);
+    }
+}
+
+void    printJsonString(FILE *fp, char *s)
+{
+    putc('"', fp);
+    for(; *s != 0; s++){
+        if(*s == '"' || *s == '\\'){
+            fprintf(fp, "\\%c", *s);
+        }else if((unsigned char)*s < 0x20){
+            fprintf(fp, "\\u%04x", *s);
+        }else{
+            putc(*s, fp);
+        }
+    }
+    putc('"', fp);
+}
+
+/* ------------------------------------------------------------------------- */
+
 char    *usbErrorMessage(int errCode)
 {
 static char buffer[80];
@@ -102,6 +246,7 @@ static char buffer[80];
         case USB_ERROR_NOTFOUND:    return "The specified device was not found";
         case USB_ERROR_BUSY:        return "The device is used by another application";
         case USB_ERROR_IO:          return "Communication error with device";
+        case USB_ERROR_TIMEOUT:     return "Timeout waiting for the device";
         default:
             sprintf(buffer, "Unknown USB error %d", errCode);
             return buffer;
@@ -109,7 +254,7 @@ static char buffer[80];
     return NULL;    /* not reached */
 }
 
-static int  getUsbInt(char *buffer, int numBytes)
+int getUsbInt(char *buffer, int numBytes)
 {
 int shift = 0, value = 0, i;
 
@@ -121,7 +266,7 @@ int shift = 0, value = 0, i;
     return value;
 }
 
-static void setUsbInt(char *buffer, int value, int numBytes)
+void    setUsbInt(char *buffer, int value, int numBytes)
 {
 int i;
 
@@ -133,132 +278,548 @@ int i;
 
 /* ------------------------------------------------------------------------- */
 
-typedef struct deviceInfo{
-    char    reportId;
-    char    pageSize[2];
-    char    flashSize[4];
-}deviceInfo_t;
+int getDeviceCaps(usbDevice_t *dev, deviceCaps_t *caps)
+{
+int     err, len;
+union{
+    char            bytes[1];
+    deviceInfoExt_t ext;
+    deviceData_t    data;   /* the report may grow, allow for it */
+}       buffer;
 
-typedef struct deviceData{
-    char    reportId;
-    char    address[3];
-    char    data[128];
-}deviceData_t;
+    len = sizeof(buffer);
+    if((err = usbGetReport(dev, USB_HID_REPORT_TYPE_FEATURE, 1, buffer.bytes, &len)) != 0)
+        return err;
+    if(len < sizeof(buffer.ext.info)){
+        fprintf(stderr, "Not enough bytes in device info report (%d instead of %d)\n", len, (int)sizeof(buffer.ext.info));
+        return -1;
+    }
+    memset(caps, 0, sizeof(*caps));
+    caps->protocolVersion = 1;
+    caps->pageSize = getUsbInt(buffer.ext.info.pageSize, 2);
+    caps->flashSize = getUsbInt(buffer.ext.info.flashSize, 4);
+    caps->maxDataSize = sizeof(buffer.data.data);
+    if(len >= sizeof(buffer.ext)){
+        caps->protocolVersion = buffer.ext.protocolVersion & 0xff;
+        caps->bootStart = getUsbInt(buffer.ext.bootStart, 4);
+        caps->maxDataSize = getUsbInt(buffer.ext.maxDataSize, 2);
+        caps->features = getUsbInt(buffer.ext.features, 2);
+    }
+    if(len < sizeof(buffer.ext) + 2)
+        caps->features &= ~FEATURE_SKIP;
+#ifdef WIN32
+    /* HidD_SetFeature() rejects reports shorter than the descriptor says,
+     * so the last page is sent completely and padded by the host instead */
+    caps->features &= ~FEATURE_SHORT_DATA;
+#endif
+    if(caps->features & FEATURE_SKIP)
+        caps->skippedPages = getUsbInt(buffer.bytes + sizeof(buffer.ext), 2);
+    if(caps->bootStart <= 0 || caps->bootStart > caps->flashSize)
+        caps->bootStart = caps->flashSize - BOOTLOAD_SIZE;
+    return 0;
+}
+
+int sendExitReport(usbDevice_t *dev)
+{
+int     len;
+union{
+    char            bytes[1];
+    deviceInfoExt_t ext;
+    deviceData_t    data;   /* see getDeviceCaps() */
+}       buffer;
 
-static int uploadData(char *dataBuffer, int startAddr, int endAddr)
+    /* the device returns report 1 at the length its descriptor declares */
+    len = sizeof(buffer);
+    if(usbGetReport(dev, USB_HID_REPORT_TYPE_FEATURE, 1, buffer.bytes, &len) != 0 || len < sizeof(deviceInfo_t))
+        len = sizeof(deviceInfo_t);
+    memset(&buffer, 0, sizeof(buffer));
+    buffer.ext.info.reportId = 1;
+    return usbSetReport(dev, USB_HID_REPORT_TYPE_FEATURE, buffer.bytes, len);
+}
+
+static int  readPage(usbDevice_t *dev, int address, int size, char *page, int *readAddress)
+/* reads 'size' bytes at 'address' through report 3; returns 0 on success */
+{
+int     err, len, i;
+union{
+    char            bytes[1];
+    deviceData_t    data;
+}       buffer;
+
+    if(*readAddress != address){
+        memset(&buffer, 0, sizeof(buffer));
+        buffer.data.reportId = 3;
+        setUsbInt(buffer.data.address, address, 3);
+        if((err = usbSetReport(dev, USB_HID_REPORT_TYPE_FEATURE, buffer.bytes, sizeof(buffer.data))) != 0)
+            return err;
+        *readAddress = address;
+    }
+    for(i = 0; i < size; i += sizeof(buffer.data.data)){
+        len = sizeof(buffer.data);
+        if((err = usbGetReport(dev, USB_HID_REPORT_TYPE_FEATURE, 3, buffer.bytes, &len)) != 0)
+            return err;
+        if(len < sizeof(buffer.data) || getUsbInt(buffer.data.address, 3) != address + i)
+            return -1;
+        memcpy(page + i, buffer.data.data, sizeof(buffer.data.data));
+        *readAddress += sizeof(buffer.data.data);
+    }
+    return 0;
+}
+
+static int  writePatch(usbDevice_t *dev, char *dataBuffer, int address, int length)
+/* replaces 'length' bytes at 'address' through report 7; returns 0 on success */
+{
+union{
+    char            bytes[1];
+    devicePatch_t   patch;
+}       buffer;
+
+    memset(&buffer, 0xff, sizeof(buffer));
+    buffer.patch.reportId = 7;
+    setUsbInt(buffer.patch.address, address, 3);
+    buffer.patch.length = length;
+    memcpy(buffer.patch.data, dataBuffer + address, length);
+    /* always the full report, Windows rejects shorter ones */
+    return usbSetReport(dev, USB_HID_REPORT_TYPE_FEATURE, buffer.bytes, sizeof(buffer.patch));
+}
+
+/* ------------------------------------------------------------------------- */
+
+static double   timeIfUsed(void)
+/* getTime() for the trace and the statistics, which cost nothing when off */
+{
+    return traceFile != NULL || runStats != NULL ? getTime() : 0;
+}
+
+int uploadData(char *dataBuffer, int startAddr, int endAddr, char *location, int leaveBootLoader, char *baseData)
 {
 usbDevice_t *dev = NULL;
-int         err = 0, len, mask, pageSize, deviceSize;
+int         err = 0, i, j, len, mask, pageRetries = 0, track = 0, readBack = 0, readAddress = -1, pagesDiffering = 0;
+int         status = 0, lastPage = -1, patchAddress = 0, patchLength = 0;
+double      t, startTime = timeIfUsed();
+char        args[64], page[1024];
+deviceCaps_t    caps, capsAfter;
+uploadPlan_t    plan;
+uploadBlock_t   *block;
 union{
     char            bytes[1];
-    deviceInfo_t    info;
     deviceData_t    data;
 }           buffer;
 
-    if((err = usbOpenDevice(&dev, IDENT_VENDOR_NUM, IDENT_VENDOR_STRING, IDENT_PRODUCT_NUM, IDENT_PRODUCT_STRING, 1)) != 0){
+    memset(&plan, 0, sizeof(plan));
+    if(traceFile != NULL){
+        snprintf(args, sizeof(args), "device %s", location != NULL ? location : "any");
+        track = traceTrack(args);
+    }
+    if(runStats != NULL){   /* enumeration is part of opening, measure it separately */
+        t = getTime();
+        usbCountDevices(IDENT_VENDOR_NUM, IDENT_PRODUCT_NUM);
+        statsRecord(STATS_ENUMERATE, getTime() - t);
+    }
+    t = timeIfUsed();
+    err = usbOpenDeviceAt(&dev, location, IDENT_VENDOR_NUM, IDENT_VENDOR_STRING, IDENT_PRODUCT_NUM, IDENT_PRODUCT_STRING, 1);
+    statsRecord(STATS_OPEN, timeIfUsed() - t);
+    if(traceFile != NULL)
+        traceSpan(track, "usbOpenDevice", t, getTime(), NULL);
+    if(err != 0){
         fprintf(stderr, "Error opening HIDBoot device: %s\n", usbErrorMessage(err));
         goto errorOccurred;
     }
-    len = sizeof(buffer);
     if(endAddr > startAddr){    // we need to upload data
-        if((err = usbGetReport(dev, USB_HID_REPORT_TYPE_FEATURE, 1, buffer.bytes, &len)) != 0){
+        t = timeIfUsed();
+        err = getDeviceCaps(dev, &caps);
+        statsRecord(STATS_INFO, timeIfUsed() - t);
+        if(traceFile != NULL)
+            traceSpan(track, "usbGetReport", t, getTime(), "\"report\": 1");
+        if(err > 0)
             fprintf(stderr, "Error reading page size: %s\n", usbErrorMessage(err));
+        if(err != 0)
             goto errorOccurred;
-        }
-        if(len < sizeof(buffer.info)){
-            fprintf(stderr, "Not enough bytes in device info report (%d instead of %d)\n", len, (int)sizeof(buffer.info));
+        printf("Page size   = %d (0x%x)\n", caps.pageSize, caps.pageSize);
+        printf("Device size = %d (0x%x); %d bytes remaining\n", caps.flashSize, caps.flashSize, caps.bootStart);
+        if(endAddr > caps.bootStart){
+            fprintf(stderr, "Data (%d bytes) exceeds remaining flash size!\n", endAddr);
             err = -1;
             goto errorOccurred;
         }
-        pageSize = getUsbInt(buffer.info.pageSize, 2);
-        deviceSize = getUsbInt(buffer.info.flashSize, 4);
-        printf("Page size   = %d (0x%x)\n", pageSize, pageSize);
-        printf("Device size = %d (0x%x); %d bytes remaining\n", deviceSize, deviceSize, deviceSize - BOOTLOAD_SIZE);
-        if(endAddr > deviceSize - BOOTLOAD_SIZE){
-            fprintf(stderr, "Data (%d bytes) exceeds remaining flash size!\n", endAddr);
+        if(caps.maxDataSize < (int)sizeof(buffer.data.data)){
+            fprintf(stderr, "Device accepts only %d bytes per data report, not supported\n", caps.maxDataSize);
             err = -1;
             goto errorOccurred;
         }
-        if(pageSize < 128){
-            mask = 127;
-        }else{
-            mask = pageSize - 1;
-        }
-        startAddr &= ~mask;                  /* round down */
-        endAddr = (endAddr + mask) & ~mask;  /* round up */
-        printf("Uploading %d (0x%x) bytes starting at %d (0x%x)\n", endAddr - startAddr, endAddr - startAddr, startAddr, startAddr);
-        while(startAddr < endAddr){
+        makeUploadPlan(&plan, dataBuffer, startAddr, endAddr, caps.pageSize, baseData, caps.features);
+        mask = caps.pageSize < (int)sizeof(buffer.data.data) ? (int)sizeof(buffer.data.data) - 1 : caps.pageSize - 1;
+        /* Without a base image, reading a page back costs less than writing
+         * it, as long as some pages are unchanged. Give up if they are not.
+         */
+        readBack = baseData == NULL && (caps.features & FEATURE_READ) && mask < (int)sizeof(page);
+        /* Status reports tell which pages are in flash. Data reports are
+         * synchronous, so they only confirm the last page, see status.c.
+         */
+        status = (caps.features & FEATURE_STATUS) && statusStart(dev) == 0;
+        printf("Uploading %d (0x%x) bytes starting at %d (0x%x)\n", plan.endAddr - plan.startAddr, plan.endAddr - plan.startAddr, plan.startAddr, plan.startAddr);
+        for(i = 0; i < plan.numBlocks; i++){
+            block = &plan.blocks[i];
+            if(block->flags & BLOCK_UNCHANGED)
+                continue;   /* page is already in flash */
+            if((block->address & mask) == 0){
+                patchAddress = block->patchAddress;
+                patchLength = block->patchLength;
+            }
+            if(readBack && (block->address & mask) == 0){
+                t = timeIfUsed();
+                err = readPage(dev, block->address, mask + 1, page, &readAddress);
+                if(traceFile != NULL){
+                    snprintf(args, sizeof(args), "\"report\": 3, \"address\": %d, \"error\": %d", block->address, err);
+                    traceSpan(track, "readPage", t, getTime(), args);
+                }
+                if(err != 0){
+                    readBack = err = 0; /* write everything */
+                }else if(memcmp(page, dataBuffer + block->address, mask + 1) == 0){
+                    for(j = i; j < plan.numBlocks && (plan.blocks[j].address & ~mask) == block->address; j++)
+                        plan.blocks[j].flags |= BLOCK_UNCHANGED;
+                    plan.bytesSkipped += mask + 1;
+                    pagesDiffering = 0;
+                    i = j - 1;
+                    continue;
+                }else{
+                    j = (endAddr + caps.pageSize - 1) & ~(caps.pageSize - 1);   /* see makeUploadPlan() */
+                    if((caps.features & FEATURE_PATCH) && block->address < j && (patchLength = findPatch(dataBuffer + block->address, page, j - block->address < mask + 1 ? j - block->address : mask + 1, caps.pageSize, &patchAddress)) > 0)
+                        patchAddress += block->address;
+                    if(++pagesDiffering >= READBACK_LIMIT)
+                        readBack = 0;
+                }
+            }
+            len = sizeof(buffer.data.data);
+            if(caps.features & FEATURE_SHORT_DATA){
+                if((len = block->length) == 0)
+                    continue;   /* the device pads the page */
+            }
+            if(patchLength > 0){    /* the rest of the page stays as it is */
+                printf("\r0x%05x ... 0x%05x", patchAddress, patchAddress + patchLength);
+                fflush(stdout);
+                t = timeIfUsed();
+                err = writePatch(dev, dataBuffer, patchAddress, patchLength);
+                if(traceFile != NULL){
+                    snprintf(args, sizeof(args), "\"report\": 7, \"address\": %d, \"error\": %d", patchAddress, err);
+                    traceSpan(track, "usbSetReport", t, getTime(), args);
+                }
+                t = timeIfUsed() - t;
+                statsRecord(STATS_BLOCK, t);
+                if(runStats != NULL){
+                    runStats->reports++;
+                    runStats->bytesSent += patchLength;
+                    runStats->uploadTime += t;
+                }
+                if(err != 0){
+                    fprintf(stderr, "\nError uploading patch: %s\n", usbErrorMessage(err));
+                    if(++pageRetries > UPLOAD_RETRIES)
+                        goto errorOccurred;
+                    if(runStats != NULL)
+                        runStats->retries++;
+                    i--;    /* a patch replaces the whole page, send it again */
+                    continue;
+                }
+                lastPage = patchAddress & ~(caps.pageSize - 1);
+                if(status)
+                    statusSent(lastPage);
+                pageRetries = 0;
+                for(j = i; j < plan.numBlocks && (plan.blocks[j].address & ~mask) == block->address; j++)
+                    ;
+                i = j - 1;
+                continue;
+            }
             buffer.data.reportId = 2;
-            memcpy(buffer.data.data, dataBuffer + startAddr, 128);
-            setUsbInt(buffer.data.address, startAddr, 3);
-            printf("\r0x%05x ... 0x%05x", startAddr, startAddr + (int)sizeof(buffer.data.data));
+            memcpy(buffer.data.data, dataBuffer + block->address, len);
+            setUsbInt(buffer.data.address, block->address, 3);
+            printf("\r0x%05x ... 0x%05x", block->address, block->address + len);
             fflush(stdout);
-            if((err = usbSetReport(dev, USB_HID_REPORT_TYPE_FEATURE, buffer.bytes, sizeof(buffer.data))) != 0){
-                fprintf(stderr, "Error uploading data block: %s\n", usbErrorMessage(err));
-                goto errorOccurred;
+            t = timeIfUsed();
+            err = usbSetReport(dev, USB_HID_REPORT_TYPE_FEATURE, buffer.bytes, sizeof(buffer.data) - sizeof(buffer.data.data) + len);
+            if(traceFile != NULL){
+                snprintf(args, sizeof(args), "\"report\": 2, \"address\": %d, \"error\": %d", block->address, err);
+                traceSpan(track, "usbSetReport", t, getTime(), args);
             }
-            startAddr += sizeof(buffer.data.data);
+            t = timeIfUsed() - t;
+            statsRecord(STATS_BLOCK, t);
+            if(runStats != NULL){
+                runStats->reports++;
+                runStats->bytesSent += len;
+                runStats->uploadTime += t;
+            }
+            if(err != 0){
+                fprintf(stderr, "\nError uploading data block: %s\n", usbErrorMessage(err));
+                /* BootHID fills the SPM page buffer with every report of a
+                 * page, and the buffer must not be filled twice. A page can
+                 * only be sent again if a single report carries all of it.
+                 */
+                if(caps.pageSize > (int)sizeof(buffer.data.data) || ++pageRetries > UPLOAD_RETRIES)
+                    goto errorOccurred;
+                if(runStats != NULL)
+                    runStats->retries++;
+                i--;
+                continue;
+            }
+            lastPage = (block->address + len - 1) & ~(caps.pageSize - 1);
+            if(status)
+                statusSent(lastPage);
+            pageRetries = 0;
         }
         printf("\n");
+        if(status){
+            t = timeIfUsed();
+            if(lastPage >= 0 && statusWait(lastPage, STATUS_TIMEOUT) != 0)
+                fprintf(stderr, "Warning: the device did not confirm the last page\n");
+            if(traceFile != NULL){
+                snprintf(args, sizeof(args), "\"address\": %d", lastPage);
+                traceSpan(track, "statusWait", t, getTime(), args);
+            }
+            statusStop();
+            status = 0;
+        }
+        if(plan.bytesSkipped)
+            printf("Skipped %d (0x%x) unchanged bytes\n", plan.bytesSkipped, plan.bytesSkipped);
+        if(runStats != NULL)
+            runStats->bytesSkipped += plan.bytesSkipped;
+        if((caps.features & FEATURE_SKIP) && getDeviceCaps(dev, &capsAfter) == 0){
+            j = (capsAfter.skippedPages - caps.skippedPages) & 0xffff;
+            if(j)
+                printf("Device kept %d unchanged pages\n", j);
+            if(runStats != NULL)
+                runStats->pagesKept += j;
+        }
+        if(runStats != NULL && (caps.features & FEATURE_PERF) && statsReadDevice(dev) != 0)
+            fprintf(stderr, "Warning: could not read the device's counters\n");
     }
     if(leaveBootLoader){
         /* and now leave boot loader: */
-        buffer.info.reportId = 1;
-        usbSetReport(dev, USB_HID_REPORT_TYPE_FEATURE, buffer.bytes, sizeof(buffer.info));
+        t = timeIfUsed();
+        sendExitReport(dev);
+        if(traceFile != NULL)
+            traceSpan(track, "exit", t, getTime(), "\"report\": 1");
         /* Ignore errors here. If the device reboots before we poll the response,
          * this request fails.
          */
     }
 errorOccurred:
+    freeUploadPlan(&plan);
+    if(status)
+        statusStop();
     if(dev != NULL)
         usbCloseDevice(dev);
+    if(traceFile != NULL)
+        traceSpan(track, "uploadData", startTime, getTime(), NULL);
     return err;
 }
 
 /* ------------------------------------------------------------------------- */
 
+#ifndef NO_MAIN   /* defined when the functions above are linked into hidbootbench */
+
+static int  uploadFile(char *file, char *eepromFile, char *registry, int leaveBootLoader)
+{
+    startAddress = sizeof(dataBuffer);
+    endAddress = 0;
+    if(file != NULL){   // an upload file was given, load the data
+        memset(dataBuffer, -1, sizeof(dataBuffer));
+        if(parseImageFile(file, dataBuffer, &startAddress, &endAddress))
+            return 1;
+        if(startAddress >= endAddress){
+            fprintf(stderr, "No data in input file, exiting.\n");
+            return 0;
+        }
+    }
+    // if no file was given, endAddress is less than startAddress and no data is uploaded
+    if(registry != NULL && endAddress > startAddress){
+        if(uploadWithRegistry(dataBuffer, startAddress, endAddress, registry, NULL, leaveBootLoader && eepromFile == NULL))
+            return 1;
+    }else if(uploadData(dataBuffer, startAddress, endAddress, NULL, leaveBootLoader && eepromFile == NULL, NULL)){
+        return 1;
+    }
+    if(eepromFile != NULL && uploadEeprom(eepromFile, NULL, leaveBootLoader))
+        return 1;
+    return 0;
+}
+
 static void printUsage(char *pname)
 {
-    fprintf(stderr, "usage: %s [-r] [<intel-hexfile>]\n", pname);
+    fprintf(stderr, "usage: %s [-r] [<intel-hexfile>|<elf-file>] [<eeprom-file>.eep]\n", pname);
+    fprintf(stderr, "       %s -b <manifest>\n", pname);
+    fprintf(stderr, "       %s --watch <intel-hexfile>|<elf-file> [--trigger <spec>]\n", pname);
+    fprintf(stderr, "       %s --update <intel-hexfile>|<elf-file> --trigger <spec> [--app <vid>:<pid>]\n", pname);
+    fprintf(stderr, "       %s --plan <intel-hexfile>|<elf-file> [--mcu <name>] [--firmware <name>] [--base <file>] [--json <out>]\n", pname);
+    fprintf(stderr, "       %s --bench [--count <n>] [--bench-write <start>:<end> [--yes]] [--firmware <name>]\n", pname);
+    fprintf(stderr, "--calibration <file> stores the results of --bench and applies them otherwise\n");
+    fprintf(stderr, "--stats or --stats=json prints timing statistics of uploads\n");
+    fprintf(stderr, "--eeprom <file> (or a file ending in .eep) also programs the EEPROM\n");
+    fprintf(stderr, "--registry <dir> sends only pages which differ from the registered image the device contains\n");
+    fprintf(stderr, "--trace <file> writes a timeline in Chrome trace event format\n");
+    fprintf(stderr, "       %s --dump <intel-hexfile>|<binary-file>\n", pname);
+    fprintf(stderr, "       %s --fault-bench <intel-hexfile>|<elf-file> [--mcu <name>] [--firmware <name>] [--json <out>]\n", pname);
+    fprintf(stderr, "--record <file> records all USB calls, --replay <file> [--replay-speed <factor>] replays them\n");
+    fprintf(stderr, "--usbmon <file> writes the report transfers as usbmon text or, for *.pcap, as pcap capture\n");
+    fprintf(stderr, "--simulate <mcu> [--sim-speed <factor>] uses a simulated device, --fault <spec> injects transfer errors\n");
+    fprintf(stderr, "trigger specs: hid:<vid>:<pid>:<hex-report> or cdc:<serial-port>\n");
 }
 
 int main(int argc, char **argv)
 {
-char    *file = NULL;
+char        *file = NULL, *manifest = NULL, *watchFile = NULL, *updateFile = NULL;
+char        *planFile = NULL, *mcu = "atmega32u4", *firmware = BOOTLOAD_SIZE == 1024 ? "boothid" : "vusb";
+char        *baseFile = NULL, *jsonFile = NULL, *benchWrite = NULL, *calibrationFile = NULL, *statsMode = NULL;
+char        *traceOutput = NULL, *recordOutput = NULL, *monitorOutput = NULL, *replayInput = NULL, *simulateMcu = NULL, *faultBenchFile = NULL;
+char        *dumpFile = NULL, *eepromFile = NULL, *registry = NULL;
+int         i, err, leaveBootLoader = 0, appVendor = 0, appProduct = 0, bench = 0, benchCount = 200, consent = 0;
+double      startTime, replaySpeed = 1, simSpeed = 1;
+trigger_t   trigger;
+calibration_t   cal;
+runStats_t  stats;
 
     if(argc < 2){
         printUsage(argv[0]);
         return 1;
     }
-    if(strcmp(argv[1], "-h") == 0 || strcmp(argv[1], "--help") == 0){
-        printUsage(argv[0]);
+    memset(&trigger, 0, sizeof(trigger));
+    for(i = 1; i < argc; i++){
+        if(strcmp(argv[i], "-r") == 0){
+            leaveBootLoader = 1;
+        }else if(strcmp(argv[i], "-b") == 0 && i + 1 < argc){
+            manifest = argv[++i];
+        }else if(strcmp(argv[i], "--watch") == 0 && i + 1 < argc){
+            watchFile = argv[++i];
+        }else if(strcmp(argv[i], "--update") == 0 && i + 1 < argc){
+            updateFile = argv[++i];
+        }else if(strcmp(argv[i], "--plan") == 0 && i + 1 < argc){
+            planFile = argv[++i];
+        }else if(strcmp(argv[i], "--mcu") == 0 && i + 1 < argc){
+            mcu = argv[++i];
+        }else if(strcmp(argv[i], "--firmware") == 0 && i + 1 < argc){
+            firmware = argv[++i];
+        }else if(strcmp(argv[i], "--base") == 0 && i + 1 < argc){
+            baseFile = argv[++i];
+        }else if(strcmp(argv[i], "--json") == 0 && i + 1 < argc){
+            jsonFile = argv[++i];
+        }else if(strcmp(argv[i], "--bench") == 0){
+            bench = 1;
+        }else if(strcmp(argv[i], "--count") == 0 && i + 1 < argc){
+            benchCount = atoi(argv[++i]);
+        }else if(strcmp(argv[i], "--bench-write") == 0 && i + 1 < argc){
+            benchWrite = argv[++i];
+        }else if(strcmp(argv[i], "--yes") == 0){
+            consent = 1;
+        }else if(strcmp(argv[i], "--calibration") == 0 && i + 1 < argc){
+            calibrationFile = argv[++i];
+        }else if(strcmp(argv[i], "--record") == 0 && i + 1 < argc){
+            recordOutput = argv[++i];
+        }else if(strcmp(argv[i], "--usbmon") == 0 && i + 1 < argc){
+            monitorOutput = argv[++i];
+        }else if(strcmp(argv[i], "--replay") == 0 && i + 1 < argc){
+            replayInput = argv[++i];
+        }else if(strcmp(argv[i], "--replay-speed") == 0 && i + 1 < argc){
+            replaySpeed = atof(argv[++i]);
+        }else if(strcmp(argv[i], "--simulate") == 0 && i + 1 < argc){
+            simulateMcu = argv[++i];
+        }else if(strcmp(argv[i], "--sim-speed") == 0 && i + 1 < argc){
+            simSpeed = atof(argv[++i]);
+        }else if(strcmp(argv[i], "--fault") == 0 && i + 1 < argc){
+            if(usbAddFault(argv[++i]) != 0){
+                fprintf(stderr, "Invalid fault \"%s\"\n", argv[i]);
+                return 1;
+            }
+        }else if(strcmp(argv[i], "--dump") == 0 && i + 1 < argc){
+            dumpFile = argv[++i];
+        }else if(strcmp(argv[i], "--fault-bench") == 0 && i + 1 < argc){
+            faultBenchFile = argv[++i];
+        }else if(strcmp(argv[i], "--trace") == 0 && i + 1 < argc){
+            traceOutput = argv[++i];
+        }else if(strcmp(argv[i], "--stats") == 0){
+            statsMode = "";
+        }else if(strncmp(argv[i], "--stats=", 8) == 0){
+            statsMode = argv[i] + 8;
+        }else if(strcmp(argv[i], "--trigger") == 0 && i + 1 < argc){
+            if(parseTrigger(&trigger, argv[++i]) != 0){
+                fprintf(stderr, "Invalid trigger \"%s\"\n", argv[i]);
+                return 1;
+            }
+        }else if(strcmp(argv[i], "--app") == 0 && i + 1 < argc){
+            if(parseUsbIds(argv[++i], &appVendor, &appProduct) < 0){
+                fprintf(stderr, "Invalid application IDs \"%s\"\n", argv[i]);
+                return 1;
+            }
+        }else if(strcmp(argv[i], "--registry") == 0 && i + 1 < argc){
+            registry = argv[++i];
+        }else if(strcmp(argv[i], "--eeprom") == 0 && i + 1 < argc){
+            eepromFile = argv[++i];
+        }else if(argv[i][0] != '-' && strlen(argv[i]) > 4 && strcmp(argv[i] + strlen(argv[i]) - 4, ".eep") == 0){
+            eepromFile = argv[i];
+        }else if(argv[i][0] == '-' || file != NULL){  /* includes -h and --help */
+            printUsage(argv[0]);
+            return 1;
+        }else{
+            file = argv[i];
+        }
+    }
+    if(recordOutput != NULL && usbRecordTo(recordOutput) != 0)
+        return 1;
+    if(monitorOutput != NULL && usbMonitorTo(monitorOutput) != 0)
+        return 1;
+    if(replayInput != NULL && usbReplayFrom(replayInput, replaySpeed) != 0)
         return 1;
+    if(faultBenchFile != NULL)
+        return runFaultBench(faultBenchFile, mcu, firmware, simSpeed, jsonFile) != 0;
+    if(simulateMcu != NULL && startSimulation(simulateMcu, firmware, simSpeed))
+        return 1;
+    if(bench)
+        return runBench(benchCount, benchWrite, consent, firmware, calibrationFile) != 0;
+    if(calibrationFile != NULL){
+        if(loadCalibration(calibrationFile, &cal, firmware))
+            return 1;
+        usbSetTimeout(cal.timeout);
     }
-    if(strcmp(argv[1], "-r") == 0){
-        leaveBootLoader = 1;
-        if(argc >= 3){
-            file = argv[2];
+    if(traceOutput != NULL){
+        if(traceOpen(traceOutput))
+            return 1;
+        atexit(traceClose);
+    }
+    if(dumpFile != NULL)
+        return runDump(dumpFile);
+    if(planFile != NULL)
+        return runPlan(planFile, mcu, firmware, baseFile, jsonFile, calibrationFile != NULL ? &cal : NULL) != 0;
+    if(statsMode != NULL){
+        if(strcmp(statsMode, "json") != 0 && *statsMode != 0){
+            fprintf(stderr, "Invalid statistics format \"%s\"\n", statsMode);
+            return 1;
         }
-    }else{
-        file = argv[1];
+        memset(&stats, 0, sizeof(stats));
+        runStats = &stats;
     }
-    startAddress = sizeof(dataBuffer);
-    endAddress = 0;
-    if(file != NULL){   // an upload file was given, load the data
-        memset(dataBuffer, -1, sizeof(dataBuffer));
-        if(parseIntelHex(file, dataBuffer, &startAddress, &endAddress))
+    startTime = getTime();
+    if(manifest != NULL){
+        err = runBatch(manifest);
+    }else if(watchFile != NULL){
+        err = runWatch(watchFile, &trigger);
+    }else if(updateFile != NULL){
+        if(trigger.type == TRIGGER_NONE){
+            fprintf(stderr, "--update requires --trigger\n");
             return 1;
-        if(startAddress >= endAddress){
-            fprintf(stderr, "No data in input file, exiting.\n");
-            return 0;
         }
+        err = runUpdate(updateFile, &trigger, appVendor, appProduct);
+    }else{
+        err = uploadFile(file, eepromFile, registry, leaveBootLoader);
     }
-    // if no file was given, endAddress is less than startAddress and no data is uploaded
-    if(uploadData(dataBuffer, startAddress, endAddress))
-        return 1;
-    return 0;
+    if(runStats != NULL){
+        runStats->totalTime = getTime() - startTime;
+        printStats(stdout, *statsMode != 0);
+    }
+    if(replayInput != NULL && usbReplayMismatches() != 0){
+        fprintf(stderr, "Replay: %d reports differ from the recording\n", usbReplayMismatches());
+        err = 1;
+    }
+    return err != 0;
 }
 
+#endif /* NO_MAIN */
+
 /* ------------------------------------------------------------------------- */
 
 
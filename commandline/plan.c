@@ -0,0 +1,310 @@
+/* Name: plan.c
+ * Project: AVR bootloader HID
+ * Author: bootloadHID contributors
+ * Creation Date: 2026-10-19
+ * Tabsize: 4
+ * License: Proprietary, free under certain conditions. See Documentation.
+ * This Revision: $Id$
+ */
+
+/*
+General Description:
+This module computes upload plans: the list of data reports which
+uploadData() sends for an image. It also implements "--plan", a dry run
+which prints the plan for a given MCU without accessing USB, together with
+an estimate of the upload time based on a simple throughput model:
+
+    time = reports * reportOverhead + reportBytes * byteTime
+         + pagesWritten * pageTime
+
+Boot loaders with FEATURE_SHORT_DATA accept a short last data report and
+fill the rest of the page with 0xff, so the padding of the image's last page
+is not sent. The 1 kB BootHID build lacks it and gets the padding as well.
+Builds with FEATURE_PATCH change a few bytes of a page with report 7, which
+costs one 37 byte report and one page write. With a base image, a page whose
+differences span at most PATCH_DATA_SIZE bytes is sent this way.
+
+The model parameters depend on the boot loader firmware: the V-USB based
+bootloadHID runs at USB low speed with 8 byte packets, BootHID uses the
+native full speed USB module with 64 byte packets. Both spend the page erase
+and write time busy waiting, so it adds to the transfer time. The built-in
+parameters are rough values, "--bench" measures them for a given setup.
+The "-speed" variants describe the PROFILE=speed builds for a 4 kB boot
+section; BootHID's then overlaps the page write with the next report.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "usbcalls.h"
+#include "bootloadHID.h"
+
+#define REPORT_DATA_SIZE    128 /* payload of one data report */
+#define REPORT_SIZE         (REPORT_DATA_SIZE + 4)
+
+/* ------------------------------------------------------------------------- */
+
+static mcuProfile_t mcuProfiles[] = {
+    /* name         flash size  page size */
+    {"atmega8",          8192,   64},
+    {"atmega88",         8192,   64},
+    {"atmega168",       16384,  128},
+    {"atmega328p",      32768,  128},
+    {"atmega644",       65536,  256},
+    {"atmega8u2",        8192,   64},
+    {"atmega16u2",      16384,  128},
+    {"atmega32u2",      32768,  128},
+    {"at90usb82",        8192,  128},
+    {"at90usb162",      16384,  128},
+    {"atmega16u4",      16384,  128},
+    {"atmega32u4",      32768,  128},
+    {"at90usb646",      65536,  256},
+    {"at90usb1286",    131072,  256},
+    {NULL, 0, 0}
+};
+
+static throughputModel_t    throughputModels[] = {
+    /* firmware        boot size  report overhead  byte time  page time  features */
+    {"vusb",              2048,       2.0e-3,         50e-6,     9.0e-3,   FEATURE_SHORT_DATA},
+    {"boothid",           1024,       1.0e-3,        1.0e-6,     9.0e-3,   0},
+    {"vusb-speed",        4096,       2.0e-3,         50e-6,     9.0e-3,   FEATURE_SHORT_DATA | FEATURE_PATCH},
+    {"boothid-speed",     4096,       1.0e-3,        1.0e-6,     8.0e-3,   FEATURE_SHORT_DATA | FEATURE_PATCH},
+    {NULL, 0, 0, 0, 0, 0}
+};
+
+mcuProfile_t    *findMcuProfile(char *name)
+{
+mcuProfile_t    *profile;
+
+    for(profile = mcuProfiles; profile->name != NULL; profile++){
+        if(strcmp(profile->name, name) == 0)
+            return profile;
+    }
+    return NULL;
+}
+
+throughputModel_t   *findThroughputModel(char *firmware)
+{
+throughputModel_t   *model;
+
+    for(model = throughputModels; model->firmware != NULL; model++){
+        if(strcmp(model->firmware, firmware) == 0)
+            return model;
+    }
+    return NULL;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static int  isBlank(char *data, int len)
+{
+    while(len--){
+        if(*data++ != (char)0xff)
+            return 0;
+    }
+    return 1;
+}
+
+int findPatch(char *data, char *base, int size, int pageSize, int *offset)
+{
+int     first = -1, last = -1, i;
+
+    for(i = 0; i < size; i++){
+        if(data[i] != base[i]){
+            if(first < 0)
+                first = i;
+            last = i;
+        }
+    }
+    if(first < 0 || last - first >= PATCH_DATA_SIZE || first / pageSize != last / pageSize)
+        return 0;
+    *offset = first;
+    return last + 1 - first;
+}
+
+void    makeUploadPlan(uploadPlan_t *plan, char *dataBuffer, int startAddr, int endAddr, int pageSize, char *baseData, int features)
+{
+int             mask, address, dataEnd, patchEnd, pageFlags = 0, patchOffset, patchLength = 0;
+uploadBlock_t   *block;
+
+    memset(plan, 0, sizeof(*plan));
+    if(pageSize < REPORT_DATA_SIZE){
+        mask = REPORT_DATA_SIZE - 1;
+    }else{
+        mask = pageSize - 1;
+    }
+    plan->pageSize = pageSize;
+    plan->startAddr = startAddr & ~mask;            /* round down */
+    plan->endAddr = (endAddr + mask) & ~mask;       /* round up */
+    /* short reports carry whole words; a full report does not end a page */
+    dataEnd = (endAddr + 1) & ~1;
+    if((dataEnd & (REPORT_DATA_SIZE - 1)) == 0 && (dataEnd & mask) != 0)
+        dataEnd += 2;
+    /* pages behind the last one with data are not written, nor patched */
+    patchEnd = (endAddr + pageSize - 1) & ~(pageSize - 1);
+    plan->numBlocks = (plan->endAddr - plan->startAddr) / REPORT_DATA_SIZE;
+    plan->blocks = calloc(plan->numBlocks > 0 ? plan->numBlocks : 1, sizeof(uploadBlock_t));
+    block = plan->blocks;
+    for(address = plan->startAddr; address < plan->endAddr; address += REPORT_DATA_SIZE, block++){
+        if((address & mask) == 0){
+            /* decisions are made per page, a page is erased when its first block arrives */
+            pageFlags = 0;
+            if(baseData != NULL && memcmp(dataBuffer + address, baseData + address, mask + 1) == 0)
+                pageFlags |= BLOCK_UNCHANGED;
+            if(isBlank(dataBuffer + address, mask + 1))
+                pageFlags |= BLOCK_BLANK;
+            patchLength = 0;
+            if(!(pageFlags & BLOCK_UNCHANGED) && baseData != NULL && (features & FEATURE_PATCH) && address < patchEnd)
+                patchLength = findPatch(dataBuffer + address, baseData + address, patchEnd - address < mask + 1 ? patchEnd - address : mask + 1, pageSize, &patchOffset);
+            if(pageFlags & BLOCK_UNCHANGED){
+                plan->bytesSkipped += mask + 1;
+            }else if(patchLength > 0){
+                pageFlags |= BLOCK_PATCH;
+                plan->reportsToSend++;
+                plan->reportBytes += sizeof(devicePatch_t);
+                plan->dataBytes += patchLength;
+                plan->bytesToSend += pageSize;     /* one page is written */
+                plan->bytesSkipped += mask + 1 - pageSize;
+            }else{
+                plan->bytesToSend += mask + 1;
+                if(pageFlags & BLOCK_BLANK)
+                    plan->blankPages++;
+            }
+        }
+        block->address = address;
+        block->length = dataEnd - address;
+        if(block->length > REPORT_DATA_SIZE)
+            block->length = REPORT_DATA_SIZE;
+        if(block->length < 0)
+            block->length = 0;
+        block->flags = pageFlags;
+        if(patchLength > 0){
+            block->patchAddress = address + patchOffset;
+            block->patchLength = patchLength;
+            patchLength = 0;    /* the report goes with the first block */
+        }
+        if(!(pageFlags & (BLOCK_UNCHANGED | BLOCK_PATCH)) && !(features & FEATURE_SHORT_DATA)){
+            plan->reportsToSend++;
+            plan->reportBytes += REPORT_SIZE;
+            plan->dataBytes += REPORT_DATA_SIZE;
+        }else if(!(pageFlags & (BLOCK_UNCHANGED | BLOCK_PATCH)) && block->length > 0){
+            plan->reportsToSend++;
+            plan->reportBytes += REPORT_SIZE - REPORT_DATA_SIZE + block->length;
+            plan->dataBytes += block->length;
+        }
+    }
+}
+
+void    freeUploadPlan(uploadPlan_t *plan)
+{
+    free(plan->blocks);
+    plan->blocks = NULL;
+    plan->numBlocks = 0;
+}
+
+double  estimateUploadTime(uploadPlan_t *plan, throughputModel_t *model)
+{
+    return plan->reportsToSend * model->reportOverhead + plan->reportBytes * model->byteTime
+        + (double)plan->bytesToSend / plan->pageSize * model->pageTime;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void writePlanJson(FILE *fp, char *file, mcuProfile_t *profile, throughputModel_t *model, uploadPlan_t *plan, double estimate)
+{
+int             i;
+uploadBlock_t   *block;
+
+    fprintf(fp, "{\n  \"file\": ");
+    printJsonString(fp, file);
+    fprintf(fp, ",\n  \"mcu\": \"%s\",\n  \"firmware\": \"%s\",\n", profile->name, model->firmware);
+    fprintf(fp, "  \"pageSize\": %d,\n  \"flashSize\": %d,\n  \"bootLoaderSize\": %d,\n", profile->pageSize, profile->flashSize, model->bootLoaderSize);
+    fprintf(fp, "  \"startAddr\": %d,\n  \"endAddr\": %d,\n  \"blocks\": [", plan->startAddr, plan->endAddr);
+    for(i = 0; i < plan->numBlocks; i++){
+        block = &plan->blocks[i];
+        fprintf(fp, "%s\n    {\"address\": %d, \"length\": %d, \"action\": \"%s\", \"blank\": %s", i == 0 ? "" : ",",
+            block->address, block->length, block->patchLength > 0 ? "patch" : (block->flags & (BLOCK_UNCHANGED | BLOCK_PATCH)) || block->length == 0 ? "skip" : "send",
+            block->flags & BLOCK_BLANK ? "true" : "false");
+        if(block->patchLength > 0)
+            fprintf(fp, ", \"patchAddress\": %d, \"patchLength\": %d", block->patchAddress, block->patchLength);
+        fprintf(fp, "}");
+    }
+    fprintf(fp, "\n  ],\n  \"reportsToSend\": %d,\n  \"bytesToSend\": %d,\n  \"bytesSkipped\": %d,\n  \"blankPages\": %d,\n",
+        plan->reportsToSend, plan->bytesToSend, plan->bytesSkipped, plan->blankPages);
+    fprintf(fp, "  \"model\": {\"reportOverhead\": %g, \"byteTime\": %g, \"pageTime\": %g},\n", model->reportOverhead, model->byteTime, model->pageTime);
+    fprintf(fp, "  \"estimatedSeconds\": %.6f\n}\n", estimate);
+}
+
+int runPlan(char *file, char *mcu, char *firmware, char *baseFile, char *jsonFile, calibration_t *cal)
+{
+static char         dataBuffer[IMAGE_BUFFER_SIZE], baseBuffer[IMAGE_BUFFER_SIZE];
+int                 startAddr = IMAGE_BUFFER_SIZE, endAddr = 0, baseStart = IMAGE_BUFFER_SIZE, baseEnd = 0, i;
+mcuProfile_t        *profile;
+throughputModel_t   *model, calibrated;
+uploadPlan_t        plan;
+uploadBlock_t       *block;
+double              estimate;
+FILE                *fp;
+
+    if((profile = findMcuProfile(mcu)) == NULL){
+        fprintf(stderr, "Unknown MCU \"%s\"\n", mcu);
+        return 1;
+    }
+    if((model = findThroughputModel(firmware)) == NULL){
+        fprintf(stderr, "Unknown firmware \"%s\" (use vusb, boothid, vusb-speed or boothid-speed)\n", firmware);
+        return 1;
+    }
+    if(cal != NULL){
+        calibrated = *model;
+        applyCalibration(cal, &calibrated);
+        model = &calibrated;
+    }
+    memset(dataBuffer, -1, sizeof(dataBuffer));
+    if(parseImageFile(file, dataBuffer, &startAddr, &endAddr))
+        return 1;
+    if(startAddr >= endAddr){
+        fprintf(stderr, "No data in input file, exiting.\n");
+        return 1;
+    }
+    if(endAddr > profile->flashSize - model->bootLoaderSize){
+        fprintf(stderr, "Data (%d bytes) exceeds remaining flash size!\n", endAddr);
+        return 1;
+    }
+    if(baseFile != NULL){
+        memset(baseBuffer, -1, sizeof(baseBuffer));
+        if(parseImageFile(baseFile, baseBuffer, &baseStart, &baseEnd))
+            return 1;
+    }
+    makeUploadPlan(&plan, dataBuffer, startAddr, endAddr, profile->pageSize, baseFile != NULL ? baseBuffer : NULL, model->features);
+    estimate = estimateUploadTime(&plan, model);
+    printf("Plan for %s on %s (page size %d, %d bytes available, firmware %s):\n", file, profile->name,
+        profile->pageSize, profile->flashSize - model->bootLoaderSize, model->firmware);
+    for(i = 0; i < plan.numBlocks; i++){
+        block = &plan.blocks[i];
+        if(block->patchLength > 0){
+            printf("  0x%05x ... 0x%05x  patch %d bytes at 0x%05x\n", block->address, block->address + block->length,
+                block->patchLength, block->patchAddress);
+            continue;
+        }
+        printf("  0x%05x ... 0x%05x  %s%s\n", block->address, block->address + block->length,
+            block->flags & BLOCK_UNCHANGED ? "skip (unchanged)" : block->flags & BLOCK_PATCH ? "skip (patched)" : block->length > 0 ? "send" : "skip (padding)",
+            block->flags & BLOCK_BLANK ? " (blank)" : "");
+    }
+    printf("Reports: %d of %d to send, %d bytes skipped, %d blank pages sent\n", plan.reportsToSend, plan.numBlocks, plan.bytesSkipped, plan.blankPages);
+    printf("Estimated upload time: %.3f s (%.3f ms/report, %.1f us/byte, %.3f ms/page)\n", estimate,
+        model->reportOverhead * 1e3, model->byteTime * 1e6, model->pageTime * 1e3);
+    if(jsonFile != NULL){
+        if((fp = fopen(jsonFile, "w")) == NULL){
+            perror(jsonFile);
+            freeUploadPlan(&plan);
+            return 1;
+        }else{
+            writePlanJson(fp, file, profile, model, &plan, estimate);
+            fclose(fp);
+        }
+    }
+    freeUploadPlan(&plan);
+    return 0;
+}
+
+/* ------------------------------------------------------------------------- */
@@ -0,0 +1,182 @@
+/* Name: registry.c
+ * Project: AVR bootloader HID
+ * Author: bootloadHID contributors
+ * Creation Date: 2026-10-19
+ * Tabsize: 4
+ * License: Proprietary, free under certain conditions. See Documentation.
+ * This Revision: $Id$
+ */
+
+/*
+General Description:
+This module implements uploads with an image registry ("--registry <dir>").
+The registry is a directory of images which were flashed before, each stored
+as Intel-Hex file named after its fingerprint: the CRC-32 (as computed by
+zlib's crc32()) of the application section, with bytes not in the image
+counted as 0xff, in 8 lower case hex digits, e.g. "1c291ca3.hex".
+
+Before the upload, the fingerprint of the device is requested (report 5,
+the boot loader must be built with BOOTLOADER_CAN_FINGERPRINT or
+USE_FINGERPRINT). If the registry contains an image with this fingerprint,
+it is what the flash contains, and only pages which differ from it are sent.
+No further queries are needed. Since the device may contain anything if the
+registry was wrong, the fingerprint is requested again afterwards and
+compared to the expected flash contents. If they match, the new contents are
+added to the registry, so that the next update can build on them.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "usbcalls.h"
+#include "bootloadHID.h"
+
+#define REGISTRY_NAME_SIZE  1024
+
+/* ------------------------------------------------------------------------- */
+
+unsigned long   imageCrc(char *buffer, int size)
+{
+unsigned long   crc = 0xffffffff;
+int             address, i;
+
+    for(address = 0; address < size; address++){
+        crc ^= address < IMAGE_BUFFER_SIZE ? buffer[address] & 0xff : 0xff;
+        for(i = 0; i < 8; i++)
+            crc = (crc >> 1) ^ (crc & 1 ? 0xedb88320 : 0);
+    }
+    return ~crc & 0xffffffff;
+}
+
+static int  readFingerprint(usbDevice_t *dev, unsigned long *crc, int *size)
+{
+int     err, len;
+union{
+    char                bytes[1];
+    deviceFingerprint_t fingerprint;
+}       buffer;
+
+    len = sizeof(buffer);
+    if((err = usbGetReport(dev, USB_HID_REPORT_TYPE_FEATURE, 5, buffer.bytes, &len)) != 0)
+        return err;
+    if(len < sizeof(buffer.fingerprint))
+        return -1;
+    *crc = (unsigned)getUsbInt(buffer.fingerprint.crc, 4);
+    *size = getUsbInt(buffer.fingerprint.size, 4);
+    return 0;
+}
+
+static int  queryDevice(char *location, deviceCaps_t *caps, unsigned long *crc, int *size)
+{
+usbDevice_t     *dev = NULL;
+int             err;
+
+    err = usbOpenDeviceAt(&dev, location, IDENT_VENDOR_NUM, IDENT_VENDOR_STRING, IDENT_PRODUCT_NUM, IDENT_PRODUCT_STRING, 1);
+    if(err != 0){
+        fprintf(stderr, "Error opening HIDBoot device: %s\n", usbErrorMessage(err));
+        return err;
+    }
+    if((err = getDeviceCaps(dev, caps)) == 0){
+        if(caps->protocolVersion >= 2 && !(caps->features & FEATURE_FINGERPRINT)){
+            err = -1;   /* don't make old boot loaders stall */
+        }else{
+            err = readFingerprint(dev, crc, size);
+        }
+    }
+    usbCloseDevice(dev);
+    return err;
+}
+
+static void registryName(char *name, char *registry, unsigned long crc)
+{
+    snprintf(name, REGISTRY_NAME_SIZE, "%s/%08lx.hex", registry, crc);
+}
+
+static int  leave(char *location)
+{
+usbDevice_t *dev = NULL;
+int         err;
+
+    err = usbOpenDeviceAt(&dev, location, IDENT_VENDOR_NUM, IDENT_VENDOR_STRING, IDENT_PRODUCT_NUM, IDENT_PRODUCT_STRING, 1);
+    if(err != 0)
+        return err;
+    sendExitReport(dev);
+    usbCloseDevice(dev);
+    return 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+int uploadWithRegistry(char *dataBuffer, int startAddr, int endAddr, char *registry, char *location, int leaveBootLoader)
+{
+static char     base[IMAGE_BUFFER_SIZE], expected[IMAGE_BUFFER_SIZE];
+char            name[REGISTRY_NAME_SIZE], tempName[REGISTRY_NAME_SIZE + 4];
+int             err, pageSize, size, haveBase = 0, baseStart = sizeof(base), baseEnd = 0;
+unsigned long   crc, expectedCrc;
+FILE            *fp;
+deviceCaps_t    caps;
+
+    if((err = queryDevice(location, &caps, &crc, &size)) != 0){
+        if(err != USB_ERROR_NOTFOUND && err != USB_ERROR_ACCESS){
+            fprintf(stderr, "Device has no fingerprint report, uploading without registry\n");
+            err = uploadData(dataBuffer, startAddr, endAddr, location, leaveBootLoader, NULL);
+        }
+        return err;
+    }
+    memset(base, 0xff, sizeof(base));
+    registryName(name, registry, crc);
+    if((fp = fopen(name, "r")) != NULL){
+        fclose(fp);
+        if(parseIntelHex(name, base, &baseStart, &baseEnd) == 0 && imageCrc(base, size) == crc){
+            printf("Device contains registered image %s\n", name);
+            haveBase = 1;
+        }else{
+            fprintf(stderr, "Warning: %s does not match its fingerprint, ignored\n", name);
+            memset(base, 0xff, sizeof(base));
+        }
+    }else{
+        printf("Fingerprint %08lx is not in the registry, uploading everything\n", crc);
+    }
+    if((err = uploadData(dataBuffer, startAddr, endAddr, location, 0, haveBase ? base : NULL)) != 0)
+        return err;
+    /* compute what the flash should contain now: the plan rounds the range to
+     * pages of at least 128 bytes, a short last report fills only its page
+     */
+    pageSize = caps.pageSize < 128 ? 128 : caps.pageSize;  /* at least one data report */
+    memcpy(expected, base, sizeof(expected));
+    startAddr &= ~(pageSize - 1);
+    if(caps.features & FEATURE_SHORT_DATA)
+        pageSize = caps.pageSize;
+    endAddr = (endAddr + pageSize - 1) & ~(pageSize - 1);
+    memcpy(expected + startAddr, dataBuffer + startAddr, endAddr - startAddr);
+    expectedCrc = imageCrc(expected, size);
+    if((err = queryDevice(location, &caps, &crc, &size)) != 0){
+        fprintf(stderr, "Error reading fingerprint after upload: %s\n", err > 0 ? usbErrorMessage(err) : "short report");
+        return err;
+    }
+    if(crc != expectedCrc){
+        if(haveBase){
+            fprintf(stderr, "Flash fingerprint %08lx differs from the expected %08lx, registry may be corrupt!\n", crc, expectedCrc);
+            return -1;
+        }
+        printf("Flash outside of the image is unknown, not registered\n");
+    }else{
+        registryName(name, registry, crc);
+        if((fp = fopen(name, "r")) != NULL){
+            fclose(fp);
+        }else{  /* write to a temporary file first, so that the registry never contains partial images */
+            snprintf(tempName, sizeof(tempName), "%s.tmp", name);
+            if(writeIntelHex(tempName, expected, 0, size < IMAGE_BUFFER_SIZE ? size : IMAGE_BUFFER_SIZE) != 0 || rename(tempName, name) != 0){
+                fprintf(stderr, "Warning: could not add %s to the registry\n", name);
+                remove(tempName);
+            }else{
+                printf("Registered %s\n", name);
+            }
+        }
+    }
+    if(leaveBootLoader)
+        leave(location);
+    return 0;
+}
+
+/* ------------------------------------------------------------------------- */
@@ -0,0 +1,168 @@
+/* Name: stats.c
+ * Project: AVR bootloader HID
+ * Author: bootloadHID contributors
+ * Creation Date: 2026-10-19
+ * Tabsize: 4
+ * License: Proprietary, free under certain conditions. See Documentation.
+ * This Revision: $Id$
+ */
+
+/*
+General Description:
+This module collects run statistics for "--stats" and "--stats=json". Each
+measured operation (enumeration, open and claim, device info query, data
+report) has a histogram with logarithmic buckets: 8 buckets per power of two
+of the latency in microseconds, so percentiles are accurate to 12.5%. Adding
+a sample is a few shifts and increments, no memory is allocated.
+
+If statistics are not enabled, 'runStats' is NULL and statsRecord() returns
+immediately.
+
+Boot loaders built with USE_PERF (BootHID) count where their own time goes:
+waiting for page erases, page writes, other SPM or EEPROM operations and
+the OUT packets of a report, and the idle main loop, plus the pages erased
+and written and the SETUP packets seen. uploadData() requests these
+counters (report 8) after the upload, and they are printed with the host's
+statistics. Comparing the device's receive and idle times with the host's
+report latencies shows whether the host, the bus or the flash is the limit.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include "usbcalls.h"
+#include "bootloadHID.h"
+
+#define SUB_BITS    3                   /* 2^SUB_BITS buckets per octave */
+#define SUB_COUNT   (1 << SUB_BITS)
+
+runStats_t  *runStats;
+
+static char *statsNames[STATS_COUNT] = {"enumerate", "open", "deviceInfo", "block"};
+
+/* ------------------------------------------------------------------------- */
+
+static int  bucketIndex(unsigned value)
+{
+int msb = 0;
+
+    if(value < SUB_COUNT)
+        return value;
+    while((value >> msb) > 1)
+        msb++;
+    return (msb - SUB_BITS + 1) * SUB_COUNT + ((value >> (msb - SUB_BITS)) & (SUB_COUNT - 1));
+}
+
+static double   bucketLimit(int index)
+/* returns the upper limit of the bucket in seconds */
+{
+int         octave = index / SUB_COUNT, sub = index % SUB_COUNT;
+unsigned    limit;
+
+    if(octave == 0)
+        return (index + 1) * 1e-6;
+    limit = (unsigned)(SUB_COUNT + sub + 1) << (octave - 1);
+    return limit * 1e-6;
+}
+
+void    statsRecord(int which, double seconds)
+{
+histogram_t *h;
+double      us;
+
+    if(runStats == NULL)
+        return;
+    h = &runStats->histograms[which];
+    h->count++;
+    h->sum += seconds;
+    if(h->max < seconds)
+        h->max = seconds;
+    us = seconds * 1e6;
+    h->buckets[bucketIndex(us >= 4e9 ? 4000000000u : (unsigned)us)]++;
+}
+
+double  statsPercentile(histogram_t *h, int percent)
+{
+unsigned    rank, seen = 0;
+int         i;
+double      value;
+
+    if(h->count == 0)
+        return 0;
+    rank = (h->count * percent + 99) / 100;
+    if(rank < 1)
+        rank = 1;
+    for(i = 0; i < HISTOGRAM_BUCKETS; i++){
+        if((seen += h->buckets[i]) >= rank)
+            break;
+    }
+    value = bucketLimit(i);
+    return value < h->max ? value : h->max;
+}
+
+/* ------------------------------------------------------------------------- */
+
+int statsReadDevice(usbDevice_t *dev)
+{
+int     err, len;
+double  tick;
+union{
+    char            bytes[1];
+    devicePerf_t    perf;
+}       buffer;
+
+    len = sizeof(buffer);
+    if((err = usbGetReport(dev, USB_HID_REPORT_TYPE_FEATURE, 8, buffer.bytes, &len)) != 0)
+        return err;
+    if(len < sizeof(buffer.perf) || getUsbInt(buffer.perf.ticksPerMs, 2) == 0)
+        return -1;
+    tick = 1e-3 / getUsbInt(buffer.perf.ticksPerMs, 2);
+    runStats->deviceCounters++;
+    runStats->eraseTime += (unsigned)getUsbInt(buffer.perf.eraseTicks, 4) * tick;
+    runStats->writeTime += (unsigned)getUsbInt(buffer.perf.writeTicks, 4) * tick;
+    runStats->busyTime += (unsigned)getUsbInt(buffer.perf.busyTicks, 4) * tick;
+    runStats->receiveTime += (unsigned)getUsbInt(buffer.perf.receiveTicks, 4) * tick;
+    runStats->idleTime += (unsigned)getUsbInt(buffer.perf.idleTicks, 4) * tick;
+    runStats->pagesErased += getUsbInt(buffer.perf.pagesErased, 2);
+    runStats->pagesWritten += getUsbInt(buffer.perf.pagesWritten, 2);
+    runStats->setupPackets += getUsbInt(buffer.perf.setupPackets, 2);
+    return 0;
+}
+
+void    printStats(FILE *fp, int json)
+{
+runStats_t  *s = runStats;
+histogram_t *h;
+int         i;
+double      throughput;
+
+    throughput = s->uploadTime > 0 ? s->bytesSent / s->uploadTime : 0;
+    if(!json){
+        fprintf(fp, "Statistics: %.3f s total, %.3f s uploading, %d bytes in %d reports (%.0f bytes/s), %d bytes skipped, %d pages kept, %d retries\n",
+            s->totalTime, s->uploadTime, s->bytesSent, s->reports, throughput, s->bytesSkipped, s->pagesKept, s->retries);
+        for(i = 0; i < STATS_COUNT; i++){
+            h = &s->histograms[i];
+            if(h->count == 0)
+                continue;
+            fprintf(fp, "  %-10s %5u x  mean %8.3f  p50 %8.3f  p95 %8.3f  p99 %8.3f  max %8.3f ms\n", statsNames[i], h->count,
+                h->sum / h->count * 1e3, statsPercentile(h, 50) * 1e3, statsPercentile(h, 95) * 1e3, statsPercentile(h, 99) * 1e3, h->max * 1e3);
+        }
+        if(s->deviceCounters)
+            fprintf(fp, "  device     erase %.3f  write %.3f  busy %.3f  receive %.3f  idle %.3f ms; %d pages erased, %d written, %d SETUP packets\n",
+                s->eraseTime * 1e3, s->writeTime * 1e3, s->busyTime * 1e3, s->receiveTime * 1e3, s->idleTime * 1e3, s->pagesErased, s->pagesWritten, s->setupPackets);
+        return;
+    }
+    /* one line, so it's easy to pick from the output */
+    fprintf(fp, "{\"totalSeconds\": %.6f, \"uploadSeconds\": %.6f, \"bytesSent\": %d, \"reports\": %d, \"bytesPerSecond\": %.1f, \"bytesSkipped\": %d, \"pagesKept\": %d, \"retries\": %d",
+        s->totalTime, s->uploadTime, s->bytesSent, s->reports, throughput, s->bytesSkipped, s->pagesKept, s->retries);
+    for(i = 0; i < STATS_COUNT; i++){
+        h = &s->histograms[i];
+        fprintf(fp, ", \"%s\": {\"count\": %u, \"mean\": %.6f, \"p50\": %.6f, \"p95\": %.6f, \"p99\": %.6f, \"max\": %.6f}", statsNames[i], h->count,
+            h->count ? h->sum / h->count : 0, statsPercentile(h, 50), statsPercentile(h, 95), statsPercentile(h, 99), h->max);
+    }
+    if(s->deviceCounters)
+        fprintf(fp, ", \"device\": {\"erase\": %.6f, \"write\": %.6f, \"busy\": %.6f, \"receive\": %.6f, \"idle\": %.6f, \"pagesErased\": %d, \"pagesWritten\": %d, \"setupPackets\": %d}",
+            s->eraseTime, s->writeTime, s->busyTime, s->receiveTime, s->idleTime, s->pagesErased, s->pagesWritten, s->setupPackets);
+    fprintf(fp, "}\n");
+}
+
+/* ------------------------------------------------------------------------- */
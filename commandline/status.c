@@ -0,0 +1,193 @@
+/* Name: status.c
+ * Project: AVR bootloader HID
+ * Author: bootloadHID contributors
+ * Creation Date: 2026-10-19
+ * Tabsize: 4
+ * License: Proprietary, free under certain conditions. See Documentation.
+ * This Revision: $Id$
+ */
+
+/*
+General Description:
+This module collects the status reports of boot loaders built with
+BOOTLOADER_CAN_STATUS (V-USB) or USE_STATUS (BootHID). After writing a page,
+such a device sends report 6 on its interrupt-in endpoint:
+
+    reportId    1 byte      6
+    address     3 bytes     start of the page
+    result      1 byte      0: written, 1: unchanged and kept
+
+Uploads go in ascending order and a device which is busy replaces the
+report of a page when the next one is due, so a report confirms its page
+and all pages sent before it. Data reports are synchronous control
+transfers, so the host is never more than one page ahead and waiting for
+earlier pages could only slow it down. uploadData() therefore sends them
+back to back as before, while a second thread reads the status reports:
+the upload is complete when the last page is confirmed, not when its
+report was accepted. The reader only
+waits for reports while a page sent is not confirmed yet, so that it can be
+stopped at once afterwards. On Windows, the HID driver queues input reports,
+so statusWait() reads them itself.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#ifndef WIN32
+#include <time.h>
+#include <pthread.h>
+#endif
+#include "usbcalls.h"
+#include "bootloadHID.h"
+
+#define STATUS_POLL_MS  100     /* the reader checks for statusStop() this often */
+
+static usbDevice_t  *statusDevice;
+static int          statusConfirmed;    /* highest page address confirmed, -1 if none */
+static int          statusSentPage;     /* highest page address sent, -1 if none */
+static int          statusFailed;       /* reading failed, e.g. during replay */
+#ifndef WIN32
+static int              statusRunning;
+static pthread_t        statusThread;
+static pthread_mutex_t  statusLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t   statusChanged = PTHREAD_COND_INITIALIZER;
+#endif
+
+/* ------------------------------------------------------------------------- */
+
+static int  statusRead(int timeout)
+/* reads one report; returns 0 if one arrived, USB_ERROR_TIMEOUT or an error */
+{
+char    buffer[64];
+int     err, len = sizeof(buffer), address;
+
+    if((err = usbReadInterrupt(statusDevice, buffer, &len, timeout)) != 0)
+        return err;
+    if(len < 5 || buffer[0] != 6)
+        return 0;   /* not a status report */
+    address = getUsbInt(buffer + 1, 3);
+#ifndef WIN32
+    pthread_mutex_lock(&statusLock);
+#endif
+    if(address > statusConfirmed)
+        statusConfirmed = address;
+#ifndef WIN32
+    pthread_cond_broadcast(&statusChanged);
+    pthread_mutex_unlock(&statusLock);
+#endif
+    return 0;
+}
+
+#ifndef WIN32
+static void *statusReader(void *arg)
+{
+int     err;
+
+    for(;;){
+        pthread_mutex_lock(&statusLock);
+        while(statusRunning && statusConfirmed >= statusSentPage)
+            pthread_cond_wait(&statusChanged, &statusLock);
+        pthread_mutex_unlock(&statusLock);
+        if(!statusRunning)
+            break;
+        if((err = statusRead(STATUS_POLL_MS)) != 0 && err != USB_ERROR_TIMEOUT){
+            pthread_mutex_lock(&statusLock);
+            statusFailed = 1;
+            pthread_cond_broadcast(&statusChanged);
+            pthread_mutex_unlock(&statusLock);
+            break;
+        }
+    }
+    return NULL;
+}
+#endif
+
+/* ------------------------------------------------------------------------- */
+
+int statusStart(usbDevice_t *dev)
+{
+    statusDevice = dev;
+    statusConfirmed = statusSentPage = -1;
+    statusFailed = 0;
+#ifndef WIN32
+    statusRunning = 1;
+    if(pthread_create(&statusThread, NULL, statusReader, NULL) != 0){
+        statusRunning = 0;
+        return -1;
+    }
+#endif
+    return 0;
+}
+
+void    statusSent(int address)
+{
+#ifndef WIN32
+    pthread_mutex_lock(&statusLock);
+#endif
+#ifndef WIN32
+    if(statusConfirmed >= statusSentPage)
+        pthread_cond_broadcast(&statusChanged);     /* the reader is idle */
+#endif
+    if(address > statusSentPage)
+        statusSentPage = address;
+#ifndef WIN32
+    pthread_mutex_unlock(&statusLock);
+#endif
+}
+
+int statusWait(int address, double timeout)
+{
+double  deadline = getTime() + timeout;
+int     err = 0;
+#ifndef WIN32
+struct timespec wakeup;
+double  t;
+
+    pthread_mutex_lock(&statusLock);
+    while(statusConfirmed < address && !statusFailed){
+        if((t = deadline - getTime()) <= 0){
+            err = -1;
+            break;
+        }
+        clock_gettime(CLOCK_REALTIME, &wakeup);     /* the condition uses the real time clock */
+        t += wakeup.tv_sec + wakeup.tv_nsec * 1e-9;
+        wakeup.tv_sec = (time_t)t;
+        wakeup.tv_nsec = (long)((t - wakeup.tv_sec) * 1e9);
+        pthread_cond_timedwait(&statusChanged, &statusLock, &wakeup);
+    }
+    if(statusFailed)
+        err = -1;
+    pthread_mutex_unlock(&statusLock);
+#else
+int     remaining;
+
+    while(statusConfirmed < address && !statusFailed){
+        if((remaining = (int)((deadline - getTime()) * 1000)) < 0){
+            err = -1;
+            break;
+        }
+        if((err = statusRead(remaining)) != 0 && err != USB_ERROR_TIMEOUT)
+            statusFailed = 1;
+        err = 0;
+    }
+    if(statusFailed)
+        err = -1;
+#endif
+    return err;
+}
+
+void    statusStop(void)
+{
+#ifndef WIN32
+    if(statusRunning){
+        pthread_mutex_lock(&statusLock);
+        statusRunning = 0;
+        pthread_cond_broadcast(&statusChanged);
+        pthread_mutex_unlock(&statusLock);
+        pthread_join(statusThread, NULL);
+    }
+#endif
+    statusDevice = NULL;
+}
+
+/* ------------------------------------------------------------------------- */
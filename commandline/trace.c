@@ -0,0 +1,93 @@
+/* Name: trace.c
+ * Project: AVR bootloader HID
+ * Author: bootloadHID contributors
+ * Creation Date: 2026-10-19
+ * Tabsize: 4
+ * License: Proprietary, free under certain conditions. See Documentation.
+ * This Revision: $Id$
+ */
+
+/*
+General Description:
+This module writes a timeline of the session for "--trace <file>" in the
+trace event format of Chrome (chrome://tracing) and Perfetto (ui.perfetto.dev).
+Every span is written as complete event ("ph": "X") on a track. File parsing
+has its own track, and each device gets one, so batch runs show one row per
+device.
+
+Events are written when they end. Each event is a single fprintf() call, so
+the thread preparing the next batch job can write parse events concurrently.
+If tracing is not enabled, 'traceFile' is NULL and callers skip all trace
+calls with a single pointer comparison.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include "usbcalls.h"
+#include "bootloadHID.h"
+
+#define MAX_TRACKS  64
+
+FILE            *traceFile;
+
+static double   traceStart;
+static char     *trackNames[MAX_TRACKS];
+static int      numTracks;
+
+/* ------------------------------------------------------------------------- */
+
+static void addTrack(char *name)
+{
+    trackNames[numTracks] = strdup(name);
+    fprintf(traceFile, ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, \"args\": {\"name\": ", numTracks);
+    printJsonString(traceFile, name);
+    fprintf(traceFile, "}}");
+    numTracks++;
+}
+
+int traceOpen(char *file)
+{
+    if((traceFile = fopen(file, "w")) == NULL){
+        fprintf(stderr, "error opening %s: %s\n", file, strerror(errno));
+        return 1;
+    }
+    traceStart = getTime();
+    fprintf(traceFile, "[\n{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, \"args\": {\"name\": \"bootloadHID\"}}");
+    addTrack("host");   /* TRACK_HOST */
+    addTrack("parse");  /* TRACK_PARSE */
+    return 0;
+}
+
+void    traceClose(void)
+{
+    if(traceFile == NULL)
+        return;
+    fprintf(traceFile, "\n]\n");
+    fclose(traceFile);
+    traceFile = NULL;
+}
+
+int traceTrack(char *name)
+{
+int i;
+
+    for(i = 0; i < numTracks; i++){
+        if(strcmp(trackNames[i], name) == 0)
+            return i;
+    }
+    if(numTracks >= MAX_TRACKS)
+        return TRACK_HOST;
+    addTrack(name);
+    return i;
+}
+
+void    traceSpan(int track, char *name, double start, double end, char *args)
+{
+    fprintf(traceFile, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.1f, \"dur\": %.1f%s%s%s}",
+        name, track, (start - traceStart) * 1e6, (end - start) * 1e6,
+        args != NULL ? ", \"args\": {" : "", args != NULL ? args : "", args != NULL ? "}" : "");
+}
+
+/* ------------------------------------------------------------------------- */
@@ -0,0 +1,225 @@
+/* Name: update.c
+ * Project: AVR bootloader HID
+ * Author: bootloadHID contributors
+ * Creation Date: 2026-10-19
+ * Tabsize: 4
+ * License: Proprietary, free under certain conditions. See Documentation.
+ * This Revision: $Id$
+ */
+
+/*
+General Description:
+This module implements the complete update of a running device ("--update
+<file> --trigger <spec>"): the application is asked to enter the boot loader,
+the image is uploaded, the boot loader is left and we wait until the
+application has enumerated again. The time spent in each phase is reported.
+
+The trigger which makes the application jump to the boot loader is given as
+    hid:<vid>:<pid>:<hex>   Send the bytes <hex> (report ID first) as feature
+                            report to the HID device with the given IDs.
+    cdc:<port>              Open the serial port <port> with 1200 baud and
+                            close it again (the "1200 baud touch").
+The application's IDs for the final phase default to those of a HID trigger
+and can be set with "--app <vid>:<pid>".
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+#endif
+#include "usbcalls.h"
+#include "bootloadHID.h"
+
+#define ENUMERATION_TIMEOUT     10  /* seconds to wait for a device to appear */
+
+/* ------------------------------------------------------------------------- */
+
+int parseUsbIds(char *spec, int *vendor, int *product)
+{
+char    *end;
+
+    *vendor = strtol(spec, &end, 16);
+    if(*end != ':')
+        return -1;
+    *product = strtol(end + 1, &end, 16);
+    if(*end != 0 && *end != ':')
+        return -1;
+    return end - spec;
+}
+
+int parseTrigger(trigger_t *trigger, char *spec)
+{
+int     len, value;
+
+    memset(trigger, 0, sizeof(*trigger));
+    if(strncmp(spec, "cdc:", 4) == 0 && spec[4] != 0){
+        trigger->type = TRIGGER_CDC;
+        trigger->port = spec + 4;
+        return 0;
+    }
+    if(strncmp(spec, "hid:", 4) != 0)
+        return -1;
+    spec += 4;
+    if((len = parseUsbIds(spec, &trigger->vendor, &trigger->product)) < 0 || spec[len] != ':')
+        return -1;
+    for(spec += len + 1; *spec != 0; spec += 2){
+        if(trigger->reportLen >= (int)sizeof(trigger->report) || sscanf(spec, "%2x", &value) != 1 || spec[1] == 0)
+            return -1;
+        trigger->report[trigger->reportLen++] = value;
+    }
+    if(trigger->reportLen == 0)
+        return -1;
+    trigger->type = TRIGGER_HID;
+    return 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static int  touchSerialPort(char *port)
+{
+#ifdef WIN32
+HANDLE  handle;
+DCB     dcb;
+char    path[64];
+
+    snprintf(path, sizeof(path), "\\\\.\\%s", port);
+    handle = CreateFile(path, GENERIC_READ | GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL);
+    if(handle == INVALID_HANDLE_VALUE){
+        fprintf(stderr, "error opening %s: error %d\n", port, (int)GetLastError());
+        return -1;
+    }
+    memset(&dcb, 0, sizeof(dcb));
+    dcb.DCBlength = sizeof(dcb);
+    GetCommState(handle, &dcb);
+    dcb.BaudRate = 1200;
+    dcb.fDtrControl = DTR_CONTROL_DISABLE;
+    SetCommState(handle, &dcb);
+    CloseHandle(handle);
+#else
+int             fd;
+struct termios  tio;
+
+    if((fd = open(port, O_RDWR | O_NOCTTY | O_NONBLOCK)) < 0){
+        fprintf(stderr, "error opening %s: %s\n", port, strerror(errno));
+        return -1;
+    }
+    if(tcgetattr(fd, &tio) == 0){
+        cfsetispeed(&tio, B1200);
+        cfsetospeed(&tio, B1200);
+        tio.c_cflag |= HUPCL;   /* drop DTR on close */
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+    close(fd);
+#endif
+    return 0;
+}
+
+int fireTrigger(trigger_t *trigger)
+{
+usbDevice_t *dev;
+int         err;
+
+    switch(trigger->type){
+    case TRIGGER_HID:
+        if((err = usbOpenDevice(&dev, trigger->vendor, NULL, trigger->product, NULL, trigger->report[0] != 0)) != 0){
+            fprintf(stderr, "Error opening application device %04x:%04x: %s\n", trigger->vendor, trigger->product, usbErrorMessage(err));
+            return err;
+        }
+        usbSetReport(dev, USB_HID_REPORT_TYPE_FEATURE, trigger->report, trigger->reportLen);
+        /* Ignore errors, the application may reset before the request is
+         * acknowledged.
+         */
+        usbCloseDevice(dev);
+        return 0;
+    case TRIGGER_CDC:
+        return touchSerialPort(trigger->port);
+    }
+    return 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static int  waitForDeviceCount(int vendor, int product, int present, double timeout)
+{
+double  deadline = getTime() + timeout;
+
+    while((usbCountDevices(vendor, product) > 0) != present){
+        if(getTime() > deadline)
+            return USB_ERROR_NOTFOUND;
+        sleepMs(20);
+    }
+    return 0;
+}
+
+int runUpdate(char *file, trigger_t *trigger, int appVendor, int appProduct)
+{
+static char dataBuffer[IMAGE_BUFFER_SIZE];
+int         startAddr = IMAGE_BUFFER_SIZE, endAddr = 0, err;
+double      tStart, tTrigger, tBootLoader, tFlash, tReboot, tApp;
+
+    memset(dataBuffer, -1, sizeof(dataBuffer));
+    if(parseImageFile(file, dataBuffer, &startAddr, &endAddr))
+        return 1;
+    if(startAddr >= endAddr){
+        fprintf(stderr, "No data in input file, exiting.\n");
+        return 1;
+    }
+    if(appVendor == 0 && trigger->type == TRIGGER_HID){
+        appVendor = trigger->vendor;
+        appProduct = trigger->product;
+    }
+    tStart = getTime();
+    if(usbCountDevices(IDENT_VENDOR_NUM, IDENT_PRODUCT_NUM) == 0){
+        printf("Triggering boot loader...\n");
+        if(fireTrigger(trigger) != 0)
+            return 1;
+    }else{
+        printf("Boot loader is already active.\n");
+    }
+    tTrigger = getTime();
+    if(waitForBootLoader(NULL, ENUMERATION_TIMEOUT) != 0){
+        fprintf(stderr, "HIDBoot device did not appear within %d s\n", ENUMERATION_TIMEOUT);
+        return 1;
+    }
+    tBootLoader = getTime();
+    if((err = uploadData(dataBuffer, startAddr, endAddr, NULL, 1, NULL)) != 0)
+        return 1;
+    tFlash = getTime();     /* includes the exit report, the reboot follows it */
+    if(waitForDeviceCount(IDENT_VENDOR_NUM, IDENT_PRODUCT_NUM, 0, ENUMERATION_TIMEOUT) != 0)
+        fprintf(stderr, "Warning: HIDBoot device did not disconnect\n");
+    tReboot = getTime();
+    tApp = tReboot;
+    if(appVendor != 0){
+        if(waitForDeviceCount(appVendor, appProduct, 1, ENUMERATION_TIMEOUT) != 0){
+            fprintf(stderr, "Application %04x:%04x did not appear within %d s\n", appVendor, appProduct, ENUMERATION_TIMEOUT);
+            err = 1;
+        }
+        tApp = getTime();
+    }
+    if(traceFile != NULL){
+        traceSpan(TRACK_HOST, "trigger", tStart, tTrigger, NULL);
+        traceSpan(TRACK_HOST, "boot loader enumeration", tTrigger, tBootLoader, NULL);
+        traceSpan(TRACK_HOST, "flash", tBootLoader, tFlash, NULL);
+        traceSpan(TRACK_HOST, "reboot", tFlash, tReboot, NULL);
+        if(appVendor != 0)
+            traceSpan(TRACK_HOST, "application enumeration", tReboot, tApp, NULL);
+    }
+    printf("Phase timing:\n");
+    printf("  trigger             %8.3f s\n", tTrigger - tStart);
+    printf("  boot loader enum    %8.3f s\n", tBootLoader - tTrigger);
+    printf("  flash               %8.3f s\n", tFlash - tBootLoader);
+    printf("  reboot              %8.3f s\n", tReboot - tFlash);
+    if(appVendor != 0)
+        printf("  application enum    %8.3f s\n", tApp - tReboot);
+    printf("  total               %8.3f s\n", tApp - tStart);
+    return err != 0;
+}
+
+/* ------------------------------------------------------------------------- */
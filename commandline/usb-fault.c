@@ -0,0 +1,144 @@
+/* Name: usb-fault.c
+ * Project: usbcalls library
+ * Author: bootloadHID contributors
+ * Creation Date: 2026-10-19
+ * Tabsize: 4
+ * License: Proprietary, free under certain conditions. See Documentation.
+ * This Revision: $Id$
+ */
+
+/*
+General Description:
+This module injects transport faults into the calls of the usbcalls API, so
+that retry and recovery can be tested and their cost measured. It is
+included by usbcalls.c and consulted by the functions in usb-record.c before
+the backend is called. Faults are given as "<kind>@<when>":
+
+    delay:<ms>      usbSetReport() takes <ms> milliseconds longer
+    io              usbSetReport() fails with USB_ERROR_IO
+    truncate:<n>    usbGetReport() returns only <n> bytes
+    gone:<ms>       the device disappears for <ms> milliseconds: opening
+                    fails with USB_ERROR_NOTFOUND, transfers with
+                    USB_ERROR_IO and it is not counted
+
+    at=<n>          the fault hits the <n>th call (counting from 0) of the
+                    function it applies to, "gone" counts usbSetReport()
+    p=<x>           each call is hit with probability <x>
+
+The random numbers come from a fixed seed, so runs are reproducible.
+*/
+
+#define FAULT_DELAY     1
+#define FAULT_IO        2
+#define FAULT_TRUNCATE  3
+#define FAULT_GONE      4
+
+#define MAX_FAULTS      8
+
+typedef struct usbFault{
+    int     kind;       /* FAULT_* */
+    int     param;      /* milliseconds or bytes */
+    int     at;         /* call number or -1 */
+    double  probability;
+}usbFault_t;
+
+static usbFault_t   faults[MAX_FAULTS];
+static int          numFaults;
+static int          faultSetCalls, faultGetCalls;
+static double       faultGoneUntil;
+static unsigned     faultRandom = 1;
+
+/* ------------------------------------------------------------------------- */
+
+int usbAddFault(char *spec)
+{
+usbFault_t  *f;
+char        *when;
+
+    if(numFaults >= MAX_FAULTS || (when = strchr(spec, '@')) == NULL)
+        return -1;
+    f = &faults[numFaults];
+    f->param = 0;
+    f->at = -1;
+    f->probability = 0;
+    if(strncmp(spec, "delay:", 6) == 0){
+        f->kind = FAULT_DELAY;
+        f->param = atoi(spec + 6);
+    }else if(strncmp(spec, "io@", 3) == 0){
+        f->kind = FAULT_IO;
+    }else if(strncmp(spec, "truncate:", 9) == 0){
+        f->kind = FAULT_TRUNCATE;
+        f->param = atoi(spec + 9);
+    }else if(strncmp(spec, "gone:", 5) == 0){
+        f->kind = FAULT_GONE;
+        f->param = atoi(spec + 5);
+    }else{
+        return -1;
+    }
+    if(sscanf(when, "@at=%d", &f->at) != 1 && sscanf(when, "@p=%lf", &f->probability) != 1)
+        return -1;
+    numFaults++;
+    return 0;
+}
+
+void    usbClearFaults(void)
+{
+    numFaults = 0;
+    faultSetCalls = faultGetCalls = 0;
+    faultGoneUntil = 0;
+    faultRandom = 1;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static int  usbFaultHits(usbFault_t *f, int call)
+{
+    if(f->at >= 0)
+        return f->at == call;
+    faultRandom = faultRandom * 1103515245 + 12345;
+    return (faultRandom >> 8) % 1000000 < f->probability * 1e6;
+}
+
+static int  usbFaultGone(void)
+{
+    return faultGoneUntil > 0 && usbTime() < faultGoneUntil;
+}
+
+static int  usbFaultSet(void)
+/* called before usbSetReport(), returns an error code to fail with */
+{
+usbFault_t  *f;
+int         call = faultSetCalls++;
+
+    if(usbFaultGone())
+        return USB_ERROR_IO;
+    for(f = faults; f < faults + numFaults; f++){
+        if(f->kind == FAULT_TRUNCATE || !usbFaultHits(f, call))
+            continue;
+        switch(f->kind){
+        case FAULT_DELAY:
+            usbWait(f->param * 1e-3);
+            break;
+        case FAULT_IO:
+            return USB_ERROR_IO;
+        case FAULT_GONE:
+            faultGoneUntil = usbTime() + f->param * 1e-3;
+            return USB_ERROR_IO;
+        }
+    }
+    return 0;
+}
+
+static void usbFaultGet(int *len)
+/* called after a successful usbGetReport() */
+{
+usbFault_t  *f;
+int         call = faultGetCalls++;
+
+    for(f = faults; f < faults + numFaults; f++){
+        if(f->kind == FAULT_TRUNCATE && usbFaultHits(f, call) && *len > f->param)
+            *len = f->param;
+    }
+}
+
+/* ------------------------------------------------------------------------- */
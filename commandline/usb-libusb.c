@@ -24,7 +24,9 @@ devices differ in report ID usage, you must change the code.
 */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <usb.h>
 
 #define usbDevice   usb_dev_handle  /* use libusb's device structure */
@@ -36,6 +38,7 @@ devices differ in report ID usage, you must change the code.
 #define USBRQ_HID_SET_REPORT    0x09
 
 static int  usesReportIDs;
+static int  usbTimeout = 5000;
 
 /* ------------------------------------------------------------------------- */
 
@@ -63,13 +66,20 @@ int     rval, i;
     return i-1;
 }
 
-int usbOpenDevice(usbDevice_t **device, int vendor, char *vendorName, int product, char *productName, int _usesReportIDs)
+static int  usbLocationMatches(struct usb_bus *bus, struct usb_device *dev, char *location)
 {
-struct usb_bus      *bus;
-struct usb_device   *dev;
-usb_dev_handle      *handle = NULL;
-int                 errorCode = USB_ERROR_NOTFOUND;
-static int          didUsbInit = 0;
+int     busNum, devNum;
+
+    if(location == NULL)
+        return 1;
+    if(sscanf(location, "%d:%d", &busNum, &devNum) != 2)
+        return 0;
+    return atoi(bus->dirname) == busNum && atoi(dev->filename) == devNum;
+}
+
+static void usbRescan(void)
+{
+static int  didUsbInit = 0;
 
     if(!didUsbInit){
         usb_init();
@@ -77,9 +87,40 @@ static int          didUsbInit = 0;
     }
     usb_find_busses();
     usb_find_devices();
+}
+
+int usbCountDevices(int vendor, int product)
+{
+struct usb_bus      *bus;
+struct usb_device   *dev;
+int                 count = 0;
+
+    usbRescan();
     for(bus=usb_get_busses(); bus; bus=bus->next){
         for(dev=bus->devices; dev; dev=dev->next){
-            if(dev->descriptor.idVendor == vendor && dev->descriptor.idProduct == product){
+            if(dev->descriptor.idVendor == vendor && dev->descriptor.idProduct == product)
+                count++;
+        }
+    }
+    return count;
+}
+
+int usbOpenDevice(usbDevice_t **device, int vendor, char *vendorName, int product, char *productName, int _usesReportIDs)
+{
+    return usbOpenDeviceAt(device, NULL, vendor, vendorName, product, productName, _usesReportIDs);
+}
+
+int usbOpenDeviceAt(usbDevice_t **device, char *location, int vendor, char *vendorName, int product, char *productName, int _usesReportIDs)
+{
+struct usb_bus      *bus;
+struct usb_device   *dev;
+usb_dev_handle      *handle = NULL;
+int                 errorCode = USB_ERROR_NOTFOUND;
+
+    usbRescan();
+    for(bus=usb_get_busses(); bus; bus=bus->next){
+        for(dev=bus->devices; dev; dev=dev->next){
+            if(dev->descriptor.idVendor == vendor && dev->descriptor.idProduct == product && usbLocationMatches(bus, dev, location)){
                 char    string[256];
                 int     len;
                 handle = usb_open(dev); /* we need to open the device in order to query strings */
@@ -150,6 +191,13 @@ static int          didUsbInit = 0;
 
 /* ------------------------------------------------------------------------- */
 
+void    usbSetTimeout(int milliseconds)
+{
+    usbTimeout = milliseconds;
+}
+
+/* ------------------------------------------------------------------------- */
+
 void    usbCloseDevice(usbDevice_t *device)
 {
     if(device != NULL)
@@ -166,7 +214,7 @@ int bytesSent;
         buffer++;   /* skip dummy report ID */
         len--;
     }
-    bytesSent = usb_control_msg(device, USB_TYPE_CLASS | USB_RECIP_INTERFACE | USB_ENDPOINT_OUT, USBRQ_HID_SET_REPORT, reportType << 8 | buffer[0], 0, buffer, len, 5000);
+    bytesSent = usb_control_msg(device, USB_TYPE_CLASS | USB_RECIP_INTERFACE | USB_ENDPOINT_OUT, USBRQ_HID_SET_REPORT, reportType << 8 | buffer[0], 0, buffer, len, usbTimeout);
     if(bytesSent != len){
         if(bytesSent < 0)
             fprintf(stderr, "Error sending message: %s\n", usb_strerror());
@@ -185,7 +233,7 @@ int bytesReceived, maxLen = *len;
         buffer++;   /* make room for dummy report ID */
         maxLen--;
     }
-    bytesReceived = usb_control_msg(device, USB_TYPE_CLASS | USB_RECIP_INTERFACE | USB_ENDPOINT_IN, USBRQ_HID_GET_REPORT, reportType << 8 | reportNumber, 0, buffer, maxLen, 5000);
+    bytesReceived = usb_control_msg(device, USB_TYPE_CLASS | USB_RECIP_INTERFACE | USB_ENDPOINT_IN, USBRQ_HID_GET_REPORT, reportType << 8 | reportNumber, 0, buffer, maxLen, usbTimeout);
     if(bytesReceived < 0){
         fprintf(stderr, "Error sending message: %s\n", usb_strerror());
         return USB_ERROR_IO;
@@ -200,4 +248,29 @@ int bytesReceived, maxLen = *len;
 
 /* ------------------------------------------------------------------------- */
 
+int usbReadInterrupt(usbDevice_t *device, char *buffer, int *len, int timeout)
+{
+int bytesReceived, maxLen = *len;
+
+    if(!usesReportIDs){
+        buffer++;   /* make room for dummy report ID */
+        maxLen--;
+    }
+    bytesReceived = usb_interrupt_read(device, USB_ENDPOINT_IN | 1, buffer, maxLen, timeout);
+    if(bytesReceived == -ETIMEDOUT)
+        return USB_ERROR_TIMEOUT;
+    if(bytesReceived < 0){
+        fprintf(stderr, "Error reading interrupt endpoint: %s\n", usb_strerror());
+        return USB_ERROR_IO;
+    }
+    *len = bytesReceived;
+    if(!usesReportIDs){
+        buffer[-1] = 0;     /* add dummy report ID */
+        (*len)++;
+    }
+    return 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
 
@@ -0,0 +1,529 @@
+/* Name: usb-record.c
+ * Project: usbcalls library
+ * Author: bootloadHID contributors
+ * Creation Date: 2026-10-19
+ * Tabsize: 4
+ * License: Proprietary, free under certain conditions. See Documentation.
+ * This Revision: $Id$
+ */
+
+/*
+General Description:
+This module sits between the usbcalls API and the platform backend, which
+usbcalls.c includes with its functions renamed to usbBackend*(). It can
+record every call with its buffer, result and duration to a file, and it can
+replay such a recording instead of accessing real devices. This allows
+sessions captured with a particular board to be reproduced offline.
+Sessions with the simulated device of usb-sim.c are recorded as well. The
+faults of usb-fault.c are applied on top of the backend, the replay or the
+simulated device of usb-sim.c.
+
+The file starts with the 8 byte signature "HBREC01\n", followed by one
+record per call:
+
+    call        1 byte      one of the REC_* constants below
+    result      4 bytes     return value (signed, little endian)
+    duration    4 bytes     microseconds the call took
+    length      2 bytes     length of the data which follows
+    data                    SET_REPORT: report sent, GET_REPORT and
+                            interrupt read: report received, open: the
+                            location (may be empty)
+
+During replay, calls must come in the same order as recorded. The recorded
+results and data are returned after waiting for the recorded duration times
+the speed factor (0 returns immediately). If a report sent differs from the
+recording, a warning is printed, so replay can be used to check that changes
+to the host software still produce the same transfers. Device counts are
+optional in both directions: recorded ones are skipped if the replaying run
+does not count (e.g. without "--stats"), and counts which were not recorded
+are answered with 1.
+
+Interrupt reads (the status reports of status.c) run in a thread of their
+own, so their order relative to the other calls is not reproducible. Reads
+which timed out are not recorded. On replay, an interrupt read returns the
+next recorded one once all calls recorded before it have been replayed;
+other calls which come across interrupt records queue them for it. Access
+to the files is serialized for this.
+
+usbMonitorTo() additionally writes the report transfers of a session (real,
+replayed or simulated) in the format of a Linux usbmon capture, as text or,
+if the file name ends in ".pcap", as pcap file with link type 189. Each call
+becomes a submission and a completion event with its setup packet, the
+device is always 1:005. Interrupt transfers are not included. This gives
+hidbootmon input with known contents and timing.
+*/
+
+#define REC_OPEN    1
+#define REC_COUNT   2
+#define REC_CLOSE   3
+#define REC_SET     4
+#define REC_GET     5
+#define REC_INTR    6
+
+#define REC_QUEUE_SIZE  16      /* interrupt reads found ahead of other calls */
+#define REC_POLL_MS     10      /* interrupt replay checks the queue this often */
+
+#define REC_SIGNATURE   "HBREC01\n"
+
+static FILE     *recordFile;
+static FILE     *replayFile;
+static double   replaySpeed;
+static int      replayMismatches;
+static char     replayDevice;   /* we need a unique non-NULL pointer */
+static struct{
+    int     result, len;
+    char    data[64];
+}               replayQueue[REC_QUEUE_SIZE];
+static int      replayQueueHead, replayQueueCount;
+#ifndef WIN32
+static pthread_mutex_t  recLock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+static FILE     *monitorFile;
+static int      monitorPcap;
+static double   monitorStart;
+static unsigned monitorUrbs;
+
+/* ------------------------------------------------------------------------- */
+
+static void usbRecPutInt(unsigned value, int numBytes)
+{
+    while(numBytes--){
+        putc(value & 0xff, recordFile);
+        value >>= 8;
+    }
+}
+
+static void usbRecLock(void)
+{
+#ifndef WIN32
+    pthread_mutex_lock(&recLock);
+#endif
+}
+
+static void usbRecUnlock(void)
+{
+#ifndef WIN32
+    pthread_mutex_unlock(&recLock);
+#endif
+}
+
+static void usbRecWrite(int call, int result, double start, char *data, int len)
+{
+    if(recordFile == NULL)
+        return;
+    if(len < 0)
+        len = 0;
+    usbRecLock();
+    usbRecPutInt(call, 1);
+    usbRecPutInt(result, 4);
+    usbRecPutInt((unsigned)((usbTime() - start) * 1e6), 4);
+    usbRecPutInt(len, 2);
+    fwrite(data, 1, len, recordFile);
+    usbRecUnlock();
+}
+
+static unsigned usbRecGetInt(int numBytes)
+{
+unsigned    value = 0;
+int         i, c;
+
+    for(i = 0; i < numBytes; i++){
+        if((c = getc(replayFile)) == EOF)
+            return 0;
+        value |= (unsigned)c << (8 * i);
+    }
+    return value;
+}
+
+static unsigned usbRecGetRecord(int *result, char *data, int *len)
+/* reads the rest of a record into 'data' (at most '*len' bytes); returns the
+ * recorded duration in microseconds */
+{
+int         recLen, i;
+unsigned    micros;
+
+    *result = (int)usbRecGetInt(4);
+    micros = usbRecGetInt(4);
+    recLen = usbRecGetInt(2);
+    for(i = 0; i < recLen; i++){
+        if(i < *len){
+            data[i] = getc(replayFile);
+        }else{
+            getc(replayFile);
+        }
+    }
+    *len = recLen;
+    return micros;
+}
+
+static void usbRecQueueInterrupt(void)
+/* moves an interrupt record from the file to the queue */
+{
+int     result, len, i;
+char    data[sizeof(replayQueue[0].data)];
+
+    len = sizeof(data);
+    usbRecGetRecord(&result, data, &len);
+    if(len > sizeof(data))
+        len = sizeof(data);
+    if(replayQueueCount >= REC_QUEUE_SIZE)
+        return;     /* the reader fell behind, lose the report as a device would */
+    i = (replayQueueHead + replayQueueCount++) % REC_QUEUE_SIZE;
+    replayQueue[i].result = result;
+    replayQueue[i].len = len;
+    memcpy(replayQueue[i].data, data, len);
+}
+
+static int  usbRecRead(int call, int *result, char *data, int *len)
+/* reads the next record, which must be for 'call'; returns 0 on success */
+{
+int         recCall, optional = call == REC_COUNT || call == REC_INTR, skipped, skipLen;
+unsigned    micros;
+
+    usbRecLock();
+    for(;;){
+        if((recCall = getc(replayFile)) == EOF){
+            usbRecUnlock();
+            if(!optional)
+                fprintf(stderr, "Replay: end of recording\n");
+            return -1;
+        }
+        if(recCall == call)
+            break;
+        if(recCall == REC_INTR){
+            usbRecQueueInterrupt();
+        }else if(recCall == REC_COUNT){     /* counting is optional, e.g. for statistics */
+            skipLen = 0;
+            usbRecGetRecord(&skipped, NULL, &skipLen);
+        }else{
+            ungetc(recCall, replayFile);
+            usbRecUnlock();
+            if(!optional)
+                fprintf(stderr, "Replay: call %d does not match recorded call %d\n", call, recCall);
+            return -1;
+        }
+    }
+    micros = usbRecGetRecord(result, data, len);
+    usbRecUnlock();
+    if(replaySpeed > 0 && call != REC_INTR)
+        usbWait(micros * 1e-6 * replaySpeed);
+    return 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void usbMonPutInt(unsigned value, int numBytes)
+{
+    while(numBytes--){
+        putc(value & 0xff, monitorFile);
+        value >>= 8;
+    }
+}
+
+static void usbMonEvent(int type, unsigned long long tag, double time, unsigned char *setup, int status, int length, char *data, int len)
+/* writes a submission ('S', with 'setup') or completion ('C') of 'length'
+ * bytes, of which the first 'len' are captured */
+{
+int             isIn = setup[0] & 0x80, i;
+unsigned long   micros = (unsigned long)((time - monitorStart) * 1e6) + 1000000;
+
+    if(monitorPcap){
+        usbMonPutInt(micros / 1000000, 4);  /* record header */
+        usbMonPutInt(micros % 1000000, 4);
+        usbMonPutInt(48 + len, 4);
+        usbMonPutInt(48 + len, 4);
+        usbMonPutInt((unsigned)tag, 4);     /* usbmon header */
+        usbMonPutInt((unsigned)(tag >> 32), 4);
+        putc(type, monitorFile);
+        putc(2, monitorFile);               /* control transfer */
+        putc(isIn ? 0x80 : 0, monitorFile); /* endpoint 0 */
+        putc(5, monitorFile);               /* device */
+        usbMonPutInt(1, 2);                 /* bus */
+        putc(type == 'S' ? 0 : '-', monitorFile);   /* setup packet present */
+        putc(len > 0 ? 0 : (isIn ? '<' : '>'), monitorFile);
+        usbMonPutInt(micros / 1000000, 4);
+        usbMonPutInt(0, 4);
+        usbMonPutInt(micros % 1000000, 4);
+        usbMonPutInt(status, 4);
+        usbMonPutInt(length, 4);
+        usbMonPutInt(len, 4);
+        fwrite(setup, 1, 8, monitorFile);
+        fwrite(data, 1, len, monitorFile);
+        return;
+    }
+    fprintf(monitorFile, "%016llx %lu %c C%c:1:005:0 ", tag, micros, type, isIn ? 'i' : 'o');
+    if(type == 'S'){
+        fprintf(monitorFile, "s %02x %02x %04x %04x %04x %d", setup[0], setup[1],
+            setup[2] | setup[3] << 8, setup[4] | setup[5] << 8, setup[6] | setup[7] << 8, length);
+    }else{
+        fprintf(monitorFile, "%d %d", status, length);
+    }
+    if(len > 0){
+        fprintf(monitorFile, " =");
+        for(i = 0; i < len && i < 32; i++)  /* usbmon shows at most 32 bytes */
+            fprintf(monitorFile, "%s%02x", i % 4 == 0 ? " " : "", data[i] & 0xff);
+    }else if(type == 'S' || !isIn){
+        fprintf(monitorFile, " %c", isIn ? '<' : '>');
+    }
+    fprintf(monitorFile, "\n");
+}
+
+static void usbMonWrite(int reportType, int reportID, int isIn, double start, int err, char *data, int wLength, int len)
+{
+unsigned char       setup[8];
+unsigned long long  tag;
+
+    if(monitorFile == NULL)
+        return;
+    tag = 0xffff880000000000ULL + (unsigned long long)(monitorUrbs++ % 4) * 0xc0;
+    setup[0] = isIn ? 0xa1 : 0x21;
+    setup[1] = isIn ? 0x01 : 0x09;      /* GET_REPORT, SET_REPORT */
+    setup[2] = reportID;
+    setup[3] = reportType;
+    setup[4] = setup[5] = 0;            /* interface */
+    setup[6] = wLength;
+    setup[7] = wLength >> 8;
+    usbMonEvent('S', tag, start, setup, -115, wLength, data, isIn ? 0 : len);  /* -EINPROGRESS */
+    if(err != 0)
+        len = 0;
+    usbMonEvent('C', tag, usbTime(), setup, err != 0 ? -32 : 0, len, data, isIn ? len : 0);
+    fflush(monitorFile);
+}
+
+int usbMonitorTo(char *file)
+{
+int     len = strlen(file);
+
+    if((monitorFile = fopen(file, "wb")) == NULL){
+        fprintf(stderr, "error opening %s: %s\n", file, strerror(errno));
+        return -1;
+    }
+    monitorPcap = len > 5 && strcmp(file + len - 5, ".pcap") == 0;
+    if(monitorPcap){
+        usbMonPutInt(0xa1b2c3d4, 4);
+        usbMonPutInt(2, 2);
+        usbMonPutInt(4, 2);
+        usbMonPutInt(0, 4);
+        usbMonPutInt(0, 4);
+        usbMonPutInt(65535, 4);
+        usbMonPutInt(189, 4);           /* LINKTYPE_USB_LINUX */
+    }
+    monitorStart = usbTime();
+    return 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+int usbRecordTo(char *file)
+{
+    if((recordFile = fopen(file, "wb")) == NULL){
+        fprintf(stderr, "error opening %s: %s\n", file, strerror(errno));
+        return -1;
+    }
+    fputs(REC_SIGNATURE, recordFile);
+    return 0;
+}
+
+int usbReplayFrom(char *file, double speed)
+{
+char    signature[sizeof(REC_SIGNATURE)] = {0};
+
+    if((replayFile = fopen(file, "rb")) == NULL){
+        fprintf(stderr, "error opening %s: %s\n", file, strerror(errno));
+        return -1;
+    }
+    if(fread(signature, 1, strlen(REC_SIGNATURE), replayFile) != strlen(REC_SIGNATURE) || strcmp(signature, REC_SIGNATURE) != 0){
+        fprintf(stderr, "%s: not a usbcalls recording\n", file);
+        fclose(replayFile);
+        replayFile = NULL;
+        return -1;
+    }
+    replaySpeed = speed;
+    return 0;
+}
+
+int usbReplayMismatches(void)
+{
+    return replayMismatches;
+}
+
+/* ------------------------------------------------------------------------- */
+
+int usbCountDevices(int vendor, int product)
+{
+int     count, len = 0;
+double  start;
+
+    if(usbFaultGone())
+        return 0;
+    if(replayFile != NULL){
+        if(usbRecRead(REC_COUNT, &count, NULL, &len) != 0)
+            return 1;   /* not recorded, assume the device is there */
+        return count;
+    }
+    start = usbTime();
+    count = simFlash != NULL ? 1 : usbBackendCountDevices(vendor, product);
+    usbRecWrite(REC_COUNT, count, start, NULL, 0);
+    return count;
+}
+
+int usbOpenDeviceAt(usbDevice_t **device, char *location, int vendor, char *vendorName, int product, char *productName, int usesReportIDs)
+{
+int     err, len = 0;
+double  start;
+
+    if(usbFaultGone())
+        return USB_ERROR_NOTFOUND;
+    if(replayFile != NULL){
+        if(usbRecRead(REC_OPEN, &err, NULL, &len) != 0)
+            return USB_ERROR_NOTFOUND;
+        if(err == 0)
+            *device = (usbDevice_t *)&replayDevice;
+        return err;
+    }
+    start = usbTime();
+    if(simFlash != NULL){
+        *device = (usbDevice_t *)&simDevice;
+        err = 0;
+    }else{
+        err = usbBackendOpenDeviceAt(device, location, vendor, vendorName, product, productName, usesReportIDs);
+    }
+    usbRecWrite(REC_OPEN, err, start, location, location != NULL ? strlen(location) : 0);
+    return err;
+}
+
+int usbOpenDevice(usbDevice_t **device, int vendor, char *vendorName, int product, char *productName, int usesReportIDs)
+{
+    return usbOpenDeviceAt(device, NULL, vendor, vendorName, product, productName, usesReportIDs);
+}
+
+void    usbSetTimeout(int milliseconds)
+{
+    if(replayFile == NULL && simFlash == NULL)
+        usbBackendSetTimeout(milliseconds);
+}
+
+void    usbCloseDevice(usbDevice_t *device)
+{
+int     result, len = 0;
+double  start;
+
+    if(replayFile != NULL){
+        usbRecRead(REC_CLOSE, &result, NULL, &len);
+        return;
+    }
+    start = usbTime();
+    if(simFlash == NULL)
+        usbBackendCloseDevice(device);
+    usbRecWrite(REC_CLOSE, 0, start, NULL, 0);
+}
+
+int usbSetReport(usbDevice_t *device, int reportType, char *buffer, int len)
+{
+char    recorded[256];
+int     err, recLen = sizeof(recorded);
+double  start;
+
+    if((err = usbFaultSet()) != 0)
+        return err;
+    start = usbTime();
+    if(replayFile != NULL){
+        if(usbRecRead(REC_SET, &err, recorded, &recLen) != 0)
+            err = USB_ERROR_IO;
+        else if(recLen != len || memcmp(recorded, buffer, len < sizeof(recorded) ? len : sizeof(recorded)) != 0){
+            if(replayMismatches++ == 0)
+                fprintf(stderr, "Replay: report %d differs from recording\n", buffer[0]);
+        }
+    }else{
+        if(simFlash != NULL){
+            err = usbSimSetReport(buffer, len);
+        }else{
+            err = usbBackendSetReport(device, reportType, buffer, len);
+        }
+        usbRecWrite(REC_SET, err, start, buffer, len);
+    }
+    usbMonWrite(reportType, buffer[0] & 0xff, 0, start, err, buffer, len, len);
+    return err;
+}
+
+int usbGetReport(usbDevice_t *device, int reportType, int reportID, char *buffer, int *len)
+{
+int     err, recLen = *len, wLength = *len;
+double  start;
+
+    if(usbFaultGone())
+        return USB_ERROR_IO;
+    start = usbTime();
+    if(replayFile != NULL){
+        if(usbRecRead(REC_GET, &err, buffer, &recLen) != 0)
+            return USB_ERROR_IO;
+        if(err == 0)
+            *len = recLen < *len ? recLen : *len;
+    }else{
+        if(simFlash != NULL){
+            err = usbSimGetReport(reportID, buffer, len);
+        }else{
+            err = usbBackendGetReport(device, reportType, reportID, buffer, len);
+        }
+        usbRecWrite(REC_GET, err, start, buffer, err == 0 ? *len : 0);
+    }
+    usbMonWrite(reportType, reportID, 1, start, err, buffer, wLength, *len);
+    if(err == 0)
+        usbFaultGet(len);
+    return err;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static int  usbReplayInterrupt(char *buffer, int *len, int timeout)
+/* returns the next recorded interrupt read, see the description above */
+{
+int     err, recLen, waited;
+
+    for(waited = 0; ; waited += REC_POLL_MS){
+        usbRecLock();
+        if(replayQueueCount > 0){
+            err = replayQueue[replayQueueHead].result;
+            recLen = replayQueue[replayQueueHead].len;
+            if(recLen > *len)
+                recLen = *len;
+            memcpy(buffer, replayQueue[replayQueueHead].data, recLen);
+            *len = recLen;
+            replayQueueHead = (replayQueueHead + 1) % REC_QUEUE_SIZE;
+            replayQueueCount--;
+            usbRecUnlock();
+            return err;
+        }
+        usbRecUnlock();
+        recLen = *len;
+        if(usbRecRead(REC_INTR, &err, buffer, &recLen) == 0){
+            *len = recLen < *len ? recLen : *len;
+            return err;
+        }
+        if(waited >= timeout)
+            return USB_ERROR_TIMEOUT;
+        usbWait(REC_POLL_MS * 1e-3);
+    }
+}
+
+int usbReadInterrupt(usbDevice_t *device, char *buffer, int *len, int timeout)
+{
+int     err;
+double  start;
+
+    if(usbFaultGone())
+        return USB_ERROR_IO;
+    if(replayFile != NULL)
+        return usbReplayInterrupt(buffer, len, timeout);
+    start = usbTime();
+    if(simFlash != NULL){
+        err = usbSimReadInterrupt(buffer, len, timeout);
+    }else{
+        err = usbBackendReadInterrupt(device, buffer, len, timeout);
+    }
+    if(err != USB_ERROR_TIMEOUT)
+        usbRecWrite(REC_INTR, err, start, buffer, err == 0 ? *len : 0);
+    return err;
+}
+
+/* ------------------------------------------------------------------------- */
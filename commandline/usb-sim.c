@@ -0,0 +1,266 @@
+/* Name: usb-sim.c
+ * Project: usbcalls library
+ * Author: bootloadHID contributors
+ * Creation Date: 2026-10-19
+ * Tabsize: 4
+ * License: Proprietary, free under certain conditions. See Documentation.
+ * This Revision: $Id$
+ */
+
+/*
+General Description:
+This module simulates a HIDBoot device in the process, so that the host
+software can be exercised and benchmarked without hardware. It is included
+by usbcalls.c and used by the functions in usb-record.c after
+usbSimulate() was called.
+
+The simulated device answers report 1 with its page and flash size, the
+start of the boot loader and its features (protocol version 2), writes
+the data of report 2 to its flash (erasing a page when its first byte is
+written and filling the rest of the page with 0xff after a short report),
+reads flash back through report 3, reads and writes an EEPROM of
+SIM_EEPROM_SIZE bytes through report 4, returns the CRC-32 of the
+application section with report 5, replaces up to 32 bytes of a page with
+report 7, returns its counters with report 8 (times spent erasing and
+writing, pages and SETUP packets; the other times are 0) and counts exit
+requests. After each page write, it posts report 6
+(page address and result) for usbReadInterrupt(). Like the V-USB boot
+loader, it keeps only the latest one. Each transfer takes a configurable
+time: a fixed time per report plus a time per page erase and per page
+write, the same model the boot loaders follow.
+*/
+
+#define SIM_EEPROM_SIZE 4096    /* largest of the supported MCUs */
+
+static char     *simFlash;
+static char     simEeprom[SIM_EEPROM_SIZE];
+static int      simFlashSize, simPageSize, simBootStart;
+static double   simReportTime, simPageTime;
+static int      simExits;
+static int      simReadAddress;
+static char     simDevice;      /* unique non-NULL pointer for the handle */
+static char     simStatus[5];   /* report 6, simStatus[0] is 0 if none is due */
+static double   simEraseTime, simWriteTime;     /* report 8 */
+static int      simErased, simWritten, simSetups;
+#ifndef WIN32
+static pthread_mutex_t  simStatusLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t   simStatusPosted = PTHREAD_COND_INITIALIZER;
+#endif
+
+/* ------------------------------------------------------------------------- */
+
+int usbSimulate(int flashSize, int pageSize, int bootSize, double reportTime, double pageTime)
+{
+    free(simFlash);
+    simFlash = malloc(flashSize);
+    memset(simFlash, 0xff, flashSize);
+    simFlashSize = flashSize;
+    simPageSize = pageSize;
+    simBootStart = flashSize - bootSize;
+    simReportTime = reportTime;
+    simPageTime = pageTime;
+    simExits = 0;
+    simStatus[0] = 0;
+    simEraseTime = simWriteTime = 0;
+    simErased = simWritten = simSetups = 0;
+    memset(simEeprom, 0xff, sizeof(simEeprom));
+    return 0;
+}
+
+char    *usbSimulatedFlash(int *exits)
+{
+    if(exits != NULL)
+        *exits = simExits;
+    return simFlash;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static void usbSimPostStatus(int address)
+{
+int     i;
+
+#ifndef WIN32
+    pthread_mutex_lock(&simStatusLock);
+#endif
+    simStatus[0] = 6;
+    for(i = 0; i < 3; i++)
+        simStatus[1 + i] = address >> (8 * i);
+    simStatus[4] = 0;   /* written */
+#ifndef WIN32
+    pthread_cond_signal(&simStatusPosted);
+    pthread_mutex_unlock(&simStatusLock);
+#endif
+}
+
+static int  usbSimReadInterrupt(char *buffer, int *len, int timeout)
+{
+int     err = USB_ERROR_TIMEOUT;
+#ifndef WIN32
+struct timespec deadline;
+
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    deadline.tv_sec += timeout / 1000;
+    deadline.tv_nsec += (timeout % 1000) * 1000000L;
+    if(deadline.tv_nsec >= 1000000000L){
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+    pthread_mutex_lock(&simStatusLock);
+    while(simStatus[0] == 0 && simFlash != NULL){
+        if(pthread_cond_timedwait(&simStatusPosted, &simStatusLock, &deadline) != 0)
+            break;
+    }
+#endif
+    if(simStatus[0] != 0 && *len >= sizeof(simStatus)){
+        memcpy(buffer, simStatus, sizeof(simStatus));
+        *len = sizeof(simStatus);
+        simStatus[0] = 0;
+        err = 0;
+    }
+#ifndef WIN32
+    pthread_mutex_unlock(&simStatusLock);
+#endif
+    return err;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static int  usbSimSetReport(char *buffer, int len)
+{
+int     address, i, page = -1;
+double  delay = simReportTime;
+
+    simSetups++;
+    if(buffer[0] == 1){
+        simExits++;
+    }else if(buffer[0] == 3 && len >= 4){
+        simReadAddress = (buffer[1] & 0xff) | (buffer[2] & 0xff) << 8 | (buffer[3] & 0xff) << 16;
+    }else if(buffer[0] == 4 && len >= 4){
+        address = (buffer[1] & 0xff) | (buffer[2] & 0xff) << 8 | (buffer[3] & 0xff) << 16;
+        if(address + len - 4 > SIM_EEPROM_SIZE)
+            return USB_ERROR_IO;
+        memcpy(simEeprom + address, buffer + 4, len - 4);
+    }else if(buffer[0] == 2 && len >= 4){
+        address = (buffer[1] & 0xff) | (buffer[2] & 0xff) << 8 | (buffer[3] & 0xff) << 16;
+        for(i = 0; i < len - 4; i++, address++){
+            if(address >= simFlashSize)
+                return USB_ERROR_IO;    /* the real device would stall */
+            if((address & (simPageSize - 1)) == 0){
+                memset(simFlash + address, 0xff, simPageSize);
+                delay += simPageTime / 2;       /* erase */
+                simEraseTime += simPageTime / 2;
+                simErased++;
+            }
+            simFlash[address] = buffer[4 + i];
+            if(((address + 1) & (simPageSize - 1)) == 0){
+                delay += simPageTime / 2;       /* write */
+                page = address & ~(simPageSize - 1);
+            }
+        }
+        if(len < 132 && (address & (simPageSize - 1)) != 0){
+            memset(simFlash + address, 0xff, simPageSize - (address & (simPageSize - 1)));
+            delay += simPageTime / 2;           /* short report: page is padded and written */
+            page = address & ~(simPageSize - 1);
+        }
+        if(page >= 0){
+            simWriteTime += simPageTime / 2;
+            simWritten++;
+        }
+    }else if(buffer[0] == 7 && len >= 5){
+        address = (buffer[1] & 0xff) | (buffer[2] & 0xff) << 8 | (buffer[3] & 0xff) << 16;
+        if(len - 5 < (buffer[4] & 0xff) || address + (buffer[4] & 0xff) > simFlashSize)
+            return USB_ERROR_IO;
+        page = address & ~(simPageSize - 1);
+        if(address + (buffer[4] & 0xff) > page + simPageSize)
+            return USB_ERROR_IO;    /* a patch stays within its page */
+        memcpy(simFlash + address, buffer + 5, buffer[4] & 0xff);
+        delay += simPageTime;       /* erase and write */
+        simEraseTime += simPageTime / 2;
+        simWriteTime += simPageTime / 2;
+        simErased++;
+        simWritten++;
+    }else{
+        return USB_ERROR_IO;
+    }
+    usbWait(delay);
+    if(page >= 0)
+        usbSimPostStatus(page);
+    return 0;
+}
+
+static int  usbSimGetReport(int reportID, char *buffer, int *len)
+{
+int             i, bit;
+unsigned long   crc, ticks[2];
+
+    simSetups++;
+    if((reportID == 3 || reportID == 4) && *len >= 132){
+        if(simReadAddress + 128 > (reportID == 3 ? simFlashSize : SIM_EEPROM_SIZE))
+            return USB_ERROR_IO;
+        buffer[0] = reportID;
+        for(i = 0; i < 3; i++)
+            buffer[1 + i] = simReadAddress >> (8 * i);
+        memcpy(buffer + 4, (reportID == 3 ? simFlash : simEeprom) + simReadAddress, 128);
+        simReadAddress += 128;
+        *len = 132;
+        usbWait(simReportTime);
+        return 0;
+    }
+    if(reportID == 5 && *len >= 9){
+        crc = 0xffffffff;
+        for(i = 0; i < simBootStart; i++){
+            crc ^= simFlash[i] & 0xff;
+            for(bit = 0; bit < 8; bit++)
+                crc = (crc >> 1) ^ (crc & 1 ? 0xedb88320 : 0);
+        }
+        crc = ~crc;
+        buffer[0] = 5;
+        for(i = 0; i < 4; i++){
+            buffer[1 + i] = crc >> (8 * i);
+            buffer[5 + i] = simBootStart >> (8 * i);
+        }
+        *len = 9;
+        usbWait(simReportTime);
+        return 0;
+    }
+    if(reportID == 8 && *len >= 29){
+        memset(buffer, 0, 29);
+        buffer[0] = 8;
+        buffer[1] = 1000 & 0xff;    /* ticks per ms */
+        buffer[2] = 1000 >> 8;
+        ticks[0] = (unsigned long)(simEraseTime * 1e6);
+        ticks[1] = (unsigned long)(simWriteTime * 1e6);
+        for(i = 0; i < 4; i++){
+            buffer[3 + i] = ticks[0] >> (8 * i);
+            buffer[7 + i] = ticks[1] >> (8 * i);
+        }
+        for(i = 0; i < 2; i++){
+            buffer[23 + i] = simErased >> (8 * i);
+            buffer[25 + i] = simWritten >> (8 * i);
+            buffer[27 + i] = simSetups >> (8 * i);
+        }
+        *len = 29;
+        usbWait(simReportTime);
+        return 0;
+    }
+    if(reportID != 1 || *len < 16)
+        return USB_ERROR_IO;
+    buffer[0] = 1;
+    for(i = 0; i < 2; i++)
+        buffer[1 + i] = simPageSize >> (8 * i);
+    for(i = 0; i < 4; i++){
+        buffer[3 + i] = simFlashSize >> (8 * i);
+        buffer[8 + i] = simBootStart >> (8 * i);
+    }
+    buffer[7] = 2;          /* protocol version */
+    buffer[12] = 128;       /* data bytes per report */
+    buffer[13] = 0;
+    buffer[14] = 7 | 64 | 128;  /* read, EEPROM, fingerprint, short data, status */
+    buffer[15] = 1 | 2;         /* patch, counters */
+    *len = 16;
+    usbWait(simReportTime);
+    return 0;
+}
+
+/* ------------------------------------------------------------------------- */
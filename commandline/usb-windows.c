@@ -17,6 +17,7 @@ hidsdi.h.
 */
 
 #include <stdio.h>
+#include <string.h>
 #include <windows.h>
 #include <setupapi.h>
 #include "hidsdi.h"
@@ -47,14 +48,52 @@ char            *ascii = buffer;
     *ascii++ = 0;
 }
 
+int usbCountDevices(int vendor, int product)
+{
+GUID                                hidGuid;
+HDEVINFO                            deviceInfoList;
+SP_DEVICE_INTERFACE_DATA            deviceInfo;
+SP_DEVICE_INTERFACE_DETAIL_DATA     *deviceDetails;
+DWORD                               size;
+HANDLE                              handle;
+HIDD_ATTRIBUTES                     deviceAttributes;
+int                                 i, count = 0;
+
+    HidD_GetHidGuid(&hidGuid);
+    deviceInfoList = SetupDiGetClassDevs(&hidGuid, NULL, NULL, DIGCF_PRESENT | DIGCF_INTERFACEDEVICE);
+    deviceInfo.cbSize = sizeof(deviceInfo);
+    for(i=0; SetupDiEnumDeviceInterfaces(deviceInfoList, 0, &hidGuid, i, &deviceInfo); i++){
+        SetupDiGetDeviceInterfaceDetail(deviceInfoList, &deviceInfo, NULL, 0, &size, NULL);
+        deviceDetails = malloc(size);
+        deviceDetails->cbSize = sizeof(*deviceDetails);
+        SetupDiGetDeviceInterfaceDetail(deviceInfoList, &deviceInfo, deviceDetails, size, &size, NULL);
+        /* open without access rights, this is sufficient to query attributes */
+        handle = CreateFile(deviceDetails->DevicePath, 0, FILE_SHARE_READ|FILE_SHARE_WRITE, NULL, OPEN_EXISTING, 0, NULL);
+        free(deviceDetails);
+        if(handle == INVALID_HANDLE_VALUE)
+            continue;
+        deviceAttributes.Size = sizeof(deviceAttributes);
+        if(HidD_GetAttributes(handle, &deviceAttributes) && deviceAttributes.VendorID == vendor && deviceAttributes.ProductID == product)
+            count++;
+        CloseHandle(handle);
+    }
+    SetupDiDestroyDeviceInfoList(deviceInfoList);
+    return count;
+}
+
 int usbOpenDevice(usbDevice_t **device, int vendor, char *vendorName, int product, char *productName, int usesReportIDs)
+{
+    return usbOpenDeviceAt(device, NULL, vendor, vendorName, product, productName, usesReportIDs);
+}
+
+int usbOpenDeviceAt(usbDevice_t **device, char *location, int vendor, char *vendorName, int product, char *productName, int usesReportIDs)
 {
 GUID                                hidGuid;        /* GUID for HID driver */
 HDEVINFO                            deviceInfoList;
 SP_DEVICE_INTERFACE_DATA            deviceInfo;
 SP_DEVICE_INTERFACE_DETAIL_DATA     *deviceDetails = NULL;
 DWORD                               size;
-int                                 i, openFlag = 0;  /* may be FILE_FLAG_OVERLAPPED */
+int                                 i, openFlag = FILE_FLAG_OVERLAPPED;  /* for usbReadInterrupt() */
 int                                 errorCode = USB_ERROR_NOTFOUND;
 HANDLE                              handle = INVALID_HANDLE_VALUE;
 HIDD_ATTRIBUTES                     deviceAttributes;
@@ -78,6 +117,8 @@ HIDD_ATTRIBUTES                     deviceAttributes;
         /* this call is for real: */
         SetupDiGetDeviceInterfaceDetail(deviceInfoList, &deviceInfo, deviceDetails, size, &size, NULL);
         DEBUG_PRINT(("checking HID path \"%s\"\n", deviceDetails->DevicePath));
+        if(location != NULL && strstr(deviceDetails->DevicePath, location) == NULL)
+            continue;   /* not the device at the requested location */
         /* attempt opening for R/W -- we don't care about devices which can't be accessed */
         handle = CreateFile(deviceDetails->DevicePath, GENERIC_READ|GENERIC_WRITE, FILE_SHARE_READ|FILE_SHARE_WRITE, NULL, OPEN_EXISTING, openFlag, NULL);
         if(handle == INVALID_HANDLE_VALUE){
@@ -126,6 +167,13 @@ HIDD_ATTRIBUTES                     deviceAttributes;
 
 /* ------------------------------------------------------------------------ */
 
+void    usbSetTimeout(int milliseconds)
+{
+    /* HidD_SetFeature() and HidD_GetFeature() have no timeout parameter */
+}
+
+/* ------------------------------------------------------------------------ */
+
 void    usbCloseDevice(usbDevice_t *device)
 {
     CloseHandle((HANDLE)device);
@@ -133,6 +181,37 @@ void    usbCloseDevice(usbDevice_t *device)
 
 /* ------------------------------------------------------------------------ */
 
+static BOOLEAN  usbTransfer(HANDLE handle, int isWrite, char *buffer, int len, DWORD *bytes, DWORD timeout)
+/* ReadFile() and WriteFile() on the handle opened with FILE_FLAG_OVERLAPPED;
+ * returns 0 and sets the last error to WAIT_TIMEOUT if the transfer did not
+ * complete within 'timeout' milliseconds.
+ */
+{
+OVERLAPPED  overlapped;
+BOOLEAN     rval;
+
+    memset(&overlapped, 0, sizeof(overlapped));
+    overlapped.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+    if(isWrite){
+        rval = WriteFile(handle, buffer, len, NULL, &overlapped);
+    }else{
+        rval = ReadFile(handle, buffer, len, NULL, &overlapped);
+    }
+    if(!rval && GetLastError() == ERROR_IO_PENDING){
+        if(WaitForSingleObject(overlapped.hEvent, timeout) != WAIT_OBJECT_0)
+            CancelIo(handle);   /* reports stay queued in the HID driver */
+        rval = GetOverlappedResult(handle, &overlapped, bytes, TRUE);
+        if(!rval && GetLastError() == ERROR_OPERATION_ABORTED)
+            SetLastError(WAIT_TIMEOUT);
+    }else if(rval){
+        rval = GetOverlappedResult(handle, &overlapped, bytes, TRUE);
+    }
+    CloseHandle(overlapped.hEvent);
+    return rval;
+}
+
+/* ------------------------------------------------------------------------ */
+
 int usbSetReport(usbDevice_t *device, int reportType, char *buffer, int len)
 {
 HANDLE  handle = (HANDLE)device;
@@ -143,7 +222,7 @@ DWORD   bytesWritten;
     case USB_HID_REPORT_TYPE_INPUT:
         break;
     case USB_HID_REPORT_TYPE_OUTPUT:
-        rval = WriteFile(handle, buffer, len, &bytesWritten, NULL);
+        rval = usbTransfer(handle, 1, buffer, len, &bytesWritten, INFINITE);
         break;
     case USB_HID_REPORT_TYPE_FEATURE:
         rval = HidD_SetFeature(handle, buffer, len);
@@ -163,7 +242,7 @@ DWORD   bytesRead;
     switch(reportType){
     case USB_HID_REPORT_TYPE_INPUT:
         buffer[0] = reportNumber;
-        rval = ReadFile(handle, buffer, *len, &bytesRead, NULL);
+        rval = usbTransfer(handle, 0, buffer, *len, &bytesRead, INFINITE);
         if(rval)
             *len = bytesRead;
         break;
@@ -178,3 +257,15 @@ DWORD   bytesRead;
 }
 
 /* ------------------------------------------------------------------------ */
+
+int usbReadInterrupt(usbDevice_t *device, char *buffer, int *len, int timeout)
+{
+DWORD   bytesRead;
+
+    if(!usbTransfer((HANDLE)device, 0, buffer, *len, &bytesRead, timeout))
+        return GetLastError() == WAIT_TIMEOUT ? USB_ERROR_TIMEOUT : USB_ERROR_IO;
+    *len = bytesRead;
+    return 0;
+}
+
+/* ------------------------------------------------------------------------ */
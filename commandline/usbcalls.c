@@ -9,12 +9,77 @@
  */
 
 /* This file includes the appropriate implementation based on platform
- * specific defines.
+ * specific defines. The implementation's functions are renamed, the public
+ * functions are in usb-record.c, which can record and replay all calls,
+ * inject faults (usb-fault.c) and use a simulated device (usb-sim.c).
  */
 
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#ifndef WIN32
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#endif
+
+#define usbOpenDevice       usbBackendOpenDevice
+#define usbOpenDeviceAt     usbBackendOpenDeviceAt
+#define usbCountDevices     usbBackendCountDevices
+#define usbSetTimeout       usbBackendSetTimeout
+#define usbCloseDevice      usbBackendCloseDevice
+#define usbSetReport        usbBackendSetReport
+#define usbGetReport        usbBackendGetReport
+#define usbReadInterrupt    usbBackendReadInterrupt
+
 #if defined(WIN32)
 #   include "usb-windows.c"
 #else
 /* e.g. defined(__APPLE__) */
 #   include "usb-libusb.c"
 #endif
+
+#undef usbOpenDevice
+#undef usbOpenDeviceAt
+#undef usbCountDevices
+#undef usbSetTimeout
+#undef usbCloseDevice
+#undef usbSetReport
+#undef usbGetReport
+#undef usbReadInterrupt
+
+/* ------------------------------------------------------------------------- */
+
+static double   usbTime(void)
+{
+#ifdef WIN32
+LARGE_INTEGER   frequency, counter;
+
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (double)counter.QuadPart / frequency.QuadPart;
+#else
+struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec + now.tv_nsec * 1e-9;
+#endif
+}
+
+static void usbWait(double seconds)
+{
+    if(seconds <= 0)
+        return;
+#ifdef WIN32
+    Sleep((DWORD)(seconds * 1000));
+#else
+    usleep((useconds_t)(seconds * 1e6));
+#endif
+}
+
+/* ------------------------------------------------------------------------- */
+
+#include "usb-sim.c"
+#include "usb-fault.c"
+#include "usb-record.c"
@@ -30,6 +30,7 @@ Mac OS X) and a native implementation for Windows are provided.
 #define USB_ERROR_NOTFOUND  2
 #define USB_ERROR_BUSY      16
 #define USB_ERROR_IO        5
+#define USB_ERROR_TIMEOUT   110
 /* These are the error codes which can be returned by functions of this
  * module.
  */
@@ -54,6 +55,25 @@ int usbOpenDevice(usbDevice_t **device, int vendor, char *vendorName, int produc
  * must be closed with usbCloseDevice(). If the device has not been found or
  * opening failed, an error code is returned.
  */
+int usbOpenDeviceAt(usbDevice_t **device, char *location, int vendor, char *vendorName, int product, char *productName, int usesReportIDs);
+/* This function is the same as usbOpenDevice(), except that only a device at
+ * the given 'location' is accepted if 'location' is not NULL. This is used to
+ * select one of several identical devices. With libusb, the location is given
+ * as "<bus>:<device>" (the numbers printed by lsusb). On Windows, it is a
+ * substring of the HID device path.
+ * Returns: The same as usbOpenDevice().
+ */
+int usbCountDevices(int vendor, int product);
+/* This function returns the number of devices with the given Vendor-ID and
+ * Product-ID which are currently connected. The devices are not opened, so
+ * this does not interfere with drivers or applications using them. Windows
+ * can only see devices of the HID class.
+ */
+void    usbSetTimeout(int milliseconds);
+/* This function sets the timeout for usbSetReport() and usbGetReport(). The
+ * default is 5000 ms. The Windows HID API does not support timeouts, the
+ * value is ignored there.
+ */
 void    usbCloseDevice(usbDevice_t *device);
 /* Every device opened with usbOpenDevice() must be closed with this function.
  */
@@ -75,6 +95,60 @@ int usbGetReport(usbDevice_t *device, int reportType, int reportID, char *buffer
  * in '*len'.
  * Returns: 0 on success, an error code otherwise.
  */
+int usbReadInterrupt(usbDevice_t *device, char *buffer, int *len, int timeout);
+/* This function waits at most 'timeout' milliseconds for an input report on
+ * the device's interrupt-in endpoint. Pass the size of 'buffer' in '*len'.
+ * The report (prefixed with its report ID) is returned in 'buffer' and its
+ * length in '*len'. It may be called from a second thread while the first one
+ * sends and receives reports on the same device. On Windows, input reports
+ * are queued by the HID driver, so a timeout of 0 just polls the queue; with
+ * libusb, the timeout should be longer than the endpoint's poll interval.
+ * These calls are not recorded, during replay they fail with USB_ERROR_IO.
+ * Returns: 0 on success, USB_ERROR_TIMEOUT if no report arrived in time,
+ * another error code otherwise.
+ */
+
+int usbRecordTo(char *file);
+/* This function starts recording all subsequent calls of this module to
+ * 'file'. See usb-record.c for the format.
+ * Returns: 0 on success, -1 if the file cannot be created.
+ */
+int usbReplayFrom(char *file, double speed);
+/* This function makes all subsequent calls of this module return what was
+ * recorded in 'file' instead of accessing devices. Each call takes the
+ * recorded time multiplied by 'speed', 0 means no delay.
+ * Returns: 0 on success, -1 if the file cannot be read.
+ */
+int usbMonitorTo(char *file);
+/* This function writes the report transfers of all subsequent calls to
+ * 'file' in Linux usbmon format, as pcap file if the name ends in ".pcap",
+ * as text otherwise. See usb-record.c.
+ * Returns: 0 on success, -1 if the file cannot be created.
+ */
+int usbReplayMismatches(void);
+/* This function returns the number of reports sent during replay which
+ * differ from the recording.
+ */
+
+int usbSimulate(int flashSize, int pageSize, int bootSize, double reportTime, double pageTime);
+/* This function replaces the devices with a simulated HIDBoot device with
+ * the given flash, page and boot loader size (in bytes). Each transfer takes 'reportTime'
+ * seconds, each page erase and write 'pageTime' seconds. Calling it again
+ * resets the device to blank flash.
+ * Returns: 0.
+ */
+char    *usbSimulatedFlash(int *exits);
+/* This function returns the flash contents of the simulated device and the
+ * number of exit requests it received in '*exits' (if not NULL).
+ */
+int usbAddFault(char *spec);
+/* This function adds a fault to be injected into subsequent calls. See
+ * usb-fault.c for the format of 'spec', e.g. "io@at=10".
+ * Returns: 0 on success, -1 if 'spec' is invalid.
+ */
+void    usbClearFaults(void);
+/* This function removes all faults and resets the call counters.
+ */
 
 /* ------------------------------------------------------------------------ */
 
@@ -0,0 +1,258 @@
+/* Name: watch.c
+ * Project: AVR bootloader HID
+ * Author: bootloadHID contributors
+ * Creation Date: 2026-10-19
+ * Tabsize: 4
+ * License: Proprietary, free under certain conditions. See Documentation.
+ * This Revision: $Id$
+ */
+
+/*
+General Description:
+This module implements watch mode ("--watch <file>"). It waits until the
+Intel-Hex or ELF file is rewritten (e.g. by a build), waits for the HIDBoot
+device (starting it with "--trigger" if given) and uploads the new image,
+then starts the application as with "-r".
+The file is only parsed again if its contents changed. Pages which are the
+same as in the previous successful upload are not transferred again.
+
+On Linux, changes are detected with inotify on the file's directory, so that
+files replaced by rename are noticed as well. On other systems, the
+modification time is polled.
+
+Ctrl-C stops watching after the upload in progress, so that the trace file
+and the statistics are completed as after any other run. A second Ctrl-C
+terminates at once.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/stat.h>
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+#include "usbcalls.h"
+#include "bootloadHID.h"
+
+#define SETTLE_TIME_MS  200     /* wait for writes to finish before reading */
+#define POLL_TIME_MS    500     /* how often waiting checks for Ctrl-C */
+
+static volatile sig_atomic_t    stopRequested;
+
+/* ------------------------------------------------------------------------- */
+
+static void stopWatch(int sig)
+{
+    stopRequested = 1;
+    signal(sig, SIG_DFL);   /* a second Ctrl-C terminates at once */
+}
+
+static int  hashFile(char *file, unsigned long long *hash)
+{
+FILE                *input;
+unsigned char       buffer[4096];
+size_t              len, i;
+unsigned long long  h = 14695981039346656037ULL;    /* FNV-1a */
+
+    if((input = fopen(file, "rb")) == NULL){
+        fprintf(stderr, "error opening %s: %s\n", file, strerror(errno));
+        return 1;
+    }
+    while((len = fread(buffer, 1, sizeof(buffer), input)) > 0){
+        for(i = 0; i < len; i++){
+            h ^= buffer[i];
+            h *= 1099511628211ULL;
+        }
+    }
+    fclose(input);
+    *hash = h;
+    return 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+#ifdef __linux__
+
+static int  watchFd = -1;
+static char *watchName;
+
+static int  initWatch(char *file)
+{
+char    *dir, *slash;
+
+    if((slash = strrchr(file, '/')) != NULL){
+        watchName = slash + 1;
+        dir = malloc(slash - file + 2);
+        memcpy(dir, file, slash - file);
+        dir[slash - file] = 0;
+        if(*dir == 0)
+            strcpy(dir, "/");
+    }else{
+        watchName = file;
+        dir = strdup(".");
+    }
+    watchFd = inotify_init();
+    if(watchFd < 0 || inotify_add_watch(watchFd, dir, IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0){
+        fprintf(stderr, "Cannot watch directory %s: %s\n", dir, strerror(errno));
+        free(dir);
+        return 1;
+    }
+    free(dir);
+    return 0;
+}
+
+static int  readWatchEvents(int timeout)
+{
+char                    buffer[4096];
+struct pollfd           pfd;
+struct inotify_event    *event;
+int                     len, offset, found = 0;
+
+    pfd.fd = watchFd;
+    pfd.events = POLLIN;
+    if(poll(&pfd, 1, timeout) <= 0)
+        return 0;
+    if((len = read(watchFd, buffer, sizeof(buffer))) <= 0)
+        return 0;
+    for(offset = 0; offset < len; offset += sizeof(*event) + event->len){
+        event = (struct inotify_event *)(buffer + offset);
+        if(event->len > 0 && strcmp(event->name, watchName) == 0)
+            found = 1;
+    }
+    return found;
+}
+
+static void waitForChange(void)
+{
+    while(!readWatchEvents(POLL_TIME_MS)){
+        if(stopRequested)
+            return;
+    }
+    while(readWatchEvents(SETTLE_TIME_MS))  /* wait until the writer is done */
+        ;
+}
+
+#else
+
+static char         *watchName;
+static struct stat  watchStat;
+
+static int  initWatch(char *file)
+{
+    watchName = file;
+    stat(file, &watchStat);
+    return 0;
+}
+
+static void waitForChange(void)
+{
+struct stat st;
+
+    while(!stopRequested){
+        sleepMs(POLL_TIME_MS);
+        if(stat(watchName, &st) == 0 && (st.st_mtime != watchStat.st_mtime || st.st_size != watchStat.st_size)){
+            watchStat = st;
+            sleepMs(SETTLE_TIME_MS);
+            return;
+        }
+    }
+}
+
+#endif
+
+/* ------------------------------------------------------------------------- */
+
+int runWatch(char *file, trigger_t *trigger)
+{
+char                *image, *flashed, *base;
+int                 startAddr = 0, endAddr = 0, flashedStart = 0, flashedEnd = 0, haveImage = 0, haveFlashed = 0;
+int                 address, err, first = 1;
+unsigned long long  hash, imageHash = 0, flashedHash = 0;
+double              tStart, tParsed, tDevice, tDone;
+
+    if(initWatch(file))
+        return 1;
+    image = malloc(IMAGE_BUFFER_SIZE);
+    flashed = malloc(IMAGE_BUFFER_SIZE);
+    base = malloc(IMAGE_BUFFER_SIZE);
+    signal(SIGINT, stopWatch);
+    for(;; first = 0){
+        if(!first){
+            printf("Watching %s for changes...\n", file);
+            fflush(stdout);
+            waitForChange();
+        }
+        if(stopRequested)
+            break;
+        tStart = getTime();
+        if(hashFile(file, &hash))
+            continue;
+        if(haveFlashed && hash == flashedHash){
+            printf("%s: contents unchanged\n", file);
+            continue;
+        }
+        if(!haveImage || hash != imageHash){
+            memset(image, -1, IMAGE_BUFFER_SIZE);
+            startAddr = IMAGE_BUFFER_SIZE;
+            endAddr = 0;
+            haveImage = 0;
+            if(parseImageFile(file, image, &startAddr, &endAddr))
+                continue;
+            if(startAddr >= endAddr){
+                fprintf(stderr, "No data in %s\n", file);
+                continue;
+            }
+            haveImage = 1;
+            imageHash = hash;
+        }
+        tParsed = getTime();
+        if(trigger->type != TRIGGER_NONE && usbCountDevices(IDENT_VENDOR_NUM, IDENT_PRODUCT_NUM) == 0){
+            printf("Triggering boot loader...\n");
+            fireTrigger(trigger);
+        }
+        printf("Waiting for HIDBoot device...\n");
+        fflush(stdout);
+        while(waitForBootLoader(NULL, POLL_TIME_MS * 1e-3) != 0){
+            if(stopRequested)
+                break;
+        }
+        if(stopRequested)
+            break;
+        tDevice = getTime();
+        if(haveFlashed){
+            /* pages we don't know for sure must differ from the new image */
+            for(address = 0; address < IMAGE_BUFFER_SIZE; address++){
+                if(address >= flashedStart && address < flashedEnd){
+                    base[address] = flashed[address];
+                }else{
+                    base[address] = ~image[address];
+                }
+            }
+        }
+        err = uploadData(image, startAddr, endAddr, NULL, 1, haveFlashed ? base : NULL);
+        tDone = getTime();
+        if(err == 0){
+            memcpy(flashed, image, IMAGE_BUFFER_SIZE);
+            flashedStart = startAddr;
+            flashedEnd = endAddr;
+            flashedHash = hash;
+            haveFlashed = 1;
+        }else{
+            haveFlashed = 0;    /* flash contents are unknown now */
+        }
+        printf("Timing: parse %.3f s, wait for device %.3f s, upload %.3f s, total %.3f s\n",
+            tParsed - tStart, tDevice - tParsed, tDone - tDevice, tDone - tStart);
+    }
+    signal(SIGINT, SIG_DFL);
+    free(image);
+    free(flashed);
+    free(base);
+    return 0;
+}
+
+/* ------------------------------------------------------------------------- */